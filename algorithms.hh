@@ -0,0 +1,524 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+#ifndef ALGORITHMS_HH_
+#define ALGORITHMS_HH_
+
+static_assert(__cplusplus >= 201402L, "Requires C++14 or newer.");
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "projected_algorithms.hh"
+#include "projection_iterator.hh"
+#include "projections.hh"
+
+// Counterparts of standard algorithms that recognize ProjIter ranges over the
+// projections in projections.hh, and work on the underlying layout rather
+// than through the projection one element at a time:
+//
+//     auto first = jz::make_projection_iterator(v.begin(), projection);
+//     jz::sort(first, first + v.size());
+//
+// For other iterators, each forwards to its std:: counterpart.  The ProjIter
+// overloads are more specialized than the std:: ones, so unqualified calls
+// that find both by argument-dependent lookup pick these.
+//
+// Over affine projections (see is_affine_projection), the view is a strided
+// run of the base.  With a stride of 1 or -1, that run is contiguous, so the
+// sorts, selections, and rotations run on the base range directly, flipping
+// the comparison or the rotation for -1.  find() and reverse() walk the base
+// by its stride.  A sort of a whole folded interleave view sorts the base
+// contiguously and then lays it out, as folded_interleave_sort() does.  The
+// remaining cases gather the view into contiguous scratch storage, run the
+// algorithm there, and scatter the result back, as projected_sort() does,
+// which costs two passes through the projection rather than one per element
+// access.  Only find() and reverse() keep to the generic algorithm for
+// projections they don't know.
+//
+// These all need random access base iterators for their fast paths, and
+// leave forward and bidirectional bases to the gathering or generic paths.
+namespace jz {
+namespace detail {
+
+// Returns the projection a ProjRef refers to, or the projection itself, so
+// that dispatch sees through proj_ref().
+template <typename Proj>
+constexpr const Proj& underlying_projection(const Proj& projection) noexcept {
+  return projection;
+}
+
+template <typename Callable>
+constexpr const Callable& underlying_projection(
+    const ProjRef<Callable>& ref) noexcept {
+  return ref.get();
+}
+
+template <typename Callable>
+using underlying_projection_t = std::decay_t<
+    decltype(underlying_projection(std::declval<const Callable&>()))>;
+
+template <typename Proj>
+struct is_folded_interleave_projection : std::false_type {};
+
+template <std::ptrdiff_t Size>
+struct is_folded_interleave_projection<FoldedInterleaveProjection<Size>>
+    : std::true_type {};
+
+// The layouts with their own implementations, in order of preference.
+enum class ViewLayout {
+  kAffine,            // A strided run of the base.
+  kFoldedInterleave,  // The folded interleave layout.
+  kGeneric,           // Anything else, or a base without random access.
+};
+
+template <typename Iter, typename Callable>
+constexpr ViewLayout view_layout() noexcept {
+  using Proj = underlying_projection_t<Callable>;
+  return !std::is_base_of<
+             std::random_access_iterator_tag,
+             typename std::iterator_traits<Iter>::iterator_category>::value
+      ? ViewLayout::kGeneric
+      : is_affine_projection<Proj>::value
+      ? ViewLayout::kAffine
+      : is_folded_interleave_projection<Proj>::value
+      ? ViewLayout::kFoldedInterleave
+      : ViewLayout::kGeneric;
+}
+
+template <ViewLayout Layout>
+using view_layout_tag = std::integral_constant<ViewLayout, Layout>;
+
+template <typename Iter, typename Callable>
+using view_layout_tag_t = view_layout_tag<view_layout<Iter, Callable>()>;
+
+// For a view over an affine projection, returns the stride between elements
+// in the base.
+template <typename Iter, typename Callable>
+constexpr std::ptrdiff_t affine_stride(
+    const ProjIter<Iter, Callable>& first) noexcept {
+  return to_affine_projection(underlying_projection(first.projection()))
+      .stride();
+}
+
+// Returns the base iterator to the first element of a view.
+template <typename Iter, typename Callable>
+auto base_of(const ProjIter<Iter, Callable>& first) {
+  return first.base() + first.projection()(first.index());
+}
+
+// For a view over an affine projection with a stride of 1 or -1, returns the
+// lowest base iterator the view reaches, so that the view covers the base
+// range starting there forward or backward.
+template <typename Iter, typename Callable>
+auto contiguous_base_of(const ProjIter<Iter, Callable>& first,
+                        const std::ptrdiff_t size) {
+  return affine_stride(first) == 1 ? base_of(first)
+                                   : base_of(first) - (size - 1);
+}
+
+template <typename Iter, typename Callable>
+bool is_contiguous_view(const ProjIter<Iter, Callable>& first) noexcept {
+  const auto stride = affine_stride(first);
+  return stride == 1 || stride == -1;
+}
+
+// Indicates whether [first, last) is the whole of a folded interleave view,
+// the only extent for which the layout is a permutation of the base.
+template <typename Iter, typename Callable>
+bool is_whole_view(const ProjIter<Iter, Callable>& first,
+                   const ProjIter<Iter, Callable>& last) noexcept {
+  return first.index() == 0 &&
+         last - first == underlying_projection(first.projection()).size();
+}
+
+// Flips a comparison, for sorting a reversed view through its base.
+template <typename Compare>
+class ReversedCompare {
+ public:
+  explicit ReversedCompare(Compare comp) : comp_{std::move(comp)} {}
+
+  template <typename T, typename U>
+  bool operator()(T&& lhs, U&& rhs) {
+    return comp_(std::forward<U>(rhs), std::forward<T>(lhs));
+  }
+
+ private:
+  Compare comp_;
+};
+
+template <typename Compare>
+ReversedCompare<Compare> reversed_compare(Compare comp) {
+  return ReversedCompare<Compare>(std::move(comp));
+}
+
+// Gathers the view into scratch storage, runs fn over the scratch storage,
+// and scatters the result back.
+template <typename RandomIt, typename Fn>
+void through_scratch(RandomIt first, RandomIt last, Fn fn) {
+  auto scratch =
+      std::vector<typename std::iterator_traits<RandomIt>::value_type>{};
+  gather(first, last, scratch);
+  fn(scratch.begin(), scratch.end());
+  scatter(scratch.begin(), first, last);
+}
+
+// sort() and stable_sort().
+template <bool IsStable, typename RandomIt, typename Compare>
+void sort_contiguous(RandomIt first, RandomIt last, Compare comp) {
+  if (IsStable) {
+    std::stable_sort(first, last, comp);
+  } else {
+    std::sort(first, last, comp);
+  }
+}
+
+template <bool IsStable, typename Iter, typename Callable, typename Compare,
+          ViewLayout Layout>
+void sort(ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last,
+          Compare comp, view_layout_tag<Layout>) {
+  if (IsStable) {
+    projected_stable_sort(first, last, comp);
+  } else {
+    projected_sort(first, last, comp);
+  }
+}
+
+// Stable sorts can't flip the comparison: equal elements would keep their
+// base order, which is the reverse of their view order.
+template <bool IsStable, typename Iter, typename Callable, typename Compare>
+void sort(ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last,
+          Compare comp, view_layout_tag<ViewLayout::kAffine>) {
+  const auto size = last - first;
+  if (size < 2) {
+    return;
+  }
+  if (affine_stride(first) == 1) {
+    const auto base = base_of(first);
+    sort_contiguous<IsStable>(base, base + size, comp);
+  } else if (affine_stride(first) == -1 && !IsStable) {
+    const auto base = contiguous_base_of(first, size);
+    std::sort(base, base + size, reversed_compare(comp));
+  } else {
+    sort<IsStable>(first, last, comp, view_layout_tag<ViewLayout::kGeneric>{});
+  }
+}
+
+// The same goes for the folded interleave layout, since it interleaves the
+// back half of the view in reverse.
+template <bool IsStable, typename Iter, typename Callable, typename Compare>
+void sort(ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last,
+          Compare comp, view_layout_tag<ViewLayout::kFoldedInterleave>) {
+  if (!IsStable && is_whole_view(first, last)) {
+    const auto base = first.base();
+    folded_interleave_sort(base, base + (last - first), comp);
+  } else {
+    sort<IsStable>(first, last, comp, view_layout_tag<ViewLayout::kGeneric>{});
+  }
+}
+
+// nth_element().
+template <typename Iter, typename Callable, typename Compare,
+          ViewLayout Layout>
+void nth_element(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> nth,
+    ProjIter<Iter, Callable> last, Compare comp, view_layout_tag<Layout>) {
+  const auto n = nth - first;
+  through_scratch(first, last, [n, &comp](auto scratch_first,
+                                          auto scratch_last) {
+    std::nth_element(scratch_first, scratch_first + n, scratch_last, comp);
+  });
+}
+
+template <typename Iter, typename Callable, typename Compare>
+void nth_element(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> nth,
+    ProjIter<Iter, Callable> last, Compare comp,
+    view_layout_tag<ViewLayout::kAffine>) {
+  const auto size = last - first;
+  const auto n = nth - first;
+  if (size == 0 || n == size) {
+    return;
+  }
+  if (affine_stride(first) == 1) {
+    const auto base = base_of(first);
+    std::nth_element(base, base + n, base + size, comp);
+  } else if (affine_stride(first) == -1) {
+    const auto base = contiguous_base_of(first, size);
+    std::nth_element(
+        base, base + (size - 1 - n), base + size, reversed_compare(comp));
+  } else {
+    nth_element(first, nth, last, comp,
+                view_layout_tag<ViewLayout::kGeneric>{});
+  }
+}
+
+// partial_sort().
+template <typename Iter, typename Callable, typename Compare,
+          ViewLayout Layout>
+void partial_sort(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> middle,
+    ProjIter<Iter, Callable> last, Compare comp, view_layout_tag<Layout>) {
+  const auto n = middle - first;
+  through_scratch(first, last, [n, &comp](auto scratch_first,
+                                          auto scratch_last) {
+    std::partial_sort(scratch_first, scratch_first + n, scratch_last, comp);
+  });
+}
+
+template <typename Iter, typename Callable, typename Compare>
+void partial_sort(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> middle,
+    ProjIter<Iter, Callable> last, Compare comp,
+    view_layout_tag<ViewLayout::kAffine>) {
+  if (first == middle) {
+    return;
+  }
+  if (affine_stride(first) == 1) {
+    const auto base = base_of(first);
+    std::partial_sort(base, base + (middle - first), base + (last - first),
+                      comp);
+  } else {
+    partial_sort(first, middle, last, comp,
+                 view_layout_tag<ViewLayout::kGeneric>{});
+  }
+}
+
+// rotate().  The general case gathers the two parts in their rotated order,
+// and scatters them back.
+template <typename Iter, typename Callable, ViewLayout Layout>
+void rotate(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> middle,
+    ProjIter<Iter, Callable> last, view_layout_tag<Layout>) {
+  auto scratch =
+      std::vector<typename ProjIter<Iter, Callable>::value_type>{};
+  scratch.reserve(last - first);
+  const auto out = std::back_inserter(scratch);
+  move_out(first, middle, move_out(middle, last, out));
+  scatter(scratch.begin(), first, last);
+}
+
+template <typename Iter, typename Callable>
+void rotate(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> middle,
+    ProjIter<Iter, Callable> last, view_layout_tag<ViewLayout::kAffine>) {
+  const auto size = last - first;
+  const auto n = middle - first;
+  if (n == 0 || n == size) {
+    return;
+  }
+  if (affine_stride(first) == 1) {
+    const auto base = base_of(first);
+    std::rotate(base, base + n, base + size);
+  } else if (affine_stride(first) == -1) {
+    // Rotating the view left rotates the base right.
+    const auto base = contiguous_base_of(first, size);
+    std::rotate(base, base + (size - n), base + size);
+  } else {
+    rotate(first, middle, last, view_layout_tag<ViewLayout::kGeneric>{});
+  }
+}
+
+// reverse().
+template <typename Iter, typename Callable, ViewLayout Layout>
+void reverse(ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last,
+             view_layout_tag<Layout>) {
+  std::reverse(first, last);
+}
+
+template <typename Iter, typename Callable>
+void reverse(ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last,
+             view_layout_tag<ViewLayout::kAffine>) {
+  using std::swap;
+  const auto size = last - first;
+  if (size == 0) {
+    return;
+  }
+  const auto stride = affine_stride(first);
+  if (stride == 1 || stride == -1) {
+    const auto base = contiguous_base_of(first, size);
+    std::reverse(base, base + size);
+    return;
+  }
+  auto front = base_of(first);
+  auto back = front + stride * (size - 1);
+  for (auto i = size / 2; i > 0; --i) {
+    swap(*front, *back);
+    front += stride;
+    back -= stride;
+  }
+}
+
+// find().
+template <typename Iter, typename Callable, typename T, ViewLayout Layout>
+ProjIter<Iter, Callable> find(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last,
+    const T& value, view_layout_tag<Layout>) {
+  return std::find(first, last, value);
+}
+
+template <typename Iter, typename Callable, typename T>
+ProjIter<Iter, Callable> find(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last,
+    const T& value, view_layout_tag<ViewLayout::kAffine>) {
+  const auto size = last - first;
+  if (size == 0) {
+    return last;
+  }
+  // Indexes from the first element rather than stepping by the stride.  A
+  // step after the last element could leave the base, which is undefined
+  // even if nothing dereferences it.
+  const auto stride = affine_stride(first);
+  const auto base = base_of(first);
+  for (auto i = decltype(size){0}; i < size; ++i) {
+    if (base[stride * i] == value) {
+      return first + i;
+    }
+  }
+  return last;
+}
+
+}  // namespace detail
+
+template <typename RandomIt, typename Compare>
+void sort(RandomIt first, RandomIt last, Compare comp) {
+  std::sort(first, last, comp);
+}
+
+template <typename RandomIt>
+void sort(RandomIt first, RandomIt last) {
+  std::sort(first, last);
+}
+
+template <typename Iter, typename Callable, typename Compare>
+void sort(ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last,
+          Compare comp) {
+  detail::sort<false>(first, last, comp,
+                      detail::view_layout_tag_t<Iter, Callable>{});
+}
+
+template <typename Iter, typename Callable>
+void sort(ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last) {
+  jz::sort(first, last, std::less<>{});
+}
+
+template <typename RandomIt, typename Compare>
+void stable_sort(RandomIt first, RandomIt last, Compare comp) {
+  std::stable_sort(first, last, comp);
+}
+
+template <typename RandomIt>
+void stable_sort(RandomIt first, RandomIt last) {
+  std::stable_sort(first, last);
+}
+
+template <typename Iter, typename Callable, typename Compare>
+void stable_sort(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last,
+    Compare comp) {
+  detail::sort<true>(first, last, comp,
+                     detail::view_layout_tag_t<Iter, Callable>{});
+}
+
+template <typename Iter, typename Callable>
+void stable_sort(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last) {
+  jz::stable_sort(first, last, std::less<>{});
+}
+
+template <typename RandomIt, typename Compare>
+void nth_element(RandomIt first, RandomIt nth, RandomIt last, Compare comp) {
+  std::nth_element(first, nth, last, comp);
+}
+
+template <typename RandomIt>
+void nth_element(RandomIt first, RandomIt nth, RandomIt last) {
+  std::nth_element(first, nth, last);
+}
+
+template <typename Iter, typename Callable, typename Compare>
+void nth_element(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> nth,
+    ProjIter<Iter, Callable> last, Compare comp) {
+  detail::nth_element(first, nth, last, comp,
+                      detail::view_layout_tag_t<Iter, Callable>{});
+}
+
+template <typename Iter, typename Callable>
+void nth_element(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> nth,
+    ProjIter<Iter, Callable> last) {
+  jz::nth_element(first, nth, last, std::less<>{});
+}
+
+template <typename RandomIt, typename Compare>
+void partial_sort(
+    RandomIt first, RandomIt middle, RandomIt last, Compare comp) {
+  std::partial_sort(first, middle, last, comp);
+}
+
+template <typename RandomIt>
+void partial_sort(RandomIt first, RandomIt middle, RandomIt last) {
+  std::partial_sort(first, middle, last);
+}
+
+template <typename Iter, typename Callable, typename Compare>
+void partial_sort(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> middle,
+    ProjIter<Iter, Callable> last, Compare comp) {
+  detail::partial_sort(first, middle, last, comp,
+                       detail::view_layout_tag_t<Iter, Callable>{});
+}
+
+template <typename Iter, typename Callable>
+void partial_sort(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> middle,
+    ProjIter<Iter, Callable> last) {
+  jz::partial_sort(first, middle, last, std::less<>{});
+}
+
+template <typename ForwardIt>
+ForwardIt rotate(ForwardIt first, ForwardIt middle, ForwardIt last) {
+  return std::rotate(first, middle, last);
+}
+
+// Returns the iterator to where first's element ends up, as std::rotate does.
+template <typename Iter, typename Callable>
+ProjIter<Iter, Callable> rotate(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> middle,
+    ProjIter<Iter, Callable> last) {
+  detail::rotate(first, middle, last,
+                 detail::view_layout_tag_t<Iter, Callable>{});
+  return first + (last - middle);
+}
+
+template <typename BidirIt>
+void reverse(BidirIt first, BidirIt last) {
+  std::reverse(first, last);
+}
+
+template <typename Iter, typename Callable>
+void reverse(ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last) {
+  detail::reverse(first, last, detail::view_layout_tag_t<Iter, Callable>{});
+}
+
+template <typename InputIt, typename T>
+InputIt find(InputIt first, InputIt last, const T& value) {
+  return std::find(first, last, value);
+}
+
+template <typename Iter, typename Callable, typename T>
+ProjIter<Iter, Callable> find(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last,
+    const T& value) {
+  return detail::find(first, last, value,
+                      detail::view_layout_tag_t<Iter, Callable>{});
+}
+
+}  // namespace jz
+
+#endif // ALGORITHMS_HH_
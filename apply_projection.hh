@@ -0,0 +1,209 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+#ifndef APPLY_PROJECTION_HH_
+#define APPLY_PROJECTION_HH_
+
+static_assert(__cplusplus >= 201402L, "Requires C++14 or newer.");
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "projected_algorithms.hh"
+#include "projection_iterator.hh"
+#include "projections.hh"
+
+namespace jz {
+namespace detail {
+
+// Indicates whether index leads its cycle of projection, i.e. is the
+// smallest index in it.  This walks the cycle until it finds a smaller index
+// or comes back around.
+template <typename Proj>
+bool leads_cycle(const Proj& projection, const std::ptrdiff_t index) {
+  auto next = static_cast<std::ptrdiff_t>(projection(index));
+  while (next > index) {
+    next = projection(next);
+  }
+  return next == index;
+}
+
+// The general cycle-leader algorithms.  Each cycle is rotated from the
+// smallest index in it, which needs no marks, so they take O(1) extra space.
+// Finding the leaders takes O(n log n) time for a random permutation, but up
+// to O(n^2) for an adversarial one.
+template <typename RandomIt, typename Proj>
+void apply_projection(
+    const RandomIt first, const std::ptrdiff_t size, const Proj& projection) {
+  for (auto leader = std::ptrdiff_t{0}; leader < size; ++leader) {
+    if (!leads_cycle(projection, leader)) {
+      continue;
+    }
+    auto value = std::move(first[leader]);
+    auto index = leader;
+    for (std::ptrdiff_t next = projection(index); next != leader;
+         next = projection(next)) {
+      first[index] = std::move(first[next]);
+      index = next;
+    }
+    first[index] = std::move(value);
+  }
+}
+
+template <typename RandomIt, typename Proj>
+void apply_inverse_projection(
+    const RandomIt first, const std::ptrdiff_t size, const Proj& projection) {
+  using std::swap;
+  for (auto leader = std::ptrdiff_t{0}; leader < size; ++leader) {
+    if (!leads_cycle(projection, leader)) {
+      continue;
+    }
+    auto value = std::move(first[leader]);
+    auto index = leader;
+    do {
+      index = projection(index);
+      swap(value, first[index]);
+    } while (index != leader);
+  }
+}
+
+// The identity and reversal are their own inverses.
+template <typename RandomIt>
+void apply_projection(
+    RandomIt, std::ptrdiff_t, const StrideProjection<1>&) noexcept {}
+
+template <typename RandomIt>
+void apply_inverse_projection(
+    RandomIt, std::ptrdiff_t, const StrideProjection<1>&) noexcept {}
+
+template <typename RandomIt, std::ptrdiff_t Size>
+void apply_projection(
+    const RandomIt first, const std::ptrdiff_t size,
+    const ReverseProjection<Size>&) {
+  std::reverse(first, first + size);
+}
+
+template <typename RandomIt, std::ptrdiff_t Size>
+void apply_inverse_projection(
+    const RandomIt first, const std::ptrdiff_t size,
+    const ReverseProjection<Size>&) {
+  std::reverse(first, first + size);
+}
+
+// The folded interleave layout is a reversal and a perfect shuffle (see
+// folded_interleave_layout()), each O(n) in place.
+template <typename RandomIt, std::ptrdiff_t Size>
+void apply_projection(
+    const RandomIt first, const std::ptrdiff_t size,
+    const FoldedInterleaveProjection<Size>&) {
+  folded_interleave_unlayout(first, first + size);
+}
+
+template <typename RandomIt, std::ptrdiff_t Size>
+void apply_inverse_projection(
+    const RandomIt first, const std::ptrdiff_t size,
+    const FoldedInterleaveProjection<Size>&) {
+  folded_interleave_layout(first, first + size);
+}
+
+// With one-element blocks, the block interleave is a perfect out-shuffle.
+template <typename RandomIt, std::ptrdiff_t Size>
+void apply_projection(
+    const RandomIt first, const std::ptrdiff_t size,
+    const BlockInterleaveProjection<1, Size>&) {
+  out_unshuffle(first, size / 2);
+}
+
+template <typename RandomIt, std::ptrdiff_t Size>
+void apply_inverse_projection(
+    const RandomIt first, const std::ptrdiff_t size,
+    const BlockInterleaveProjection<1, Size>&) {
+  out_shuffle(first, size / 2);
+}
+
+// Looks through proj_ref() for the projections above.
+template <typename RandomIt, typename Callable>
+void apply_projection(
+    const RandomIt first, const std::ptrdiff_t size,
+    const ProjRef<Callable>& projection) {
+  apply_projection(first, size, projection.get());
+}
+
+template <typename RandomIt, typename Callable>
+void apply_inverse_projection(
+    const RandomIt first, const std::ptrdiff_t size,
+    const ProjRef<Callable>& projection) {
+  apply_inverse_projection(first, size, projection.get());
+}
+
+}  // namespace detail
+
+// Rearranges [first, last) in place into the order of its view through
+// projection, so that afterwards, [first, last) holds what
+//
+//     make_projection_iterator(first, projection)
+//
+// showed over the same indices before.  Later scans can then read the range
+// contiguously rather than through a ProjIter.  The projection must be a
+// permutation of [0, last - first).
+//
+// The identity, ReverseProjection, FoldedInterleaveProjection and the perfect
+// shuffle, BlockInterleaveProjection<1>, each rearrange with a specialized
+// algorithm in O(n) time and O(1) extra space.  Other projections use the
+// cycle-leader algorithm, which also needs only O(1) extra space, but takes
+// O(n log n) time for typical permutations and O(n^2) at worst, and whose
+// accesses follow the projection around the range.  The overload below with
+// a scratch vector takes O(n) time for those, when memory allows.
+template <typename RandomIt, typename Proj>
+void apply_projection(RandomIt first, RandomIt last, const Proj& projection) {
+  detail::apply_projection(first, last - first, projection);
+}
+
+// Inverts apply_projection(), so that [first, last) holds what was in it
+// before, viewed through projection: each element at index i moves to index
+// projection(i).  For example, applying the inverse of the folded interleave
+// projection to a sorted range lays it out as folded_interleave_sort() does.
+template <typename RandomIt, typename Proj>
+void apply_inverse_projection(
+    RandomIt first, RandomIt last, const Proj& projection) {
+  detail::apply_inverse_projection(first, last - first, projection);
+}
+
+// As above, but rearranges out of place through the caller's scratch vector,
+// in O(n) time for any projection.  This gathers the projected view into
+// scratch in view order, and moves it back contiguously.  Piecewise affine
+// and walkable projections gather a segment or a walk at a time, as
+// projected_for_each() does.  Others, such as tables and bit reversal, read
+// the range in the projection's scattered order, one element per access;
+// this isn't cache blocked.  The scratch vector's contents are unspecified
+// afterwards, but its capacity is retained.
+template <typename RandomIt, typename Proj, typename Alloc>
+void apply_projection(
+    RandomIt first, RandomIt last, const Proj& projection,
+    std::vector<typename std::iterator_traits<RandomIt>::value_type, Alloc>&
+        scratch) {
+  const auto view = make_projection_iterator(first, proj_ref(projection));
+  detail::gather(view, view + (last - first), scratch);
+  std::move(scratch.begin(), scratch.end(), first);
+  scratch.clear();
+}
+
+// As above, but moves [first, last) out into scratch contiguously, and then
+// back in through the projection, so the writes fall in the projection's
+// order, a segment or a walk at a time where the projection allows.
+template <typename RandomIt, typename Proj, typename Alloc>
+void apply_inverse_projection(
+    RandomIt first, RandomIt last, const Proj& projection,
+    std::vector<typename std::iterator_traits<RandomIt>::value_type, Alloc>&
+        scratch) {
+  scratch.assign(std::make_move_iterator(first), std::make_move_iterator(last));
+  const auto view = make_projection_iterator(first, proj_ref(projection));
+  detail::scatter(scratch.begin(), view, view + (last - first));
+  scratch.clear();
+}
+
+}  // namespace jz
+
+#endif // APPLY_PROJECTION_HH_
@@ -0,0 +1,256 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+#ifndef BASE_CHECKPOINTS_HH_
+#define BASE_CHECKPOINTS_HH_
+
+static_assert(__cplusplus >= 201402L, "Requires C++14 or newer.");
+
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace jz {
+
+template <typename Iter>
+class CheckpointIter;
+
+// Records an iterator at every 2^log2_spacing'th position of a forward or
+// bidirectional range, such as a std::list, so that reaching any position
+// walks at most 2^log2_spacing - 1 steps from the checkpoint before it.  For
+// bidirectional ranges, positions in the back half of their interval walk
+// back from the checkpoint after it instead, which halves that bound.
+//
+// begin() and end() return CheckpointIter random access iterators over the
+// range, which can serve as the base of a ProjIter or ProjectedView, or be
+// passed to std::sort directly:
+//
+//     auto checkpoints = jz::make_base_checkpoints(list.begin(), list.end());
+//     auto first = jz::make_projection_iterator(checkpoints.begin(), proj);
+//     jz::projected_sort(first, first + list.size());
+//
+// That makes each access O(2^log2_spacing) rather than O(n), so sorts through
+// such views stay O(n log n) in all.  The table holds n / 2^log2_spacing
+// iterators, and building it walks the range once.
+//
+// The iterators refer back to the table, so it must outlive them, and must not
+// be moved while they're in use.  The checkpoints themselves are only as valid
+// as the iterators they hold.  Algorithms that assign to elements, as sorts
+// do, leave std::list iterators valid, but inserting into or erasing from the
+// range invalidates the table.
+template <typename Iter>
+class BaseCheckpoints {
+  using IterTraits = std::iterator_traits<Iter>;
+
+  static_assert(
+    std::is_base_of<
+      std::forward_iterator_tag,
+      typename IterTraits::iterator_category>::value,
+      "Must use a forward iterator.");
+
+  static constexpr bool kIsBidirectional =
+    std::is_base_of<
+      std::bidirectional_iterator_tag,
+      typename IterTraits::iterator_category>::value;
+
+ public:
+  using iterator = CheckpointIter<Iter>;
+
+  BaseCheckpoints(Iter first, Iter last, const int log2_spacing = 4)
+  : log2_spacing_{log2_spacing} {
+    assert(log2_spacing >= 0 && log2_spacing < 31);
+    const auto spacing = std::ptrdiff_t{1} << log2_spacing;
+    auto remaining = std::ptrdiff_t{0};
+    for (; first != last; ++first, ++size_) {
+      if (remaining-- == 0) {
+        checkpoints_.push_back(first);
+        remaining = spacing - 1;
+      }
+    }
+    // The end is a checkpoint too, so bidirectional walks can start from it.
+    checkpoints_.push_back(first);
+  }
+
+  iterator begin() const noexcept { return iterator{this, 0}; }
+  iterator end() const noexcept { return iterator{this, size_}; }
+
+  std::ptrdiff_t size() const noexcept { return size_; }
+  int log2_spacing() const noexcept { return log2_spacing_; }
+
+  // Returns an iterator to the element at index, walking from the nearest
+  // checkpoint that can reach it.
+  Iter at(const std::ptrdiff_t index) const {
+    assert(index >= 0 && index <= size_);
+    return walk_(index, std::integral_constant<bool, kIsBidirectional>{});
+  }
+
+ private:
+  std::vector<Iter> checkpoints_;
+  std::ptrdiff_t size_ = 0;
+  int log2_spacing_;
+
+  Iter walk_(const std::ptrdiff_t index, std::false_type) const {
+    const auto checkpoint = index >> log2_spacing_;
+    return std::next(checkpoints_[checkpoint],
+                     index - (checkpoint << log2_spacing_));
+  }
+
+  Iter walk_(const std::ptrdiff_t index, std::true_type) const {
+    const auto checkpoint = index >> log2_spacing_;
+    const auto steps = index - (checkpoint << log2_spacing_);
+    const auto next = checkpoint + 1;
+    const auto last = static_cast<std::ptrdiff_t>(checkpoints_.size()) - 1;
+    if (next <= last) {
+      // The last checkpoint is the end, which may be closer than spacing.
+      const auto next_index = next == last ? size_ : next << log2_spacing_;
+      if (next_index - index < steps) {
+        return std::prev(checkpoints_[next], next_index - index);
+      }
+    }
+    return std::next(checkpoints_[checkpoint], steps);
+  }
+};
+
+// Provides template argument deduction for BaseCheckpoints for C++14.  C++17
+// onward can deduce the template parameter from the constructor.
+template <typename Iter>
+BaseCheckpoints<Iter> make_base_checkpoints(
+    Iter first, Iter last, const int log2_spacing = 4) {
+  return BaseCheckpoints<Iter>(
+      std::move(first), std::move(last), log2_spacing);
+}
+
+// A random access iterator over the range a BaseCheckpoints table covers.
+// It holds a pointer to the table and an index, so moving it is O(1), and
+// dereferencing it walks from the nearest checkpoint, as BaseCheckpoints::at()
+// does.  The table must outlive it.
+template <typename Iter>
+class CheckpointIter {
+  using IterTraits = std::iterator_traits<Iter>;
+
+ public:
+  using iterator_category = std::random_access_iterator_tag;
+  using difference_type   = std::ptrdiff_t;
+  using value_type        = typename IterTraits::value_type;
+  using pointer           = typename IterTraits::pointer;
+  using reference         = typename IterTraits::reference;
+
+  // Constructs a singular iterator, which may only be assigned to.
+  CheckpointIter() noexcept = default;
+
+  reference operator*() const { return *base(); }
+
+  pointer operator->() const { return std::addressof(**this); }
+
+  reference operator[](const difference_type delta) const {
+    return *table_->at(index_ + delta);
+  }
+
+  CheckpointIter& operator++() noexcept {
+    ++index_;
+    return *this;
+  }
+
+  CheckpointIter operator++(int) noexcept {
+    auto copy = *this;
+    ++index_;
+    return copy;
+  }
+
+  CheckpointIter& operator--() noexcept {
+    --index_;
+    return *this;
+  }
+
+  CheckpointIter operator--(int) noexcept {
+    auto copy = *this;
+    --index_;
+    return copy;
+  }
+
+  CheckpointIter& operator+=(const difference_type delta) noexcept {
+    index_ += delta;
+    return *this;
+  }
+
+  CheckpointIter& operator-=(const difference_type delta) noexcept {
+    index_ -= delta;
+    return *this;
+  }
+
+  friend CheckpointIter operator+(
+      CheckpointIter it, const difference_type delta) noexcept {
+    return it += delta;
+  }
+
+  friend CheckpointIter operator+(
+      const difference_type delta, CheckpointIter it) noexcept {
+    return it += delta;
+  }
+
+  friend CheckpointIter operator-(
+      CheckpointIter it, const difference_type delta) noexcept {
+    return it -= delta;
+  }
+
+  friend difference_type operator-(
+      const CheckpointIter& lhs, const CheckpointIter& rhs) noexcept {
+    return lhs.index_ - rhs.index_;
+  }
+
+  // As with ProjIter, these don't check whether both iterators refer to the
+  // same table.
+  friend bool operator==(
+      const CheckpointIter& lhs, const CheckpointIter& rhs) noexcept {
+    return lhs.index_ == rhs.index_;
+  }
+
+  friend bool operator!=(
+      const CheckpointIter& lhs, const CheckpointIter& rhs) noexcept {
+    return !(lhs == rhs);
+  }
+
+  friend bool operator<(
+      const CheckpointIter& lhs, const CheckpointIter& rhs) noexcept {
+    return lhs.index_ < rhs.index_;
+  }
+
+  friend bool operator>(
+      const CheckpointIter& lhs, const CheckpointIter& rhs) noexcept {
+    return rhs < lhs;
+  }
+
+  friend bool operator<=(
+      const CheckpointIter& lhs, const CheckpointIter& rhs) noexcept {
+    return !(rhs < lhs);
+  }
+
+  friend bool operator>=(
+      const CheckpointIter& lhs, const CheckpointIter& rhs) noexcept {
+    return !(lhs < rhs);
+  }
+
+  // Returns the underlying iterator to the same element.
+  Iter base() const { return table_->at(index_); }
+
+  // Returns our index within the range.
+  difference_type index() const noexcept { return index_; }
+
+ private:
+  friend class BaseCheckpoints<Iter>;
+
+  CheckpointIter(
+      const BaseCheckpoints<Iter>* const table,
+      const difference_type index) noexcept
+  : table_{table}, index_{index} {}
+
+  const BaseCheckpoints<Iter>* table_ = nullptr;
+  difference_type index_ = 0;
+};
+
+}  // namespace jz
+
+#endif // BASE_CHECKPOINTS_HH_
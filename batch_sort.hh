@@ -0,0 +1,374 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+#ifndef BATCH_SORT_HH_
+#define BATCH_SORT_HH_
+
+static_assert(__cplusplus >= 201402L, "Requires C++14 or newer.");
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "projected_algorithms.hh"
+#include "projection_iterator.hh"
+
+namespace jz {
+
+// batch_projected_sort() sorts views of up to this many elements with a
+// sorting network, and longer views with projected_sort().
+constexpr std::ptrdiff_t kMaxBatchNetworkSize = 64;
+
+namespace detail {
+
+// How many same-sized views batch_projected_sort() sorts side by side, when
+// it can sort them a vector lane each.
+constexpr std::ptrdiff_t kBatchLanes = 16;
+
+// A compare-exchange in a sorting network: the pair of positions it orders.
+using NetworkStep = std::pair<std::uint8_t, std::uint8_t>;
+
+// Returns Batcher's odd-even merge sort network for size elements, as its
+// compare-exchanges in order.  Leaving out the steps that reach past size
+// gives a network for any size, not just powers of two.
+inline std::vector<NetworkStep> make_sorting_network(
+    const std::ptrdiff_t size) {
+  auto network = std::vector<NetworkStep>{};
+  for (auto p = std::ptrdiff_t{1}; p < size; p *= 2) {
+    for (auto k = p; k >= 1; k /= 2) {
+      for (auto j = k % p; j + k < size; j += 2 * k) {
+        for (auto i = std::ptrdiff_t{0}; i < k && i + j + k < size; ++i) {
+          if ((i + j) / (2 * p) == (i + j + k) / (2 * p)) {
+            network.emplace_back(i + j, i + j + k);
+          }
+        }
+      }
+    }
+  }
+  return network;
+}
+
+// Returns the sorting network for size elements, building the networks for
+// every size up to kMaxBatchNetworkSize on first use.
+inline const std::vector<NetworkStep>& sorting_network(
+    const std::ptrdiff_t size) {
+  static_assert(kMaxBatchNetworkSize <= 256,
+                "Network steps must fit in std::uint8_t.");
+  static const auto networks = [] {
+    auto result =
+        std::array<std::vector<NetworkStep>, kMaxBatchNetworkSize + 1>{};
+    for (auto n = std::ptrdiff_t{0}; n <= kMaxBatchNetworkSize; ++n) {
+      result[n] = make_sorting_network(n);
+    }
+    return result;
+  }();
+  return networks[size];
+}
+
+// Indicates whether Compare orders T ascending (+1) or descending (-1) by
+// operator<, so a network can compare-exchange many Ts at once with min and
+// max, or neither (0).
+template <typename Compare, typename T>
+struct lane_order : std::integral_constant<int, 0> {};
+
+template <typename T>
+struct lane_order<std::less<>, T> : std::integral_constant<int, 1> {};
+
+template <typename T>
+struct lane_order<std::less<T>, T> : std::integral_constant<int, 1> {};
+
+template <typename T>
+struct lane_order<std::greater<>, T> : std::integral_constant<int, -1> {};
+
+template <typename T>
+struct lane_order<std::greater<T>, T> : std::integral_constant<int, -1> {};
+
+template <typename Compare, typename T>
+struct is_lane_sortable
+    : std::integral_constant<bool, std::is_arithmetic<T>::value &&
+                                   lane_order<Compare, T>::value != 0> {};
+
+// Runs network over kBatchLanes views at once, with lanes[i][lane] holding
+// element i of each view.  Each step is a branchless min and max across the
+// lanes, which compilers vectorize.
+template <int Order, typename T>
+void sort_lanes(
+    T (*const lanes)[kBatchLanes], const std::vector<NetworkStep>& network) {
+  for (const auto& step : network) {
+    auto* const lo = lanes[step.first];
+    auto* const hi = lanes[step.second];
+    for (auto lane = std::ptrdiff_t{0}; lane < kBatchLanes; ++lane) {
+      const auto a = lo[lane];
+      const auto b = hi[lane];
+      const auto swap = Order > 0 ? b < a : a < b;
+      lo[lane] = swap ? b : a;
+      hi[lane] = swap ? a : b;
+    }
+  }
+}
+
+// Sorts count views of size elements, starting at bases[0], ..., bases[count
+// - 1], each laid out in its base by positions.
+template <int Order, typename BaseIter>
+void sort_batch(
+    const BaseIter* const bases, const std::ptrdiff_t count,
+    const std::ptrdiff_t size, const std::ptrdiff_t* const positions) {
+  using T = typename std::iterator_traits<BaseIter>::value_type;
+  T lanes[kMaxBatchNetworkSize][kBatchLanes];
+  for (auto i = std::ptrdiff_t{0}; i < size; ++i) {
+    for (auto lane = std::ptrdiff_t{0}; lane < count; ++lane) {
+      lanes[i][lane] = bases[lane][positions[i]];
+    }
+    // Fill the lanes we don't need, so every lane holds a value.
+    std::fill(lanes[i] + count, lanes[i] + kBatchLanes, lanes[i][0]);
+  }
+  sort_lanes<Order>(lanes, sorting_network(size));
+  for (auto i = std::ptrdiff_t{0}; i < size; ++i) {
+    for (auto lane = std::ptrdiff_t{0}; lane < count; ++lane) {
+      bases[lane][positions[i]] = lanes[i][lane];
+    }
+  }
+}
+
+// Sorts one view of size elements, starting at base and laid out by
+// positions, through scratch.
+template <typename BaseIter, typename Compare, typename T, typename Alloc>
+void sort_one(
+    const BaseIter base, const std::ptrdiff_t size,
+    const std::ptrdiff_t* const positions, Compare& comp,
+    std::vector<T, Alloc>& scratch) {
+  scratch.clear();
+  for (auto i = std::ptrdiff_t{0}; i < size; ++i) {
+    scratch.push_back(std::move(base[positions[i]]));
+  }
+  for (const auto& step : sorting_network(size)) {
+    auto& a = scratch[step.first];
+    auto& b = scratch[step.second];
+    if (comp(b, a)) {
+      using std::swap;
+      swap(a, b);
+    }
+  }
+  for (auto i = std::ptrdiff_t{0}; i < size; ++i) {
+    base[positions[i]] = std::move(scratch[i]);
+  }
+}
+
+// Holds the positions a projection maps each view index to, for views of
+// one size at a time.
+template <typename Alloc = std::allocator<std::ptrdiff_t>>
+class NetworkPositions {
+ public:
+  explicit NetworkPositions(const Alloc& alloc = Alloc{}) : positions_(alloc) {}
+
+  // Switches to views of size elements, looking up their positions unless
+  // that's the size we already have.
+  template <typename MakeProjection>
+  void update(MakeProjection& make_projection, const std::ptrdiff_t size) {
+    if (size == size_) {
+      return;
+    }
+    const auto projection = make_projection(size);
+    positions_.resize(static_cast<std::size_t>(size));
+    for (auto i = std::ptrdiff_t{0}; i < size; ++i) {
+      positions_[i] = static_cast<std::ptrdiff_t>(projection(i));
+    }
+    size_ = size;
+  }
+
+  std::ptrdiff_t size() const noexcept { return size_; }
+
+  const std::ptrdiff_t* data() const noexcept { return positions_.data(); }
+
+ private:
+  std::vector<std::ptrdiff_t, Alloc> positions_;
+  std::ptrdiff_t size_ = -1;
+};
+
+// Sorts a view too long for a network with projected_sort().
+template <typename BaseIter, typename MakeProjection, typename Compare,
+          typename T, typename Alloc>
+void sort_long_view(
+    const BaseIter base, const std::ptrdiff_t size,
+    MakeProjection& make_projection, Compare& comp,
+    std::vector<T, Alloc>& scratch) {
+  const auto view = make_projection_iterator(base, make_projection(size));
+  projected_sort(view, view + size, comp, scratch);
+}
+
+// The serial form of batch_projected_sort(), for views that can't share
+// vector lanes, which it sorts one at a time.  positions and scratch are the
+// working storage.
+template <typename SpanIt, typename MakeProjection, typename Compare,
+          typename PositionsAlloc, typename T, typename Alloc>
+void batch_projected_sort(
+    SpanIt first, SpanIt last, MakeProjection& make_projection, Compare comp,
+    NetworkPositions<PositionsAlloc>& positions,
+    std::vector<T, Alloc>& scratch, std::false_type) {
+  for (; first != last; ++first) {
+    auto&& span = *first;
+    const auto base = std::begin(span);
+    const auto size = static_cast<std::ptrdiff_t>(
+        std::distance(base, std::end(span)));
+    if (size > kMaxBatchNetworkSize) {
+      sort_long_view(base, size, make_projection, comp, scratch);
+    } else if (size > 1) {
+      positions.update(make_projection, size);
+      sort_one(base, size, positions.data(), comp, scratch);
+    }
+  }
+}
+
+// As above, for views that can, which it gathers into batches of up to
+// kBatchLanes consecutive views of the same size.
+template <typename SpanIt, typename MakeProjection, typename Compare,
+          typename PositionsAlloc, typename T, typename Alloc>
+void batch_projected_sort(
+    SpanIt first, SpanIt last, MakeProjection& make_projection, Compare comp,
+    NetworkPositions<PositionsAlloc>& positions,
+    std::vector<T, Alloc>& scratch, std::true_type) {
+  using BaseIter = decltype(std::begin(*first));
+  constexpr auto kOrder = lane_order<Compare, T>::value;
+
+  auto bases = std::array<BaseIter, kBatchLanes>{};
+  auto count = std::ptrdiff_t{0};
+  const auto flush = [&] {
+    if (count != 0) {
+      sort_batch<kOrder>(bases.data(), count, positions.size(),
+                         positions.data());
+      count = 0;
+    }
+  };
+
+  for (; first != last; ++first) {
+    auto&& span = *first;
+    const auto base = std::begin(span);
+    const auto size = static_cast<std::ptrdiff_t>(
+        std::distance(base, std::end(span)));
+    if (size > kMaxBatchNetworkSize) {
+      sort_long_view(base, size, make_projection, comp, scratch);
+    } else if (size > 1) {
+      if (size != positions.size()) {
+        flush();
+        positions.update(make_projection, size);
+      }
+      bases[count++] = base;
+      if (count == kBatchLanes) {
+        flush();
+      }
+    }
+  }
+  flush();
+}
+
+template <typename SpanIt, typename MakeProjection, typename Compare,
+          typename PositionsAlloc, typename T, typename Alloc>
+void batch_projected_sort(
+    SpanIt first, SpanIt last, MakeProjection& make_projection, Compare comp,
+    NetworkPositions<PositionsAlloc>& positions,
+    std::vector<T, Alloc>& scratch) {
+  static_assert(
+      std::is_same<T, typename std::iterator_traits<
+                          decltype(std::begin(*first))>::value_type>::value,
+      "Scratch storage must hold the views' value type.");
+  batch_projected_sort(first, last, make_projection, comp, positions, scratch,
+                       is_lane_sortable<Compare, T>{});
+}
+
+template <typename SpanIt, typename MakeProjection, typename Compare>
+void batch_projected_sort(
+    SpanIt first, SpanIt last, MakeProjection& make_projection,
+    Compare comp) {
+  using T = typename std::iterator_traits<
+      decltype(std::begin(*first))>::value_type;
+  auto positions = NetworkPositions<>{};
+  auto scratch = std::vector<T>{};
+  batch_projected_sort(first, last, make_projection, comp, positions,
+                       scratch);
+}
+
+}  // namespace detail
+
+// Sorts each of many independent views in [first, last), each one viewed
+// through the projection that make_projection(size) returns for its size.
+// Each element of [first, last) is a random access range, such as a vector,
+// of the same type.  For example, to sort each vector in vs into the folded
+// interleave layout:
+//
+//     jz::batch_projected_sort(vs.begin(), vs.end(), [](std::ptrdiff_t n) {
+//       return jz::make_folded_interleave_projection(n);
+//     });
+//
+// Each view ends up as std::sort through a ProjIter over it would leave it,
+// apart from the order of equivalent elements.  The projection for a size
+// must map that many view indices into the range, and can only depend on
+// the size, as it's made once for each run of views of the same size.
+//
+// This is for many views of a few dozen elements, where sorting one view at
+// a time spends much of its time building iterators and setting up
+// introsort.  Views of up to kMaxBatchNetworkSize elements are sorted by a
+// fixed sorting network, through a table of the projection's positions for
+// their size.  When the value type is arithmetic and comp is std::less or
+// std::greater, up to 16 consecutive views of the same size are sorted
+// together, one per vector lane.  Longer views get projected_sort().
+template <typename SpanIt, typename MakeProjection, typename Compare>
+void batch_projected_sort(
+    SpanIt first, SpanIt last, MakeProjection make_projection, Compare comp) {
+  detail::batch_projected_sort(first, last, make_projection, comp);
+}
+
+// As above, but sorts in ascending order with operator<.
+template <typename SpanIt, typename MakeProjection>
+void batch_projected_sort(
+    SpanIt first, SpanIt last, MakeProjection make_projection) {
+  batch_projected_sort(first, last, make_projection, std::less<>{});
+}
+
+#ifdef JZ_PROJECTED_ALGORITHMS_HAS_EXECUTION
+
+// Parallel counterparts of batch_projected_sort().  With std::execution::par
+// or par_unseq, [first, last) is split into one contiguous share of views
+// per thread.  make_projection and comp must be safe to call concurrently.
+// Other policies run serially.
+template <typename ExecutionPolicy, typename SpanIt, typename MakeProjection,
+          typename Compare,
+          typename = detail::enable_if_execution_policy_t<ExecutionPolicy>>
+void batch_projected_sort(
+    ExecutionPolicy&&, SpanIt first, SpanIt last,
+    MakeProjection make_projection, Compare comp) {
+  const auto views = std::distance(first, last);
+  auto elements = std::ptrdiff_t{0};
+  if (detail::is_parallel_policy_v<ExecutionPolicy>) {
+    for (auto span = first; span != last; ++span) {
+      elements += std::distance(std::begin(*span), std::end(*span));
+    }
+  }
+  const auto tasks = detail::parallel_task_count(elements);
+  detail::run_parallel_tasks(tasks, [&](const unsigned task) {
+    auto task_make_projection = make_projection;
+    detail::batch_projected_sort(
+        std::next(first, views * task / tasks),
+        std::next(first, views * (task + 1) / tasks),
+        task_make_projection, comp);
+  });
+}
+
+template <typename ExecutionPolicy, typename SpanIt, typename MakeProjection,
+          typename = detail::enable_if_execution_policy_t<ExecutionPolicy>>
+void batch_projected_sort(
+    ExecutionPolicy&& policy, SpanIt first, SpanIt last,
+    MakeProjection make_projection) {
+  batch_projected_sort(std::forward<ExecutionPolicy>(policy), first, last,
+                       make_projection, std::less<>{});
+}
+
+#endif  // JZ_PROJECTED_ALGORITHMS_HAS_EXECUTION
+
+}  // namespace jz
+
+#endif // BATCH_SORT_HH_
@@ -0,0 +1,57 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+#ifndef DEQUE_SEGMENTS_HH_
+#define DEQUE_SEGMENTS_HH_
+
+static_assert(__cplusplus >= 201402L, "Requires C++14 or newer.");
+
+#include <cstddef>
+#include <deque>
+
+#include "projection_iterator.hh"
+
+namespace jz {
+
+// Describes std::deque iterators to segmented_iterator_traits, so ProjIter
+// finds each projected element of a deque with a division and a map load,
+// rather than by advancing a copy of the iterator.  Include this wherever
+// ProjIter is used over a std::deque, before that use.
+//
+// The standard doesn't expose a deque's layout, so this relies on
+// libstdc++'s: std::_Deque_iterator holds _M_cur, _M_first and _M_node, the
+// last pointing into a map of pointers to fixed-size buffers of
+// std::__deque_buf_size(sizeof(T)) elements each, and it can be built from
+// an element pointer and its map entry.  With other standard libraries, this
+// defines nothing, and ProjIter advances deque iterators as it does any
+// other random access base.
+#if defined(__GLIBCXX__)
+template <typename T, typename Ref, typename Ptr>
+struct segmented_iterator_traits<std::_Deque_iterator<T, Ref, Ptr>> {
+ private:
+  using Iter = std::_Deque_iterator<T, Ref, Ptr>;
+
+ public:
+  static constexpr bool is_segmented = true;
+
+  using pointer     = Ptr;
+  using segment_map = typename Iter::_Map_pointer;
+
+  static constexpr std::ptrdiff_t segment_size =
+      static_cast<std::ptrdiff_t>(std::__deque_buf_size(sizeof(T)));
+
+  static segment_map segment(const Iter& it) noexcept { return it._M_node; }
+
+  static std::ptrdiff_t local(const Iter& it) noexcept {
+    return it._M_cur - it._M_first;
+  }
+
+  static Iter compose(
+      const segment_map segment, const std::ptrdiff_t local) noexcept {
+    return Iter(*segment + local, segment);
+  }
+};
+#endif
+
+}  // namespace jz
+
+#endif // DEQUE_SEGMENTS_HH_
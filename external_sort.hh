@@ -0,0 +1,298 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+#ifndef EXTERNAL_SORT_HH_
+#define EXTERNAL_SORT_HH_
+
+static_assert(__cplusplus >= 201402L, "Requires C++14 or newer.");
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "mmap_array.hh"
+#include "projected_algorithms.hh"
+#include "projection_iterator.hh"
+
+namespace jz {
+
+// Tunes projected_external_sort(), below.
+struct ExternalSortOptions {
+  // The most memory, in bytes, the sort's buffers may take.
+  std::size_t memory_budget = std::size_t{1} << 30;
+
+  // The directory to keep sorted runs in.  Empty means $TMPDIR, or /tmp if
+  // that isn't set.
+  std::string temp_dir;
+};
+
+namespace detail {
+
+// A file for sorted runs, unlinked as soon as it's made, so it goes away
+// once closed, even if we don't get to close it.
+class RunFile {
+ public:
+  explicit RunFile(std::string dir) {
+    if (dir.empty()) {
+      const auto env = std::getenv("TMPDIR");
+      dir = env && *env ? env : "/tmp";
+    }
+    auto path = dir + "/jz-sort-XXXXXX";
+    fd_ = ::mkstemp(&path[0]);
+    if (fd_ < 0) {
+      throw_errno("mkstemp");
+    }
+    ::unlink(path.c_str());
+  }
+
+  RunFile(const RunFile&) = delete;
+  RunFile& operator=(const RunFile&) = delete;
+
+  ~RunFile() { ::close(fd_); }
+
+  void write(const void* const data, std::size_t bytes, off_t offset) const {
+    auto src = static_cast<const char*>(data);
+    while (bytes != 0) {
+      const auto written = ::pwrite(fd_, src, bytes, offset);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw_errno("pwrite");
+      }
+      src += written;
+      bytes -= static_cast<std::size_t>(written);
+      offset += written;
+    }
+  }
+
+  void read(void* const data, std::size_t bytes, off_t offset) const {
+    auto dst = static_cast<char*>(data);
+    while (bytes != 0) {
+      const auto got = ::pread(fd_, dst, bytes, offset);
+      if (got <= 0) {
+        if (got < 0 && errno == EINTR) {
+          continue;
+        }
+        if (got == 0) {
+          errno = EIO;  // The run is shorter than we wrote.
+        }
+        throw_errno("pread");
+      }
+      dst += got;
+      bytes -= static_cast<std::size_t>(got);
+      offset += got;
+    }
+  }
+
+ private:
+  int fd_;
+};
+
+// Reads one sorted run back from a RunFile, a block at a time, reading the
+// next block in the background while the merge consumes this one.
+template <typename T>
+class RunReader {
+ public:
+  RunReader(
+      const RunFile& file, const std::ptrdiff_t first,
+      const std::ptrdiff_t size, T* const block, T* const spare,
+      const std::ptrdiff_t block_size)
+  : file_{&file}, next_{first}, remaining_{size}, block_{block},
+    spare_{spare}, block_size_{block_size} {
+    fetch_();
+    next_block_();
+  }
+
+  bool empty() const noexcept { return head_ == tail_; }
+
+  const T& front() const noexcept { return *head_; }
+
+  void pop() {
+    if (++head_ == tail_) {
+      next_block_();
+    }
+  }
+
+ private:
+  const RunFile* file_;
+  std::ptrdiff_t next_;            // The next element to read from the file.
+  std::ptrdiff_t remaining_;       // How many elements we haven't read yet.
+  T* block_;
+  T* spare_;
+  std::ptrdiff_t block_size_;
+  const T* head_ = nullptr;
+  const T* tail_ = nullptr;
+  std::ptrdiff_t fetching_ = 0;    // How many elements pending_ reads.
+  std::future<void> pending_;
+
+  // Starts reading the block after the current one into spare_.
+  void fetch_() {
+    fetching_ = std::min(block_size_, remaining_);
+    if (fetching_ == 0) {
+      return;
+    }
+    const auto file = file_;
+    const auto dst = spare_;
+    const auto bytes = static_cast<std::size_t>(fetching_) * sizeof(T);
+    const auto offset = static_cast<off_t>(next_ * sizeof(T));
+    pending_ = std::async(std::launch::async, [file, dst, bytes, offset] {
+      file->read(dst, bytes, offset);
+    });
+    next_ += fetching_;
+    remaining_ -= fetching_;
+  }
+
+  void next_block_() {
+    if (fetching_ == 0) {
+      head_ = tail_;
+      return;
+    }
+    pending_.get();
+    std::swap(block_, spare_);
+    head_ = block_;
+    tail_ = block_ + fetching_;
+    fetch_();
+  }
+};
+
+}  // namespace detail
+
+// Sorts [first, last) with a bounded amount of memory, for views of arrays
+// larger than memory, such as ProjIter ranges over an MmapArray.  Sorting
+// through such a view directly with std::sort, or gathering it whole with
+// projected_sort(), pages the array in and out at random once it outgrows
+// memory.
+//
+// Instead, this gathers the view in order a memory_budget's worth at a time,
+// sorts each piece, and writes it out to a run file in options.temp_dir,
+// writing each run in the background while it gathers and sorts the next.
+// It then merges the runs, reading each back in large blocks, again in the
+// background, and writes the merged result through [first, last) in order.
+// So the view itself sees two passes, one read and one write, each in view
+// order, and the run file sees one sequential write and one large-block
+// read per run.  Views that fit in the budget just get projected_sort().
+//
+// The value type must be trivially copyable, as the runs are stored as raw
+// bytes.  The merge holds two blocks per run and needs at least one element
+// per block, so the budget must hold at least (2 * runs + 1) elements, where
+// there are 2 * size / budget runs; otherwise this throws std::length_error.
+// I/O errors throw std::system_error, leaving [first, last) unspecified.
+template <typename RandomIt, typename Compare>
+void projected_external_sort(
+    RandomIt first, RandomIt last, Compare comp,
+    const ExternalSortOptions& options = {}) {
+  using T = typename std::iterator_traits<RandomIt>::value_type;
+  static_assert(std::is_trivially_copyable<T>::value,
+                "External sort requires trivially copyable values.");
+
+  const auto size = static_cast<std::ptrdiff_t>(std::distance(first, last));
+  const auto budget = static_cast<std::ptrdiff_t>(
+      std::min<std::size_t>(options.memory_budget / sizeof(T),
+                            std::numeric_limits<std::ptrdiff_t>::max()));
+  if (size <= budget) {
+    projected_sort(first, last, comp);
+    return;
+  }
+
+  // Split the budget in two, so we can write one run while making the next.
+  const auto run_size = std::max(budget / 2, std::ptrdiff_t{1});
+  const auto runs = (size + run_size - 1) / run_size;
+  const auto block_size = budget / (2 * runs + 1);
+  if (block_size == 0) {
+    throw std::length_error("Memory budget too small to merge the runs");
+  }
+
+  auto buffer = std::vector<T>(static_cast<std::size_t>(budget));
+  const detail::RunFile file(options.temp_dir);
+  {
+    auto run = buffer.data();
+    auto spare = run + run_size;
+    auto pending = std::future<void>{};
+    for (auto pos = std::ptrdiff_t{0}; pos < size; pos += run_size) {
+      const auto count = std::min(run_size, size - pos);
+      const auto run_first = std::next(first, pos);
+      projected_copy(run_first, std::next(run_first, count), run);
+      std::sort(run, run + count, comp);
+      if (pending.valid()) {
+        pending.get();
+      }
+      const auto bytes = static_cast<std::size_t>(count) * sizeof(T);
+      const auto offset = static_cast<off_t>(pos * sizeof(T));
+      pending = std::async(
+          std::launch::async, [&file, run, bytes, offset] {
+            file.write(run, bytes, offset);
+          });
+      std::swap(run, spare);
+    }
+    pending.get();
+  }
+
+  auto readers = std::vector<detail::RunReader<T>>{};
+  readers.reserve(static_cast<std::size_t>(runs));
+  auto heap = std::vector<std::size_t>{};
+  heap.reserve(readers.capacity());
+  for (auto run = std::ptrdiff_t{0}; run < runs; ++run) {
+    const auto block = buffer.data() + 2 * run * block_size;
+    readers.emplace_back(
+        file, run * run_size, std::min(run_size, size - run * run_size),
+        block, block + block_size, block_size);
+    heap.push_back(static_cast<std::size_t>(run));
+  }
+
+  // Orders the heap so the run with the least front element comes first.
+  const auto later = [&readers, &comp](const std::size_t lhs,
+                                       const std::size_t rhs) {
+    return comp(readers[rhs].front(), readers[lhs].front());
+  };
+  std::make_heap(heap.begin(), heap.end(), later);
+
+  const auto merged = buffer.data() + 2 * runs * block_size;
+  auto count = std::ptrdiff_t{0};
+  auto out = first;
+  const auto flush = [&] {
+    const auto out_last = std::next(out, count);
+    detail::scatter(merged, out, out_last);
+    out = out_last;
+    count = 0;
+  };
+  while (!heap.empty()) {
+    std::pop_heap(heap.begin(), heap.end(), later);
+    auto& reader = readers[heap.back()];
+    merged[count++] = reader.front();
+    reader.pop();
+    if (reader.empty()) {
+      heap.pop_back();
+    } else {
+      std::push_heap(heap.begin(), heap.end(), later);
+    }
+    if (count == block_size) {
+      flush();
+    }
+  }
+  flush();
+}
+
+// As above, but sorts in ascending order with operator<.
+template <typename RandomIt>
+void projected_external_sort(
+    RandomIt first, RandomIt last, const ExternalSortOptions& options = {}) {
+  projected_external_sort(first, last, std::less<>{}, options);
+}
+
+}  // namespace jz
+
+#endif // EXTERNAL_SORT_HH_
@@ -0,0 +1,333 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+//
+// Compares the ways of sorting into the folded interleave layout.  Uses
+// Google Benchmark, e.g.:
+//
+//   g++ -std=c++14 -O2 folded_interleave_bench.cc -lbenchmark -lpthread
+//
+// On Linux, the std::sort benchmarks also report branch mispredictions per
+// element, when the kernel lets us open a hardware performance counter.
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#ifdef __linux__
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+#include <benchmark/benchmark.h>
+
+#include "batch_sort.hh"
+#include "projected_algorithms.hh"
+#include "projection_iterator.hh"
+#include "projections.hh"
+#include "table_projection.hh"
+#if __cplusplus >= 201703L
+#  include "scratch_arena.hh"
+#endif
+
+namespace {
+
+using std::ptrdiff_t;
+using jz::make_folded_interleave_projection;
+using jz::make_projection_iterator;
+
+// The projection as folded_interleave_sort.cc originally wrote it, choosing
+// the half with a branch.
+auto make_branchy_folded_interleave_projection(ptrdiff_t size) {
+  return [size](const ptrdiff_t index) {
+    const auto index2 = 2 * index;
+    return index2 >= size ? 2 * size - index2 - 1 : index2;
+  };
+}
+
+// The same projection, choosing the half with a mask, as
+// jz::FoldedInterleaveProjection does.
+auto make_branchless_folded_interleave_projection(ptrdiff_t size) {
+  return [size](const ptrdiff_t index) {
+    const auto index2 = 2 * index;
+    const auto back_mask = -static_cast<ptrdiff_t>(index2 >= size);
+    return index2 + (back_mask & (2 * size - 1 - 2 * index2));
+  };
+}
+
+// Counts branch mispredictions in user space on the calling thread.  If the
+// counter can't be opened (no PMU, or perf_event_paranoid forbids it), valid()
+// returns false and the rest are no-ops.
+#ifdef __linux__
+class BranchMissCounter {
+ public:
+  BranchMissCounter() {
+    auto attr = perf_event_attr{};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+    }
+  }
+
+  BranchMissCounter(const BranchMissCounter&) = delete;
+  BranchMissCounter& operator=(const BranchMissCounter&) = delete;
+
+  ~BranchMissCounter() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  bool valid() const noexcept { return fd_ >= 0; }
+
+  void enable() noexcept {
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+
+  void disable() noexcept {
+    if (fd_ >= 0) {
+      ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+    }
+  }
+
+  std::uint64_t count() const noexcept {
+    auto value = std::uint64_t{};
+    if (fd_ < 0 || read(fd_, &value, sizeof(value)) != sizeof(value)) {
+      return 0;
+    }
+    return value;
+  }
+
+ private:
+  int fd_ = -1;
+};
+#else
+class BranchMissCounter {
+ public:
+  BranchMissCounter() = default;
+  BranchMissCounter(const BranchMissCounter&) = delete;
+  BranchMissCounter& operator=(const BranchMissCounter&) = delete;
+
+  bool valid() const noexcept { return false; }
+  void enable() noexcept {}
+  void disable() noexcept {}
+  std::uint64_t count() const noexcept { return 0; }
+};
+#endif
+
+// Returns size random ints.  The generator is seeded from the size, so every
+// benchmark at a given size sorts the same input.
+std::vector<int> random_input(ptrdiff_t size) {
+  auto g = std::mt19937_64{static_cast<std::uint64_t>(size)};
+  auto dist = std::uniform_int_distribution<int>{};
+  auto v = std::vector<int>(size);
+  for (auto& elem : v) {
+    elem = dist(g);
+  }
+  return v;
+}
+
+// Runs sort_fn over a fresh copy of the same random input each iteration.
+// Branch mispredictions are only counted while sort_fn runs.
+template <typename SortFn>
+void run_sort_benchmark(benchmark::State& state, SortFn sort_fn) {
+  const auto size = static_cast<ptrdiff_t>(state.range(0));
+  const auto input = random_input(size);
+  auto v = input;
+  BranchMissCounter branch_misses;
+  for (auto _ : state) {
+    state.PauseTiming();
+    branch_misses.disable();
+    std::copy(input.begin(), input.end(), v.begin());
+    branch_misses.enable();
+    state.ResumeTiming();
+    sort_fn(v);
+    benchmark::DoNotOptimize(v.data());
+    benchmark::ClobberMemory();
+  }
+  branch_misses.disable();
+  state.SetItemsProcessed(state.iterations() * size);
+  if (branch_misses.valid()) {
+    state.counters["branch_misses_per_item"] = benchmark::Counter(
+        static_cast<double>(branch_misses.count()) / size,
+        benchmark::Counter::kAvgIterations);
+  }
+}
+
+// Runs std::sort through a ProjIter built from make_projection(size).
+template <typename MakeProjection>
+void run_std_sort_benchmark(
+    benchmark::State& state, MakeProjection make_projection) {
+  run_sort_benchmark(state, [&make_projection](std::vector<int>& v) {
+    auto fip_proj  = make_projection(v.size());
+    auto fip_begin = make_projection_iterator(v.begin(), fip_proj);
+    auto fip_end   = fip_begin + v.size();
+    std::sort(fip_begin, fip_end);
+  });
+}
+
+// The original approach: std::sort through a ProjIter.
+void BM_StdSortThroughProjIter(benchmark::State& state) {
+  run_std_sort_benchmark(state, [](ptrdiff_t size) {
+    return make_folded_interleave_projection(size);
+  });
+}
+
+// std::sort through a ProjIter, with each form of the projection.  Sizes step
+// by 10x to make the per-element misprediction rate easy to compare.
+void BM_StdSortBranchyProjection(benchmark::State& state) {
+  run_std_sort_benchmark(state, [](ptrdiff_t size) {
+    return make_branchy_folded_interleave_projection(size);
+  });
+}
+
+void BM_StdSortBranchlessProjection(benchmark::State& state) {
+  run_std_sort_benchmark(state, [](ptrdiff_t size) {
+    return make_branchless_folded_interleave_projection(size);
+  });
+}
+
+// std::sort through a ProjIter that looks the projection up in a cached
+// table, as repeated sorts of same-sized batches would.  The folded
+// interleave projection is cheap to compute, so this measures what the table
+// lookups cost against the arithmetic they replace.
+void BM_StdSortThroughCachedTable(benchmark::State& state) {
+  jz::TableProjectionCache cache;
+  run_sort_benchmark(state, [&cache](std::vector<int>& v) {
+    const auto size = static_cast<ptrdiff_t>(v.size());
+    cache.visit(make_folded_interleave_projection(size), size,
+                [&v](const auto& table) {
+      auto fip_begin = make_projection_iterator(v.begin(), jz::proj_ref(table));
+      auto fip_end   = fip_begin + v.size();
+      std::sort(fip_begin, fip_end);
+    });
+  });
+}
+
+// Gathers through a ProjIter, sorts contiguously, and scatters back.
+void BM_ProjectedSort(benchmark::State& state) {
+  auto scratch = std::vector<int>{};
+  run_sort_benchmark(state, [&scratch](std::vector<int>& v) {
+    auto fip_proj  = make_folded_interleave_projection(v.size());
+    auto fip_begin = make_projection_iterator(v.begin(), fip_proj);
+    auto fip_end   = fip_begin + v.size();
+    jz::projected_sort(fip_begin, fip_end, std::less<>{}, scratch);
+  });
+}
+
+#if __cplusplus >= 201703L
+// As above, but takes the scratch storage from a per-thread arena on each
+// call, as a caller with no vector of its own to keep would.
+void BM_ProjectedSortWithArena(benchmark::State& state) {
+  run_sort_benchmark(state, [](std::vector<int>& v) {
+    auto fip_proj  = make_folded_interleave_projection(v.size());
+    auto fip_begin = make_projection_iterator(v.begin(), fip_proj);
+    auto fip_end   = fip_begin + v.size();
+    jz::projected_sort(fip_begin, fip_end, std::less<>{},
+                       jz::thread_scratch_arena());
+  });
+}
+#endif
+
+// Gathers through a ProjIter, radix sorts contiguously, and scatters back.
+void BM_ProjectedRadixSort(benchmark::State& state) {
+  auto scratch = std::vector<int>{};
+  run_sort_benchmark(state, [&scratch](std::vector<int>& v) {
+    auto fip_proj  = make_folded_interleave_projection(v.size());
+    auto fip_begin = make_projection_iterator(v.begin(), fip_proj);
+    auto fip_end   = fip_begin + v.size();
+    jz::projected_radix_sort(fip_begin, fip_end, scratch);
+  });
+}
+
+// Sorts contiguously, then shuffles into the layout in place.
+void BM_FoldedInterleaveSortInPlace(benchmark::State& state) {
+  run_sort_benchmark(state, [](std::vector<int>& v) {
+    jz::folded_interleave_sort(v.begin(), v.end());
+  });
+}
+
+// Sorts contiguously in a scratch buffer, then lays out in one linear pass.
+void BM_FoldedInterleaveSortBuffered(benchmark::State& state) {
+  auto scratch = std::vector<int>{};
+  run_sort_benchmark(state, [&scratch](std::vector<int>& v) {
+    jz::folded_interleave_sort(v.begin(), v.end(), std::less<>{}, scratch);
+  });
+}
+
+// Runs sort_fn over a fresh copy of the same batch of small random vectors
+// each iteration, with about a million ints in all.
+template <typename SortFn>
+void run_batch_benchmark(benchmark::State& state, SortFn sort_fn) {
+  constexpr auto kBatchElements = ptrdiff_t{1} << 20;
+  const auto size = static_cast<ptrdiff_t>(state.range(0));
+  const auto flat = random_input(kBatchElements);
+  auto input = std::vector<std::vector<int>>{};
+  for (auto it = flat.begin(); flat.end() - it >= size; it += size) {
+    input.emplace_back(it, it + size);
+  }
+  auto vs = input;
+  for (auto _ : state) {
+    state.PauseTiming();
+    vs = input;
+    state.ResumeTiming();
+    sort_fn(vs);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(
+      state.iterations() * static_cast<std::int64_t>(input.size()) * size);
+}
+
+// Sorts each small vector with std::sort through its own ProjIter, as the
+// demo does.
+void BM_StdSortEachView(benchmark::State& state) {
+  run_batch_benchmark(state, [](std::vector<std::vector<int>>& vs) {
+    for (auto& v : vs) {
+      auto fip_proj  = make_folded_interleave_projection(v.size());
+      auto fip_begin = make_projection_iterator(v.begin(), fip_proj);
+      std::sort(fip_begin, fip_begin + v.size());
+    }
+  });
+}
+
+// Sorts all the small vectors with one batch_projected_sort() call.
+void BM_BatchProjectedSort(benchmark::State& state) {
+  run_batch_benchmark(state, [](std::vector<std::vector<int>>& vs) {
+    jz::batch_projected_sort(vs.begin(), vs.end(), [](ptrdiff_t size) {
+      return make_folded_interleave_projection(size);
+    });
+  });
+}
+
+constexpr auto kMinSize = 1 << 10;
+constexpr auto kMaxSize = 1 << 24;
+
+BENCHMARK(BM_StdSortThroughProjIter)->Range(kMinSize, kMaxSize);
+BENCHMARK(BM_StdSortBranchyProjection)
+    ->RangeMultiplier(10)->Range(1000, 100000000);
+BENCHMARK(BM_StdSortBranchlessProjection)
+    ->RangeMultiplier(10)->Range(1000, 100000000);
+BENCHMARK(BM_StdSortThroughCachedTable)->Range(kMinSize, kMaxSize);
+BENCHMARK(BM_ProjectedSort)->Range(kMinSize, kMaxSize);
+#if __cplusplus >= 201703L
+BENCHMARK(BM_ProjectedSortWithArena)->Range(kMinSize, kMaxSize);
+#endif
+BENCHMARK(BM_ProjectedRadixSort)->Range(kMinSize, kMaxSize);
+BENCHMARK(BM_FoldedInterleaveSortInPlace)->Range(kMinSize, kMaxSize);
+BENCHMARK(BM_FoldedInterleaveSortBuffered)->Range(kMinSize, kMaxSize);
+BENCHMARK(BM_StdSortEachView)->RangeMultiplier(2)->Range(8, 64);
+BENCHMARK(BM_BatchProjectedSort)->RangeMultiplier(2)->Range(8, 64);
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -4,8 +4,16 @@
 #include <cstddef>
 #include <iostream>
 #include <random>
+#include <vector>
 
 #include "projection_iterator.hh"
+#if __cplusplus >= 201400L
+#  include "projected_view.hh"
+#  include "projections.hh"
+#endif
+#ifdef JZ_PROJECTION_STATS
+#  include "projection_stats.hh"
+#endif
 
 namespace {
 
@@ -13,23 +21,19 @@ using std::ptrdiff_t;
 using jz::make_projection_iterator;
 
 #if __cplusplus >= 201400L
-// Returns a projection function for a particular size random-access container
-// such that this view through the projection:
+// Lays this view:
 //
 //      0, 1, 2, 3, 4, 5, 6, 7, 8, 9
-// 
-// is laid out in memory as:
-// 
+//
+// out in memory as:
+//
 //      0, 9, 1, 8, 2, 7, 3, 6, 4, 5
-auto make_folded_interleave_projection(ptrdiff_t size) {
-  return [size](const ptrdiff_t index) {
-    const auto index2 = 2 * index;
-    return index2 >= size ? 2 * size - index2 - 1 : index2; 
-  };
-}
+using jz::make_folded_interleave_projection;
 #else
 
-// C++11 version of the above.
+// C++11 version of jz::FoldedInterleaveProjection in projections.hh, which
+// needs C++14.  Like that one, it picks the half of the view with a mask, as
+// std::sort probes both halves unpredictably.
 class FoldedInterleaveProjection {
  public:
   explicit FoldedInterleaveProjection(ptrdiff_t size) noexcept
@@ -37,7 +41,8 @@ class FoldedInterleaveProjection {
 
   ptrdiff_t operator()(const ptrdiff_t index) const noexcept {
     const auto index2 = 2 * index;
-    return index2 >= size_ ? 2 * size_ - index2 - 1 : index2; 
+    const auto back_mask = -static_cast<ptrdiff_t>(index2 >= size_);
+    return index2 + (back_mask & (2 * size_ - 1 - 2 * index2));
   }
 
  private:
@@ -61,6 +66,40 @@ void print_span(Iter first, Iter last) {
   }
 }
 
+// Sorts v into the folded interleave layout, then prints v and its view
+// through the projection.
+void sort_and_print(std::vector<int>& v) {
+#if __cplusplus >= 201400L
+  auto fip_view = jz::make_projected_view(
+      v, make_folded_interleave_projection(v.size()));
+  auto fip_begin = fip_view.begin();
+  auto fip_end   = fip_view.end();
+#else
+  auto fip_proj  = make_folded_interleave_projection(v.size());
+  auto fip_begin = make_projection_iterator(v.begin(), fip_proj);
+  auto fip_end   = fip_begin + v.size();
+#endif
+
+#ifdef JZ_PROJECTION_STATS
+  jz::reset_projection_stats();
+#endif
+  std::sort(fip_begin, fip_end);
+#ifdef JZ_PROJECTION_STATS
+  const auto stats = jz::thread_projection_stats();
+#endif
+
+  std::cout << "After:    ";
+  print_span(v.cbegin(), v.cend());
+  std::cout << '\n';
+#ifdef JZ_PROJECTION_STATS
+  std::cout << "Sort:     " << stats << '\n';
+#endif
+
+  std::cout << "FIP view: ";
+  print_span(fip_begin, fip_end);
+  std::cout << "\n\n";
+}
+
 }  // namespace
 
 int main() {
@@ -77,19 +116,7 @@ int main() {
     print_span(v.cbegin(), v.cend());
     std::cout << '\n';
 
-    auto fip_proj  = make_folded_interleave_projection(v.size());
-    auto fip_begin = make_projection_iterator(v.begin(), fip_proj);
-    auto fip_end   = fip_begin + v.size();
-
-    std::sort(fip_begin, fip_end);
-
-    std::cout << "After:    ";
-    print_span(v.cbegin(), v.cend());
-    std::cout << '\n';
-
-    std::cout << "FIP view: ";
-    print_span(fip_begin, fip_end);
-    std::cout << "\n\n";
+    sort_and_print(v);
   }
 
   // Random values in shuffled order.
@@ -104,19 +131,7 @@ int main() {
     print_span(v.cbegin(), v.cend());
     std::cout << '\n';
 
-    auto fip_proj  = make_folded_interleave_projection(v.size());
-    auto fip_begin = make_projection_iterator(v.begin(), fip_proj);
-    auto fip_end   = fip_begin + v.size();
-
-    std::sort(fip_begin, fip_end);
-
-    std::cout << "After:    ";
-    print_span(v.cbegin(), v.cend());
-    std::cout << '\n';
-
-    std::cout << "FIP view: ";
-    print_span(fip_begin, fip_end);
-    std::cout << "\n\n";
+    sort_and_print(v);
   }
 
   // Again, but with one less value (to test even/odd length).
@@ -132,18 +147,6 @@ int main() {
     print_span(v.cbegin(), v.cend());
     std::cout << '\n';
 
-    auto fip_proj  = make_folded_interleave_projection(v.size());
-    auto fip_begin = make_projection_iterator(v.begin(), fip_proj);
-    auto fip_end   = fip_begin + v.size();
-
-    std::sort(fip_begin, fip_end);
-
-    std::cout << "After:    ";
-    print_span(v.cbegin(), v.cend());
-    std::cout << '\n';
-
-    std::cout << "FIP view: ";
-    print_span(fip_begin, fip_end);
-    std::cout << "\n\n";
+    sort_and_print(v);
   }
 }
@@ -0,0 +1,323 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+#ifndef MMAP_ARRAY_HH_
+#define MMAP_ARRAY_HH_
+
+static_assert(__cplusplus >= 201402L, "Requires C++14 or newer.");
+
+#if !defined(__unix__) && !defined(__APPLE__)
+#  error "mmap_array.hh requires a POSIX system."
+#endif
+
+#include <cerrno>
+#include <cstddef>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "projection_iterator.hh"
+#include "projections.hh"
+#include "table_projection.hh"
+
+namespace jz {
+
+// How a mapping expects to be accessed, as passed to madvise().
+enum class MmapAdvice {
+  kNormal,      // Read ahead a little around each fault.
+  kSequential,  // Read ahead aggressively, and drop pages once passed.
+  kRandom,      // Don't read ahead.
+  kWillNeed,    // Start reading the whole mapping in now.
+  kDontNeed,    // Drop the mapping's pages for now.
+};
+
+// The page size an MmapArray asks for.
+enum class MmapPages {
+  kDefault,
+  kHuge,  // Transparent huge pages, where the file's filesystem allows.
+};
+
+namespace detail {
+
+[[noreturn]] inline void throw_errno(const char* const what) {
+  throw std::system_error(errno, std::generic_category(), what);
+}
+
+inline int madvise_flag(const MmapAdvice advice) noexcept {
+  switch (advice) {
+    case MmapAdvice::kSequential: return MADV_SEQUENTIAL;
+    case MmapAdvice::kRandom:     return MADV_RANDOM;
+    case MmapAdvice::kWillNeed:   return MADV_WILLNEED;
+    case MmapAdvice::kDontNeed:   return MADV_DONTNEED;
+    default:                      return MADV_NORMAL;
+  }
+}
+
+template <typename Callable>
+struct is_table_projection : std::false_type {};
+
+template <typename IndexT>
+struct is_table_projection<TableProjection<IndexT>> : std::true_type {};
+
+template <typename Callable>
+struct is_table_projection<ProjRef<Callable>>
+    : is_table_projection<Callable> {};
+
+// Whether a walk through Callable in view order is known from its type alone
+// to move forward through the whole base, each element after the one before.
+// Ascending segments aren't enough: a transposition, tile or block interleave
+// steps forward within each segment, but starts each column, tile or block
+// back before where the last one ended.
+template <typename Callable>
+struct is_forward_projection : std::false_type {};
+
+template <std::ptrdiff_t Stride>
+struct is_forward_projection<StrideProjection<Stride>>
+    : std::integral_constant<bool, (Stride > 0)> {};
+
+template <typename Callable>
+struct is_forward_projection<ProjRef<Callable>>
+    : is_forward_projection<Callable> {};
+
+template <typename Proj, typename Inverse>
+struct is_forward_projection<InvertibleProjection<Proj, Inverse>>
+    : is_forward_projection<Proj> {};
+
+template <typename Outer, typename Inner>
+struct is_forward_projection<ComposedProjection<Outer, Inner>>
+    : std::integral_constant<bool, is_forward_projection<Outer>::value &&
+                                   is_forward_projection<Inner>::value> {};
+
+// As above, but also looks at the strides of projections that only know
+// theirs at run time.
+template <typename Callable>
+constexpr bool ascends(const ProjRef<Callable>& projection) noexcept;
+
+template <typename Outer, typename Inner>
+constexpr bool ascends(
+    const ComposedProjection<Outer, Inner>& projection) noexcept;
+
+template <typename Callable>
+constexpr bool ascends(const Callable&) noexcept {
+  return is_forward_projection<Callable>::value;
+}
+
+constexpr inline bool ascends(const StrideProjection<>& projection) noexcept {
+  return projection.stride() > 0;
+}
+
+constexpr inline bool ascends(const AffineProjection& projection) noexcept {
+  return projection.stride() > 0;
+}
+
+template <typename Callable>
+constexpr bool ascends(const ProjRef<Callable>& projection) noexcept {
+  return ascends(projection.get());
+}
+
+template <typename Outer, typename Inner>
+constexpr bool ascends(
+    const ComposedProjection<Outer, Inner>& projection) noexcept {
+  return ascends(projection.outer()) && ascends(projection.inner());
+}
+
+}  // namespace detail
+
+// Returns the advice that suits walking a mapping through Callable in view
+// order.  Positive strides, and compositions of them, run forward through the
+// file, so they get kSequential.  Table projections, which usually stand in
+// for scattered layouts, get kRandom, so faults don't read in pages the walk
+// won't touch.  Other projections get kNormal.  That includes those that walk
+// backward, such as reverses and the back half of a folded interleave, as
+// sequential read-ahead only reads forward.  It also includes transpositions,
+// tiles and block interleaves: each column, tile or block goes back to pages
+// the walk has passed, which kSequential lets the kernel drop early.  The
+// strides of StrideProjection<> and AffineProjection aren't known until run
+// time, so they get kNormal here; the overload below, which
+// MmapArray::advise_for() uses, looks at them.
+template <typename Callable>
+constexpr MmapAdvice mmap_advice_for() noexcept {
+  return detail::is_forward_projection<Callable>::value
+      ? MmapAdvice::kSequential
+      : detail::is_table_projection<Callable>::value ? MmapAdvice::kRandom
+      : MmapAdvice::kNormal;
+}
+
+// As above, but looks at projection's run-time strides too.
+template <typename Callable>
+constexpr MmapAdvice mmap_advice_for(const Callable& projection) noexcept {
+  return detail::ascends(projection) ? MmapAdvice::kSequential
+      : mmap_advice_for<Callable>();
+}
+
+// Maps a file that holds an array of T, so views can walk arrays larger than
+// memory without loading them first.  Pages are read in as the view touches
+// them, and the kernel may drop clean pages under memory pressure, so the
+// resident set tracks the pages in use.  The iterators are plain pointers,
+// so the mapping makes a contiguous base for ProjIter:
+//
+//     auto keys = jz::MmapArray<std::int64_t>("keys.bin");
+//     auto projection = jz::make_folded_interleave_projection(keys.size());
+//     keys.advise_for(projection);
+//     auto first = jz::make_projection_iterator(keys.begin(), projection);
+//     std::sort(first, first + keys.size());
+//
+// MmapArray<T> maps the file shared and writable, so writes go back to the
+// file; MmapArray<const T> maps it read-only.  sync() waits for written
+// pages to reach the file, which unmapping alone doesn't.  T must be
+// trivially copyable, and the file must hold a whole number of them.
+//
+// Asking for MmapPages::kHuge advises transparent huge pages, which cut TLB
+// misses for scattered walks.  Whether the kernel uses them depends on the
+// filesystem; files on hugetlbfs always get huge pages.
+template <typename T>
+class MmapArray {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Can only map arrays of trivially copyable types.");
+
+ public:
+  using element_type    = T;
+  using value_type      = typename std::remove_cv<T>::type;
+  using size_type       = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using pointer         = T*;
+  using reference       = T&;
+  using iterator        = T*;
+
+  MmapArray() noexcept = default;
+
+  // Maps the file at path.  Throws std::system_error if it can't.
+  explicit MmapArray(
+      const std::string& path, const MmapPages pages = MmapPages::kDefault)
+  : MmapArray(path.c_str(), pages) {}
+
+  explicit MmapArray(
+      const char* const path, const MmapPages pages = MmapPages::kDefault) {
+    const auto fd = ::open(
+        path, O_CLOEXEC | (std::is_const<T>::value ? O_RDONLY : O_RDWR));
+    if (fd < 0) {
+      detail::throw_errno("open");
+    }
+    try {
+      map_(fd, pages);
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+    ::close(fd);
+  }
+
+  MmapArray(const MmapArray&) = delete;
+  MmapArray& operator=(const MmapArray&) = delete;
+
+  MmapArray(MmapArray&& other) noexcept
+  : data_{std::exchange(other.data_, nullptr)},
+    size_{std::exchange(other.size_, 0)} {}
+
+  MmapArray& operator=(MmapArray&& other) noexcept {
+    if (this != &other) {
+      unmap_();
+      data_ = std::exchange(other.data_, nullptr);
+      size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+  }
+
+  ~MmapArray() { unmap_(); }
+
+  iterator begin() const noexcept { return data_; }
+  iterator end() const noexcept { return data_ + size_; }
+
+  pointer data() const noexcept { return data_; }
+  size_type size() const noexcept { return size_; }
+  bool empty() const noexcept { return size_ == 0; }
+
+  reference operator[](const difference_type index) const noexcept {
+    return data_[index];
+  }
+
+  // Tells the kernel how we'll access the mapping.  Throws std::system_error
+  // if it refuses.
+  void advise(const MmapAdvice advice) const {
+    if (size_ != 0 &&
+        ::madvise(mapping_(), bytes_(), detail::madvise_flag(advice)) != 0) {
+      detail::throw_errno("madvise");
+    }
+  }
+
+  // Advises the access pattern of a walk through projection, as chosen by
+  // mmap_advice_for() above.
+  template <typename Callable>
+  void advise_for(const Callable& projection) const {
+    advise(mmap_advice_for(projection));
+  }
+
+  // Writes modified pages back to the file, and waits for them.  Throws
+  // std::system_error if that fails.
+  void sync() const {
+    if (size_ != 0 && ::msync(mapping_(), bytes_(), MS_SYNC) != 0) {
+      detail::throw_errno("msync");
+    }
+  }
+
+ private:
+  T* data_ = nullptr;
+  size_type size_ = 0;
+
+  void* mapping_() const noexcept {
+    return const_cast<value_type*>(data_);
+  }
+
+  size_type bytes_() const noexcept { return size_ * sizeof(T); }
+
+  void map_(const int fd, const MmapPages pages) {
+    struct stat status;
+    if (::fstat(fd, &status) != 0) {
+      detail::throw_errno("fstat");
+    }
+    const auto bytes = static_cast<size_type>(status.st_size);
+    if (bytes % sizeof(T) != 0) {
+      throw std::system_error(
+          std::make_error_code(std::errc::invalid_argument),
+          "File size isn't a multiple of the element size");
+    }
+    if (bytes == 0) {
+      return;  // mmap() refuses empty mappings.
+    }
+
+    const auto protection =
+        std::is_const<T>::value ? PROT_READ : PROT_READ | PROT_WRITE;
+    void* const mapping =
+        ::mmap(nullptr, bytes, protection, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+      detail::throw_errno("mmap");
+    }
+    data_ = static_cast<T*>(mapping);
+    size_ = bytes / sizeof(T);
+
+#ifdef MADV_HUGEPAGE
+    // This is only a hint, and filesystems without huge page support refuse
+    // it, so failing here isn't an error.
+    if (pages == MmapPages::kHuge) {
+      ::madvise(mapping, bytes, MADV_HUGEPAGE);
+    }
+#else
+    static_cast<void>(pages);
+#endif
+  }
+
+  void unmap_() noexcept {
+    if (size_ != 0) {
+      ::munmap(mapping_(), bytes_());
+    }
+  }
+};
+
+}  // namespace jz
+
+#endif // MMAP_ARRAY_HH_
@@ -0,0 +1,238 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+#ifndef PREFETCHING_ITERATOR_HH_
+#define PREFETCHING_ITERATOR_HH_
+
+static_assert(__cplusplus >= 201402L, "Requires C++14 or newer.");
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+#include "projection_iterator.hh"
+
+namespace jz {
+
+// The distance, in elements, that make_prefetching_iterator() prefetches
+// ahead for views too large to cache, unless told otherwise.  This is a fixed
+// guess at how many misses a core keeps in flight, not tuned to the element
+// size, the projection's cost or the machine.
+constexpr std::ptrdiff_t kDefaultPrefetchDistance = 16;
+
+// Views whose elements span fewer bytes than this likely stay in cache, where
+// prefetching only adds work, so make_prefetching_iterator() doesn't
+// prefetch through them unless told to.  Like the distance, this is a fixed
+// guess at a last-level cache share, not measured from the machine.
+constexpr std::size_t kMinPrefetchBytes = std::size_t{2} << 20;
+
+namespace detail {
+
+inline void prefetch_for_read(const void* const address) noexcept {
+#if defined(__GNUC__)
+  __builtin_prefetch(address);
+#else
+  static_cast<void>(address);
+#endif
+}
+
+}  // namespace detail
+
+// Wraps a ProjIter over a contiguous base, so that each increment prefetches
+// the element distance positions further on.  For projections that scatter
+// consecutive indices across memory, such as hash layouts or a
+// TableProjection over a shuffle, each access through a ProjIter is likely a
+// cache miss, and a sequential walk tends to wait out each miss in turn.
+// Prefetching ahead keeps several misses in flight instead:
+//
+//     auto first = jz::make_prefetching_iterator(view_first, view_last);
+//     auto last = jz::make_prefetching_iterator(view_last, view_last);
+//     auto sum = std::accumulate(first, last, 0);
+//
+// Only increments prefetch, so this helps single passes over the view, such
+// as std::for_each, std::accumulate and std::copy, and does nothing for the
+// jumps that searches and sorts make.  It never prefetches at or past the
+// end index it was made with, so it never evaluates the projection outside
+// the view.  Each prefetch evaluates the projection for its index, so the
+// projection runs twice per element.  That suits projections that are cheap
+// next to a miss, such as table lookups.  For piecewise affine projections,
+// the hardware prefetchers already follow each segment, and
+// projected_for_each() and projected_copy() walk them faster anyway.
+//
+// Out-of-order cores already overlap the misses of a simple loop body, so
+// the gain is largest when the work per element is enough, or branchy
+// enough, to keep the core from running ahead on its own.  Measure before
+// reaching for this.
+template <typename Iter, typename Callable>
+class PrefetchingProjIter {
+  using Inner = ProjIter<Iter, Callable>;
+
+  static_assert(is_contiguous_base<Iter>::value,
+                "Can only prefetch through a contiguous base.");
+
+ public:
+  using iterator_category = std::random_access_iterator_tag;
+  using difference_type   = typename Inner::difference_type;
+  using value_type        = typename Inner::value_type;
+  using pointer           = typename Inner::pointer;
+  using reference         = typename Inner::reference;
+
+  // Wraps it, prefetching distance elements ahead as it advances, but not
+  // at or past the view index last.  A distance of 0 doesn't prefetch.
+  PrefetchingProjIter(
+      Inner it, const difference_type last,
+      const difference_type distance) noexcept
+  : it_{std::move(it)}, last_{last}, distance_{distance} {}
+
+  reference operator*() const { return *it_; }
+
+  pointer operator->() const { return std::addressof(**this); }
+
+  reference operator[](const difference_type delta) const {
+    return it_[delta];
+  }
+
+  PrefetchingProjIter& operator++() {
+    ++it_;
+    prefetch_();
+    return *this;
+  }
+
+  PrefetchingProjIter operator++(int) {
+    auto copy = *this;
+    ++*this;
+    return copy;
+  }
+
+  PrefetchingProjIter& operator--() noexcept {
+    --it_;
+    return *this;
+  }
+
+  PrefetchingProjIter operator--(int) noexcept {
+    auto copy = *this;
+    --it_;
+    return copy;
+  }
+
+  PrefetchingProjIter& operator+=(const difference_type delta) noexcept {
+    it_ += delta;
+    return *this;
+  }
+
+  PrefetchingProjIter& operator-=(const difference_type delta) noexcept {
+    it_ -= delta;
+    return *this;
+  }
+
+  friend PrefetchingProjIter operator+(
+      PrefetchingProjIter it, const difference_type delta) noexcept {
+    return it += delta;
+  }
+
+  friend PrefetchingProjIter operator+(
+      const difference_type delta, PrefetchingProjIter it) noexcept {
+    return it += delta;
+  }
+
+  friend PrefetchingProjIter operator-(
+      PrefetchingProjIter it, const difference_type delta) noexcept {
+    return it -= delta;
+  }
+
+  friend difference_type operator-(
+      const PrefetchingProjIter& lhs, const PrefetchingProjIter& rhs)
+      noexcept {
+    return lhs.it_ - rhs.it_;
+  }
+
+  // As with ProjIter, these don't check whether both iterators view the same
+  // base through the same projection.
+  friend bool operator==(
+      const PrefetchingProjIter& lhs, const PrefetchingProjIter& rhs)
+      noexcept {
+    return lhs.it_ == rhs.it_;
+  }
+
+  friend bool operator!=(
+      const PrefetchingProjIter& lhs, const PrefetchingProjIter& rhs)
+      noexcept {
+    return !(lhs == rhs);
+  }
+
+  friend bool operator<(
+      const PrefetchingProjIter& lhs, const PrefetchingProjIter& rhs)
+      noexcept {
+    return lhs.it_ < rhs.it_;
+  }
+
+  friend bool operator>(
+      const PrefetchingProjIter& lhs, const PrefetchingProjIter& rhs)
+      noexcept {
+    return rhs < lhs;
+  }
+
+  friend bool operator<=(
+      const PrefetchingProjIter& lhs, const PrefetchingProjIter& rhs)
+      noexcept {
+    return !(rhs < lhs);
+  }
+
+  friend bool operator>=(
+      const PrefetchingProjIter& lhs, const PrefetchingProjIter& rhs)
+      noexcept {
+    return !(lhs < rhs);
+  }
+
+  // Returns the wrapped ProjIter.
+  const Inner& get() const noexcept { return it_; }
+
+  // Returns our index relative to the base.
+  difference_type index() const noexcept { return it_.index(); }
+
+  // Returns how far ahead we prefetch.
+  difference_type distance() const noexcept { return distance_; }
+
+ private:
+  Inner it_;
+  difference_type last_;
+  difference_type distance_;
+
+  void prefetch_() const {
+    const auto ahead = it_.index() + distance_;
+    if (distance_ > 0 && ahead < last_) {
+      detail::prefetch_for_read(
+          it_.base() + detail::note_projection_call(it_.projection()(ahead)));
+    }
+  }
+};
+
+// Returns a PrefetchingProjIter that wraps it, for a walk that ends at last,
+// prefetching distance elements ahead.  Make the end iterator the same way,
+// so both have the same type.
+template <typename Iter, typename Callable>
+PrefetchingProjIter<Iter, Callable> make_prefetching_iterator(
+    ProjIter<Iter, Callable> it, const ProjIter<Iter, Callable>& last,
+    const std::ptrdiff_t distance) noexcept {
+  return PrefetchingProjIter<Iter, Callable>(
+      std::move(it), last.index(), distance);
+}
+
+// As above, with a fixed default distance, switched on by the size of the
+// walk: none for walks over fewer than kMinPrefetchBytes of elements, and
+// otherwise kDefaultPrefetchDistance.  Where it matters, measure the loop at
+// hand and pass the distance explicitly.
+template <typename Iter, typename Callable>
+PrefetchingProjIter<Iter, Callable> make_prefetching_iterator(
+    ProjIter<Iter, Callable> it, const ProjIter<Iter, Callable>& last)
+    noexcept {
+  using T = typename std::iterator_traits<Iter>::value_type;
+  const auto bytes = static_cast<std::size_t>(last - it) * sizeof(T);
+  const auto distance =
+      last > it && bytes >= kMinPrefetchBytes ? kDefaultPrefetchDistance : 0;
+  return make_prefetching_iterator(std::move(it), last, distance);
+}
+
+}  // namespace jz
+
+#endif // PREFETCHING_ITERATOR_HH_
@@ -0,0 +1,1852 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+#ifndef PROJECTED_ALGORITHMS_HH_
+#define PROJECTED_ALGORITHMS_HH_
+
+static_assert(__cplusplus >= 201402L, "Requires C++14 or newer.");
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 202002L
+# include <bit>
+#endif
+
+#if __cplusplus >= 201703L && defined(__has_include)
+# if __has_include(<execution>)
+#  define JZ_PROJECTED_ALGORITHMS_HAS_EXECUTION 1
+#  include <execution>
+#  include <system_error>
+#  include <thread>
+# endif
+#endif
+
+#if defined(__AVX2__)
+# include <immintrin.h>
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
+// projected_copy() into a ProjIter range hands copies of at least this many
+// bytes to projected_copy_streaming().  Define it before including this
+// header to change it.
+#ifndef JZ_STREAMING_COPY_THRESHOLD
+# define JZ_STREAMING_COPY_THRESHOLD (std::size_t{8} << 20)
+#endif
+
+#include "projection_iterator.hh"
+
+namespace jz {
+namespace detail {
+
+struct projection_walk_tag {};
+
+// Selects how the in-order walks below traverse a ProjIter range: a segment
+// at a time for piecewise affine projections (std::true_type), with the
+// projection's walk() for those that have one, or else one index at a time
+// (std::false_type).  The first two step the base by offsets, so they need
+// random access bases.
+template <typename Iter, typename Callable>
+using traversal_tag_t = std::conditional_t<
+    !std::is_base_of<
+        std::random_access_iterator_tag,
+        typename std::iterator_traits<Iter>::iterator_category>::value,
+    std::false_type,
+    std::conditional_t<
+        has_affine_segments<Callable>::value, std::true_type,
+        std::conditional_t<has_projection_walk<Callable>::value,
+                           projection_walk_tag, std::false_type>>>;
+
+template <typename InputIt, typename Fn>
+Fn projected_for_each(InputIt first, InputIt last, Fn fn, std::false_type) {
+  for (; first != last; ++first) {
+    fn(*first);
+  }
+  return fn;
+}
+
+template <typename Iter, typename Callable, typename Fn>
+Fn projected_for_each(
+    const ProjIter<Iter, Callable>& first,
+    const ProjIter<Iter, Callable>& last, Fn fn, std::true_type) {
+  const auto base = first.base();
+  const auto& projection = first.projection();
+  const auto end = last.index();
+  auto index = first.index();
+  while (index < end) {
+    const auto segment =
+        note_projection_call(projection.segment(index));
+    const auto stop = std::min(segment.last, end);
+    auto offset = segment.offset + segment.stride * index;
+    for (; index < stop; ++index, offset += segment.stride) {
+      fn(*(base + offset));
+    }
+  }
+  return fn;
+}
+
+template <typename Iter, typename Callable, typename Fn>
+Fn projected_for_each(
+    const ProjIter<Iter, Callable>& first,
+    const ProjIter<Iter, Callable>& last, Fn fn, projection_walk_tag) {
+  const auto base = first.base();
+  auto visit = [&base, &fn](const std::ptrdiff_t offset) {
+    fn(*(base + offset));
+  };
+  first.projection().walk(first.index(), last.index(), visit);
+  return fn;
+}
+
+}  // namespace detail
+
+// Calls fn on each element of [first, last) in order, like std::for_each.
+//
+// When [first, last) is a ProjIter range over a piecewise affine projection
+// (see has_affine_segments), this walks each segment by its stride, so the
+// projection is only consulted once per segment rather than once per element.
+// Projections that walk themselves (see has_projection_walk) step through
+// the range with walk() instead.
+template <typename InputIt, typename Fn>
+Fn projected_for_each(InputIt first, InputIt last, Fn fn) {
+  return detail::projected_for_each(first, last, std::move(fn),
+                                    std::false_type{});
+}
+
+template <typename Iter, typename Callable, typename Fn>
+Fn projected_for_each(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last, Fn fn) {
+  return detail::projected_for_each(
+      first, last, std::move(fn), detail::traversal_tag_t<Iter, Callable>{});
+}
+
+namespace detail {
+
+// Indicates whether projected_copy() can copy a block at a time from a
+// ProjIter over Iter to OutputIt: both must be contiguous, and hold the same
+// arithmetic type, so that copying is just copying bits.
+template <typename Iter, typename OutputIt>
+struct is_block_copyable
+    : std::integral_constant<
+          bool,
+          is_contiguous_base<Iter>::value &&
+          is_contiguous_base<OutputIt>::value &&
+          std::is_arithmetic<
+              typename std::iterator_traits<Iter>::value_type>::value &&
+          std::is_same<
+              typename std::iterator_traits<Iter>::value_type,
+              typename std::iterator_traits<OutputIt>::value_type>::value> {};
+
+template <std::size_t Size>
+using element_size_tag = std::integral_constant<std::size_t, Size>;
+
+// The SIMD kernels below each copy as much of a run as they handle to out,
+// and advance out and the count or index of what they've copied, leaving the
+// rest to a scalar loop.  They address each element from the start of the
+// run, so they never form a pointer past either end of it.  These do nothing
+// for element sizes and targets that have no kernel.
+template <typename T, std::size_t Size>
+void simd_copy_strided(
+    const T*, std::ptrdiff_t, std::ptrdiff_t, std::ptrdiff_t&, T*&,
+    element_size_tag<Size>) noexcept {}
+
+template <typename T, typename Proj, std::size_t Size>
+void simd_copy_projected(
+    const T*, const Proj&, std::ptrdiff_t&, std::ptrdiff_t, T*&,
+    element_size_tag<Size>) noexcept {}
+
+#if defined(__AVX2__)
+// For strides of 2 and -2, as in the folded interleave layout, each 8 x
+// 32-bit output comes from two overlapping loads, each permuted to bring
+// alternate lanes into one half.  The second load starts one element early,
+// so neither reads past the last element in the run.  Other strides are left
+// to the scalar loop: 32-bit gathers measured slower than it for them.
+template <typename T>
+void simd_copy_strided(
+    const T* const src, const std::ptrdiff_t stride, const std::ptrdiff_t count,
+    std::ptrdiff_t& done, T*& out, element_size_tag<4>) noexcept {
+  const auto load = [](const T* const ptr) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+  };
+  const auto store = [](T* const ptr, const __m256i value) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(ptr), value);
+  };
+
+  if (stride == 2) {
+    const auto evens_low = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    for (; count - done >= 8; done += 8, out += 8) {
+      const auto next = src + 2 * done;
+      const auto lo = _mm256_permutevar8x32_epi32(load(next), evens_low);
+      const auto hi = _mm256_permutevar8x32_epi32(load(next + 7), evens_low);
+      store(out, _mm256_permute2x128_si256(lo, hi, 0x30));
+    }
+  } else if (stride == -2) {
+    const auto reversed = _mm256_setr_epi32(7, 5, 3, 1, 6, 4, 2, 0);
+    for (; count - done >= 8; done += 8, out += 8) {
+      const auto next = src - 2 * done;
+      const auto lo = _mm256_permutevar8x32_epi32(load(next - 14), reversed);
+      const auto hi = _mm256_permutevar8x32_epi32(load(next - 7), reversed);
+      store(out, _mm256_permute2x128_si256(hi, lo, 0x30));
+    }
+  }
+}
+
+// As above, for 4 x 64-bit outputs.  Here, gathers do beat the scalar loop
+// for other strides.
+template <typename T>
+void simd_copy_strided(
+    const T* const src, const std::ptrdiff_t stride, const std::ptrdiff_t count,
+    std::ptrdiff_t& done, T*& out, element_size_tag<8>) noexcept {
+  const auto load = [](const T* const ptr) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+  };
+  const auto store = [](T* const ptr, const __m256i value) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(ptr), value);
+  };
+
+  if (stride == 2) {
+    for (; count - done >= 4; done += 4, out += 4) {
+      const auto next = src + 2 * done;
+      const auto lo = _mm256_permute4x64_epi64(load(next), 0x08);
+      const auto hi = _mm256_permute4x64_epi64(load(next + 3), 0xD0);
+      store(out, _mm256_permute2x128_si256(lo, hi, 0x30));
+    }
+  } else if (stride == -2) {
+    for (; count - done >= 4; done += 4, out += 4) {
+      const auto next = src - 2 * done;
+      const auto lo = _mm256_permute4x64_epi64(load(next - 6), 0x20);
+      const auto hi = _mm256_permute4x64_epi64(load(next - 3), 0x07);
+      store(out, _mm256_permute2x128_si256(hi, lo, 0x30));
+    }
+  } else {
+    const auto offsets = _mm256_setr_epi64x(0, stride, 2 * stride, 3 * stride);
+    for (; count - done >= 4; done += 4, out += 4) {
+      store(out, _mm256_i64gather_epi64(
+                     reinterpret_cast<const long long*>(src + stride * done),
+                     offsets, 8));
+    }
+  }
+}
+
+// For projections without affine runs, evaluates the projection for a block
+// of indices, then gathers the block.  With AVX-512, blocks are 8 elements of
+// either size; with AVX2, 4.  (The masked AVX-512 gathers, with every lane
+// enabled, sidestep a spurious -Wmaybe-uninitialized in GCC's unmasked ones.)
+template <typename T, typename Proj>
+void simd_copy_projected(
+    const T* const base, const Proj& projection, std::ptrdiff_t& index,
+    const std::ptrdiff_t last, T*& out, element_size_tag<4>) noexcept {
+#if defined(__AVX512F__)
+  alignas(64) long long offsets[8];
+  for (; last - index >= 8; index += 8, out += 8) {
+    for (int lane = 0; lane < 8; ++lane) {
+      offsets[lane] = projection(index + lane);
+    }
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(out),
+        _mm512_mask_i64gather_epi32(
+            _mm256_setzero_si256(), 0xFF, _mm512_load_si512(offsets), base,
+            4));
+  }
+#else
+  alignas(32) long long offsets[4];
+  for (; last - index >= 4; index += 4, out += 4) {
+    for (int lane = 0; lane < 4; ++lane) {
+      offsets[lane] = projection(index + lane);
+    }
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(out),
+        _mm256_i64gather_epi32(
+            reinterpret_cast<const int*>(base),
+            _mm256_load_si256(reinterpret_cast<const __m256i*>(offsets)), 4));
+  }
+#endif
+}
+
+template <typename T, typename Proj>
+void simd_copy_projected(
+    const T* const base, const Proj& projection, std::ptrdiff_t& index,
+    const std::ptrdiff_t last, T*& out, element_size_tag<8>) noexcept {
+#if defined(__AVX512F__)
+  alignas(64) long long offsets[8];
+  for (; last - index >= 8; index += 8, out += 8) {
+    for (int lane = 0; lane < 8; ++lane) {
+      offsets[lane] = projection(index + lane);
+    }
+    _mm512_storeu_si512(
+        out, _mm512_mask_i64gather_epi64(
+                 _mm512_setzero_si512(), 0xFF, _mm512_load_si512(offsets),
+                 base, 8));
+  }
+#else
+  alignas(32) long long offsets[4];
+  for (; last - index >= 4; index += 4, out += 4) {
+    for (int lane = 0; lane < 4; ++lane) {
+      offsets[lane] = projection(index + lane);
+    }
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(out),
+        _mm256_i64gather_epi64(
+            reinterpret_cast<const long long*>(base),
+            _mm256_load_si256(reinterpret_cast<const __m256i*>(offsets)), 8));
+  }
+#endif
+}
+#endif  // __AVX2__
+
+// Copies the count elements starting at src and spaced stride apart to out.
+// Unit strides copy or reverse-copy contiguously, which the standard library
+// and the compiler already vectorize.
+template <typename T>
+T* copy_strided(
+    const T* const src, const std::ptrdiff_t stride, const std::ptrdiff_t count,
+    T* out) noexcept {
+  if (count <= 0) {
+    return out;
+  }
+  if (stride == 1) {
+    return std::copy(src, src + count, out);
+  }
+  if (stride == -1) {
+    return std::reverse_copy(src - (count - 1), src + 1, out);
+  }
+  auto done = std::ptrdiff_t{0};
+  simd_copy_strided(
+      src, stride, count, done, out, element_size_tag<sizeof(T)>{});
+  for (; done < count; ++done) {
+    *out++ = src[stride * done];
+  }
+  return out;
+}
+
+// Copies the view of base through projection over indices [index, last) to
+// out, one affine segment at a time.
+template <typename T, typename Proj>
+T* copy_projected(
+    const T* const base, const Proj& projection, std::ptrdiff_t index,
+    const std::ptrdiff_t last, T* out, std::true_type) noexcept {
+  while (index < last) {
+    const auto segment =
+        note_projection_call(projection.segment(index));
+    const auto stop = std::min(segment.last, last);
+    out = copy_strided(
+        base + (segment.offset + segment.stride * index), segment.stride,
+        stop - index, out);
+    index = stop;
+  }
+  return out;
+}
+
+// As above, stepping through the indices with the projection's walk().
+template <typename T, typename Proj>
+T* copy_projected(
+    const T* const base, const Proj& projection, const std::ptrdiff_t index,
+    const std::ptrdiff_t last, T* out, projection_walk_tag) noexcept {
+  auto copy = [base, &out](const std::ptrdiff_t offset) {
+    *out++ = base[offset];
+  };
+  projection.walk(index, last, copy);
+  return out;
+}
+
+// As above, for projections with neither.
+template <typename T, typename Proj>
+T* copy_projected(
+    const T* const base, const Proj& projection, std::ptrdiff_t index,
+    const std::ptrdiff_t last, T* out, std::false_type) noexcept {
+  simd_copy_projected(
+      base, projection, index, last, out, element_size_tag<sizeof(T)>{});
+  for (; index < last; ++index) {
+    *out++ = base[projection(index)];
+  }
+  return out;
+}
+
+template <typename Iter, typename Callable, typename OutputIt>
+OutputIt projected_copy(
+    const ProjIter<Iter, Callable>& first,
+    const ProjIter<Iter, Callable>& last, OutputIt out, std::false_type) {
+  return std::copy(first, last, out);
+}
+
+template <typename Iter, typename Callable, typename OutputIt>
+OutputIt projected_copy(
+    const ProjIter<Iter, Callable>& first,
+    const ProjIter<Iter, Callable>& last, OutputIt out, std::true_type) {
+  const auto dest = detail::to_address(out);
+  const auto dest_last = copy_projected(
+      first.base(), first.projection(), first.index(), last.index(), dest,
+      traversal_tag_t<Iter, Callable>{});
+  return out + (dest_last - dest);
+}
+
+}  // namespace detail
+
+// Copies [first, last) to out, like std::copy.
+//
+// For a ProjIter range over a contiguous base of arithmetic type, copied to
+// contiguous storage of the same type, this copies blocks of elements rather
+// than dereferencing one projected element at a time.  For piecewise affine
+// projections, each segment copies with a kernel suited to its stride:
+// contiguous copies for strides of 1 and -1, and when built for AVX2,
+// permuted vector loads for strides of 2 and -2, and hardware gathers for
+// other strides over 64-bit elements.  Projections without affine segments
+// evaluate the projection for a block of indices, then gather the block,
+// using AVX-512 if it's enabled, unless they walk themselves (see
+// has_projection_walk).  Other targets use scalar loops.
+template <typename InputIt, typename OutputIt>
+OutputIt projected_copy(InputIt first, InputIt last, OutputIt out) {
+  return std::copy(first, last, out);
+}
+
+template <typename Iter, typename Callable, typename OutputIt>
+OutputIt projected_copy(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last,
+    OutputIt out) {
+  return detail::projected_copy(
+      first, last, out, detail::is_block_copyable<Iter, OutputIt>{});
+}
+
+namespace detail {
+
+template <typename Callable, typename = void>
+struct has_projection_size : std::false_type {};
+
+template <typename Callable>
+struct has_projection_size<
+    Callable, decltype(void(std::declval<const Callable&>().size()))>
+    : std::true_type {};
+
+// Indicates whether projected_copy_streaming() can write a ProjIter range
+// over Iter through Callable in base order, reading from InputIt: both must
+// be contiguous and hold the same arithmetic type, and the projection must be
+// piecewise affine, invertible, and know its size.  Such projections permute
+// [0, size()).
+template <typename InputIt, typename Iter, typename Callable>
+struct is_streamable
+    : std::integral_constant<
+          bool,
+          is_block_copyable<InputIt, Iter>::value &&
+          has_affine_segments<Callable>::value &&
+          has_inverse_projection<Callable>::value &&
+          has_projection_size<Callable>::value> {};
+
+// The size of the lines projected_copy_streaming() writes whole, and of the
+// blocks it assembles them in.
+constexpr std::size_t kStreamLineSize = 64;
+constexpr std::size_t kStreamBlockSize = 4096;
+
+// Copies a line of kStreamLineSize bytes from buffer to line, both aligned to
+// kStreamLineSize.  With SSE2, this uses non-temporal stores, which write
+// the line without first reading it into the cache.  Elsewhere, it's an
+// ordinary copy, which still hands the memory system whole lines in order.
+inline void stream_line(void* const line, const void* const buffer) noexcept {
+#if defined(__SSE2__)
+  const auto src = static_cast<const __m128i*>(buffer);
+  const auto dest = static_cast<__m128i*>(line);
+  for (auto i = std::size_t{0}; i < kStreamLineSize / 16; ++i) {
+    _mm_stream_si128(dest + i, _mm_load_si128(src + i));
+  }
+#else
+  std::memcpy(line, buffer, kStreamLineSize);
+#endif
+}
+
+// Orders the non-temporal stores above before any later stores, so that
+// other threads see them once the copy returns.
+inline void stream_fence() noexcept {
+#if defined(__SSE2__)
+  _mm_sfence();
+#endif
+}
+
+// Copies as much of a run of run elements as it handles from src, read
+// forward for a step of 1 or backward for -1, to every gap'th slot of block
+// from slot on, leaving the slots between alone, and stays within the first
+// count slots.  It advances slot and the count done of what it's copied,
+// leaving the rest to a scalar loop, and addresses each element from src, so
+// it never forms a pointer past either end of the run.  With AVX2 or SSE2,
+// this handles the gap of 2 in the folded interleave layout, by spreading
+// each load across alternate lanes and blending it into the block.
+template <typename T, std::size_t Size>
+void simd_stage_strided(
+    const T*, std::ptrdiff_t, std::ptrdiff_t, std::ptrdiff_t, std::ptrdiff_t&,
+    std::ptrdiff_t&, T*, std::ptrdiff_t, element_size_tag<Size>) noexcept {}
+
+#if defined(__AVX2__)
+template <typename T>
+void simd_stage_strided(
+    const T* const src, const std::ptrdiff_t step, const std::ptrdiff_t gap,
+    const std::ptrdiff_t run, std::ptrdiff_t& done, std::ptrdiff_t& slot,
+    T* const block,
+    const std::ptrdiff_t count, element_size_tag<4>) noexcept {
+  const auto load = [](const T* const ptr) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+  };
+  const auto spread = [&load](T* const dest, const __m256i value,
+                              const __m256i lanes) {
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(dest),
+        _mm256_blend_epi32(
+            load(dest), _mm256_permutevar8x32_epi32(value, lanes), 0x55));
+  };
+
+  if (gap != 2) {
+    return;
+  }
+  if (step == 1) {
+    const auto lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    const auto hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+    for (; run - done >= 8 && slot + 16 <= count; done += 8, slot += 16) {
+      const auto value = load(src + done);
+      spread(block + slot, value, lo);
+      spread(block + slot + 8, value, hi);
+    }
+  } else {
+    const auto lo = _mm256_setr_epi32(7, 7, 6, 6, 5, 5, 4, 4);
+    const auto hi = _mm256_setr_epi32(3, 3, 2, 2, 1, 1, 0, 0);
+    for (; run - done >= 8 && slot + 16 <= count; done += 8, slot += 16) {
+      const auto value = load(src - done - 7);
+      spread(block + slot, value, lo);
+      spread(block + slot + 8, value, hi);
+    }
+  }
+}
+
+template <typename T>
+void simd_stage_strided(
+    const T* const src, const std::ptrdiff_t step, const std::ptrdiff_t gap,
+    const std::ptrdiff_t run, std::ptrdiff_t& done, std::ptrdiff_t& slot,
+    T* const block,
+    const std::ptrdiff_t count, element_size_tag<8>) noexcept {
+  const auto load = [](const T* const ptr) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+  };
+  const auto spread = [&load](T* const dest, const __m256i spread_value) {
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(dest),
+        _mm256_blend_epi32(load(dest), spread_value, 0x33));
+  };
+
+  if (gap != 2) {
+    return;
+  }
+  if (step == 1) {
+    for (; run - done >= 4 && slot + 8 <= count; done += 4, slot += 8) {
+      const auto value = load(src + done);
+      spread(block + slot, _mm256_permute4x64_epi64(value, 0x50));
+      spread(block + slot + 4, _mm256_permute4x64_epi64(value, 0xFA));
+    }
+  } else {
+    for (; run - done >= 4 && slot + 8 <= count; done += 4, slot += 8) {
+      const auto value = load(src - done - 3);
+      spread(block + slot, _mm256_permute4x64_epi64(value, 0xAF));
+      spread(block + slot + 4, _mm256_permute4x64_epi64(value, 0x05));
+    }
+  }
+}
+#elif defined(__SSE2__)
+// Without AVX2, the same with SSE2, blending through a mask.
+template <typename T>
+void simd_stage_strided(
+    const T* const src, const std::ptrdiff_t step, const std::ptrdiff_t gap,
+    const std::ptrdiff_t run, std::ptrdiff_t& done, std::ptrdiff_t& slot,
+    T* const block,
+    const std::ptrdiff_t count, element_size_tag<4>) noexcept {
+  const auto load = [](const T* const ptr) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+  };
+  const auto evens = _mm_setr_epi32(-1, 0, -1, 0);
+  const auto spread = [&load, evens](T* const dest, const __m128i value) {
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(dest),
+        _mm_or_si128(_mm_and_si128(evens, value),
+                     _mm_andnot_si128(evens, load(dest))));
+  };
+
+  if (gap != 2) {
+    return;
+  }
+  for (; run - done >= 4 && slot + 8 <= count; done += 4, slot += 8) {
+    const auto value = step == 1
+                           ? load(src + done)
+                           : _mm_shuffle_epi32(load(src - done - 3), 0x1B);
+    spread(block + slot, _mm_unpacklo_epi32(value, value));
+    spread(block + slot + 4, _mm_unpackhi_epi32(value, value));
+  }
+}
+
+template <typename T>
+void simd_stage_strided(
+    const T* const src, const std::ptrdiff_t step, const std::ptrdiff_t gap,
+    const std::ptrdiff_t run, std::ptrdiff_t& done, std::ptrdiff_t& slot,
+    T* const block,
+    const std::ptrdiff_t count, element_size_tag<8>) noexcept {
+  const auto load = [](const T* const ptr) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+  };
+  const auto evens = _mm_setr_epi32(-1, -1, 0, 0);
+  const auto spread = [&load, evens](T* const dest, const __m128i value) {
+    _mm_storeu_si128(
+        reinterpret_cast<__m128i*>(dest),
+        _mm_or_si128(_mm_and_si128(evens, value),
+                     _mm_andnot_si128(evens, load(dest))));
+  };
+
+  if (gap != 2) {
+    return;
+  }
+  for (; run - done >= 2 && slot + 4 <= count; done += 2, slot += 4) {
+    const auto value = step == 1
+                           ? load(src + done)
+                           : _mm_shuffle_epi32(load(src - done - 1), 0x4E);
+    spread(block + slot, _mm_unpacklo_epi64(value, value));
+    spread(block + slot + 2, _mm_unpackhi_epi64(value, value));
+  }
+}
+#endif
+
+// Sets the bits in the bitmap filled for the run slots pos, pos + gap, ....
+// Slots gap apart fall in each 64-bit word in the same pattern, shifted, so
+// this sets them a word at a time.
+inline void mark_strided(
+    std::uint64_t* const filled, std::ptrdiff_t pos, const std::ptrdiff_t gap,
+    const std::ptrdiff_t run) noexcept {
+  constexpr auto kBits = std::ptrdiff_t{64};
+  auto pattern = std::uint64_t{0};
+  for (auto bit = std::ptrdiff_t{0}; bit < kBits; bit += gap) {
+    pattern |= std::uint64_t{1} << bit;
+  }
+  const auto end = pos + gap * (run - 1) + 1;
+  while (pos < end) {
+    const auto word = pos / kBits;
+    const auto word_end = (word + 1) * kBits;
+    auto mask = pattern << (pos % kBits);
+    if (end < word_end) {
+      mask &= (std::uint64_t{1} << (end % kBits)) - 1;
+    }
+    filled[word] |= mask;
+    pos += gap * ((word_end - pos + gap - 1) / gap);
+  }
+}
+
+// Returns the number of trailing zero bits in bits, which mustn't be zero.
+inline int count_trailing_zeros(const std::uint64_t bits) noexcept {
+#if __cplusplus >= 202002L
+  return std::countr_zero(bits);
+#elif defined(__GNUC__)
+  return __builtin_ctzll(bits);
+#else
+  // Isolates the lowest set bit, and looks up its position by the top six
+  // bits of its product with a de Bruijn sequence.
+  constexpr int kPositions[64] = {
+      0,  1,  2,  53, 3,  7,  54, 27, 4,  38, 41, 8,  34, 55, 48, 28,
+      62, 5,  39, 46, 44, 42, 22, 9,  24, 35, 59, 56, 49, 18, 29, 11,
+      63, 52, 6,  26, 37, 40, 33, 47, 61, 45, 43, 21, 23, 58, 17, 10,
+      51, 25, 36, 32, 60, 20, 57, 16, 50, 31, 19, 15, 30, 14, 13, 12};
+  return kPositions[((bits & (~bits + 1)) * 0x022FDD63CC95386Du) >> 58];
+#endif
+}
+
+// Fills block with the elements of the view bound for base[first, first +
+// count), taking them from src, the whole view in view order.  This copies
+// the part of each segment that lands in the block in one strided pass, so
+// the projection's inverse and segment() are consulted once per run rather
+// than once per element.  A bitmap of the elements filled so far finds where
+// the next run starts.
+template <typename T, typename Proj>
+void stage_streaming_block(
+    const T* const src, const Proj& projection, const std::ptrdiff_t first,
+    const std::ptrdiff_t count, T* const block) noexcept {
+  constexpr auto kBits = std::ptrdiff_t{64};
+  std::uint64_t filled[kStreamBlockSize / sizeof(T) / kBits] = {};
+  for (auto pos = std::ptrdiff_t{0}; pos < count; ) {
+    const auto unfilled = ~filled[pos / kBits] >> (pos % kBits);
+    if (unfilled == 0) {
+      pos = (pos / kBits + 1) * kBits;
+      continue;
+    }
+    pos += count_trailing_zeros(unfilled);
+    if (pos >= count) {
+      break;
+    }
+
+    // The run starts at the lowest unfilled element, so for a positive
+    // stride, it walks the segment forward from there, and for a negative
+    // one, backward.
+    const auto index =
+        static_cast<std::ptrdiff_t>(projection.inverse(first + pos));
+    const auto segment = note_projection_call(projection.segment(index));
+    const auto step = segment.stride > 0 ? 1 : -1;
+    const auto gap = segment.stride * step;
+    const auto run = std::min(
+        step > 0 ? segment.last - index : index - segment.first + 1,
+        (count - pos + gap - 1) / gap);
+    const auto from = src + index;
+    auto done = std::ptrdiff_t{0};
+    auto slot = pos;
+    simd_stage_strided(from, step, gap, run, done, slot, block, count,
+                       element_size_tag<sizeof(T)>{});
+    for (; done < run; ++done, slot += gap) {
+      block[slot] = from[step * done];
+    }
+    mark_strided(filled, pos, gap, run);
+  }
+}
+
+// Copies src, the count elements of the whole view of base through
+// projection in view order, to base, writing base in order a block at a
+// time.  Each block is assembled in cache, and its whole lines go out
+// through stream_line().  The elements ahead of base's first line boundary,
+// and past its last, go out with ordinary stores.
+template <typename T, typename Proj>
+void copy_streaming(
+    const T* const src, const std::ptrdiff_t count, T* const base,
+    const Proj& projection) noexcept {
+  constexpr auto kLineElems =
+      static_cast<std::ptrdiff_t>(kStreamLineSize / sizeof(T));
+  constexpr auto kBlockElems =
+      static_cast<std::ptrdiff_t>(kStreamBlockSize / sizeof(T));
+
+  alignas(kStreamLineSize) T block[kBlockElems];
+  const auto misalignment =
+      reinterpret_cast<std::uintptr_t>(base) % kStreamLineSize;
+  const auto head = std::min(
+      count, static_cast<std::ptrdiff_t>(
+          misalignment ? (kStreamLineSize - misalignment) / sizeof(T) : 0));
+  stage_streaming_block(src, projection, 0, head, block);
+  std::copy(block, block + head, base);
+
+  auto first = head;
+  while (count - first >= kLineElems) {
+    const auto lines = std::min(kBlockElems, count - first) / kLineElems;
+    stage_streaming_block(src, projection, first, lines * kLineElems, block);
+    for (auto line = std::ptrdiff_t{0}; line < lines; ++line) {
+      stream_line(base + first + line * kLineElems,
+                  block + line * kLineElems);
+    }
+    first += lines * kLineElems;
+  }
+  stream_fence();
+
+  const auto tail = count - first;
+  stage_streaming_block(src, projection, first, tail, block);
+  std::copy(block, block + tail, base + first);
+}
+
+template <typename InputIt, typename Iter, typename Callable>
+ProjIter<Iter, Callable> projected_copy_streaming(
+    InputIt first, InputIt last, ProjIter<Iter, Callable> out,
+    std::false_type) {
+  return std::copy(first, last, out);
+}
+
+template <typename InputIt, typename Iter, typename Callable>
+ProjIter<Iter, Callable> projected_copy_streaming(
+    InputIt first, InputIt last, ProjIter<Iter, Callable> out,
+    std::true_type) {
+  const auto count = static_cast<std::ptrdiff_t>(std::distance(first, last));
+  if (out.index() != 0 || count != out.projection().size()) {
+    return std::copy(first, last, out);
+  }
+  copy_streaming(
+      detail::to_address(first), count, out.base(), out.projection());
+  return out + count;
+}
+
+}  // namespace detail
+
+// Copies [first, last) to out, like std::copy, for a ProjIter out whose
+// writes would otherwise scatter across a buffer too large to cache.  Each
+// scattered write costs a read of the line it lands in, to fill the rest of
+// that line in the cache, even when later writes overwrite the rest of it.
+//
+// When [first, last) is contiguous and covers the whole of out's view, and
+// out views a contiguous base of the same arithmetic type through a
+// piecewise affine, invertible projection that knows its size, such as
+// FoldedInterleaveProjection or TiledProjection, this instead writes the
+// base in order.  It assembles each 4 KiB block of the base in cache, a
+// segment at a time, finding each segment through the projection's inverse.
+// It then writes the block's whole 64-byte lines with non-temporal stores on
+// targets with SSE2, which skip the read.  Other views fall back to
+// std::copy, and other targets to ordinary stores.  The stores are fenced
+// before this returns.
+//
+// Projections without affine segments, such as BitReverseProjection, would
+// have to gather every element through the inverse instead.  That trades
+// scattered writes for scattered reads, which measured slower, so those
+// fall back to std::copy too.
+//
+// Streaming leaves the written lines out of the cache, so it's a loss for
+// copies that are read again soon.  projected_copy() only chooses it for
+// copies of at least JZ_STREAMING_COPY_THRESHOLD bytes.
+template <typename InputIt, typename OutputIt>
+OutputIt projected_copy_streaming(
+    InputIt first, InputIt last, OutputIt out) {
+  return std::copy(first, last, out);
+}
+
+template <typename InputIt, typename Iter, typename Callable>
+ProjIter<Iter, Callable> projected_copy_streaming(
+    InputIt first, InputIt last, ProjIter<Iter, Callable> out) {
+  return detail::projected_copy_streaming(
+      first, last, out, detail::is_streamable<InputIt, Iter, Callable>{});
+}
+
+// Copying into a ProjIter range uses projected_copy_streaming() for copies
+// of at least JZ_STREAMING_COPY_THRESHOLD bytes that it can stream, and
+// std::copy otherwise.
+template <typename InputIt, typename Iter, typename Callable>
+ProjIter<Iter, Callable> projected_copy(
+    InputIt first, InputIt last, ProjIter<Iter, Callable> out) {
+  using Streamable = detail::is_streamable<InputIt, Iter, Callable>;
+  using T = typename std::iterator_traits<Iter>::value_type;
+  if (Streamable::value &&
+      static_cast<std::size_t>(std::distance(first, last)) * sizeof(T) >=
+          std::size_t{JZ_STREAMING_COPY_THRESHOLD}) {
+    return detail::projected_copy_streaming(first, last, out, Streamable{});
+  }
+  return std::copy(first, last, out);
+}
+
+// Copying from one ProjIter range to another copies an element at a time.
+template <typename Iter, typename Callable, typename OutIter,
+          typename OutCallable>
+ProjIter<OutIter, OutCallable> projected_copy(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last,
+    ProjIter<OutIter, OutCallable> out) {
+  return std::copy(first, last, out);
+}
+
+namespace detail {
+
+template <typename Iter, typename Callable, typename OutputIt,
+          typename UnaryOp>
+OutputIt projected_transform(
+    const ProjIter<Iter, Callable>& first,
+    const ProjIter<Iter, Callable>& last, OutputIt out, UnaryOp& op,
+    std::false_type) {
+  return std::transform(first, last, out, std::ref(op));
+}
+
+// Copies a block at a time into a small buffer with projected_copy(), then
+// transforms from the buffer, which the compiler can vectorize.
+template <typename Iter, typename Callable, typename OutputIt,
+          typename UnaryOp>
+OutputIt projected_transform(
+    ProjIter<Iter, Callable> first, const ProjIter<Iter, Callable>& last,
+    OutputIt out, UnaryOp& op, std::true_type) {
+  constexpr std::ptrdiff_t kBlockSize = 256;
+  typename std::iterator_traits<Iter>::value_type buffer[kBlockSize];
+  while (first != last) {
+    const auto count = std::min(last - first, kBlockSize);
+    const auto next = first + count;
+    projected_copy(first, next, buffer, std::true_type{});
+    out = std::transform(buffer, buffer + count, out, std::ref(op));
+    first = next;
+  }
+  return out;
+}
+
+}  // namespace detail
+
+// Applies op to each element of [first, last) and writes the results to out,
+// like std::transform.  For ProjIter ranges that projected_copy() can copy a
+// block at a time, this reads the elements in blocks the same way.
+template <typename InputIt, typename OutputIt, typename UnaryOp>
+OutputIt projected_transform(
+    InputIt first, InputIt last, OutputIt out, UnaryOp op) {
+  return std::transform(first, last, out, std::move(op));
+}
+
+template <typename Iter, typename Callable, typename OutputIt,
+          typename UnaryOp>
+OutputIt projected_transform(
+    ProjIter<Iter, Callable> first, ProjIter<Iter, Callable> last,
+    OutputIt out, UnaryOp op) {
+  using T = typename std::iterator_traits<Iter>::value_type;
+  return detail::projected_transform(
+      first, last, out, op, detail::is_block_copyable<Iter, T*>{});
+}
+
+namespace detail {
+
+// Indicates whether gather() can fill a vector of T from InputIt with
+// projected_copy()'s block copies.
+template <typename InputIt, typename T>
+struct is_block_gatherable : std::false_type {};
+
+template <typename Iter, typename Callable, typename T>
+struct is_block_gatherable<ProjIter<Iter, Callable>, T>
+    : is_block_copyable<Iter, T*> {};
+
+template <typename InputIt, typename T, typename Alloc>
+void gather(
+    InputIt first, InputIt last, std::vector<T, Alloc>& scratch,
+    std::false_type) {
+  scratch.clear();
+  scratch.reserve(std::distance(first, last));
+  jz::projected_for_each(first, last, [&scratch](auto&& elem) {
+    scratch.push_back(std::move(elem));
+  });
+}
+
+template <typename InputIt, typename T, typename Alloc>
+void gather(
+    InputIt first, InputIt last, std::vector<T, Alloc>& scratch,
+    std::true_type) {
+  scratch.resize(std::distance(first, last));
+  projected_copy(first, last, scratch.data());
+}
+
+// Replaces the contents of scratch with the elements of [first, last), moved
+// out in order.
+template <typename InputIt, typename T, typename Alloc>
+void gather(InputIt first, InputIt last, std::vector<T, Alloc>& scratch) {
+  gather(first, last, scratch, is_block_gatherable<InputIt, T>{});
+}
+
+// Moves the elements of [first, last) to consecutive positions starting at
+// out.
+template <typename InputIt, typename OutputIt>
+OutputIt move_out(InputIt first, InputIt last, OutputIt out) {
+  jz::projected_for_each(first, last, [&out](auto&& elem) {
+    *out = std::move(elem);
+    ++out;
+  });
+  return out;
+}
+
+// Moves consecutive elements starting at src into [first, last).
+template <typename InputIt, typename ForwardIt>
+void scatter(InputIt src, ForwardIt first, ForwardIt last) {
+  jz::projected_for_each(first, last, [&src](auto&& elem) {
+    elem = std::move(*src);
+    ++src;
+  });
+}
+
+// Returns the size 2m of the prefix that each round of in_shuffle() and
+// in_unshuffle() cycle-shuffles within 2n elements: the largest with 2m + 1 a
+// power of 3.
+inline std::ptrdiff_t in_shuffle_round_size(const std::ptrdiff_t n) noexcept {
+  auto pow3 = std::ptrdiff_t{1};
+  while (pow3 <= (2 * n + 1) / 3) {
+    pow3 *= 3;
+  }
+  return pow3 - 1;
+}
+
+// Performs an in-place perfect in-shuffle of the 2n elements starting at
+// first.  That is, a0, ..., a(n-1), b0, ..., b(n-1) becomes b0, a0, b1, a1,
+// ..., b(n-1), a(n-1).
+//
+// This is Jain's cycle-leader algorithm ("A Simple In-Place Algorithm for
+// In-Shuffle", 2004).  For 2m elements where 2m + 1 is a power of 3, the
+// element at 1-based position i moves to position 2i mod (2m + 1), and the
+// cycles of that permutation are led by 1, 3, 9, ....  Each round rotates the
+// largest such 2m elements into place, runs those cycles, and then repeats on
+// the remainder.  It runs in O(n) time with O(1) extra space.
+template <typename RandomIt>
+void in_shuffle(RandomIt first, std::ptrdiff_t n) {
+  using std::swap;
+  while (n > 0) {
+    const auto pow3 = in_shuffle_round_size(n) + 1;
+    const auto m = (pow3 - 1) / 2;
+
+    // Bring b0, ..., b(m-1) up next to a0, ..., a(m-1).
+    std::rotate(first + m, first + n, first + n + m);
+
+    for (auto leader = std::ptrdiff_t{1}; leader < pow3; leader *= 3) {
+      auto i = leader;
+      auto value = std::move(first[i - 1]);
+      do {
+        i = 2 * i;
+        i -= i >= pow3 ? pow3 : 0;
+        swap(value, first[i - 1]);
+      } while (i != leader);
+    }
+
+    first += 2 * m;
+    n -= m;
+  }
+}
+
+// Inverts in_shuffle(): b0, a0, b1, a1, ..., b(n-1), a(n-1), in the 2n
+// elements starting at first, becomes a0, ..., a(n-1), b0, ..., b(n-1).
+//
+// This undoes in_shuffle()'s rounds from the last to the first, running each
+// round's cycles backward and then its rotation, so it also runs in O(n) time
+// with O(1) extra space.  Rather than store where each round starts, it
+// recounts the rounds, which costs O(log(n)^2) time in all.
+template <typename RandomIt>
+void in_unshuffle(const RandomIt first, const std::ptrdiff_t n) {
+  using std::swap;
+  auto rounds = 0;
+  for (auto left = n; left > 0; left -= in_shuffle_round_size(left) / 2) {
+    ++rounds;
+  }
+
+  while (rounds-- > 0) {
+    auto offset = std::ptrdiff_t{0};
+    auto left = n;
+    for (auto round = 0; round < rounds; ++round) {
+      const auto m = in_shuffle_round_size(left) / 2;
+      offset += 2 * m;
+      left -= m;
+    }
+
+    const auto pow3 = in_shuffle_round_size(left) + 1;
+    const auto m = (pow3 - 1) / 2;
+    const auto base = first + offset;
+
+    // Each element moves from position i to i / 2 mod (2m + 1).
+    for (auto leader = std::ptrdiff_t{1}; leader < pow3; leader *= 3) {
+      auto i = leader;
+      auto value = std::move(base[i - 1]);
+      do {
+        i = i % 2 == 0 ? i / 2 : (i + pow3) / 2;
+        swap(value, base[i - 1]);
+      } while (i != leader);
+    }
+
+    std::rotate(base + m, base + 2 * m, base + left + m);
+  }
+}
+
+// Performs an in-place perfect out-shuffle of the 2n elements starting at
+// first.  That is, a0, ..., a(n-1), b0, ..., b(n-1) becomes a0, b0, a1, b1,
+// ..., a(n-1), b(n-1).  The first and last elements stay put, and everything
+// between them is an in-shuffle.
+template <typename RandomIt>
+void out_shuffle(RandomIt first, std::ptrdiff_t n) {
+  if (n > 1) {
+    in_shuffle(first + 1, n - 1);
+  }
+}
+
+// Inverts out_shuffle().
+template <typename RandomIt>
+void out_unshuffle(RandomIt first, std::ptrdiff_t n) {
+  if (n > 1) {
+    in_unshuffle(first + 1, n - 1);
+  }
+}
+
+// Rearranges an ascending range in place from sorted order into the folded
+// interleave layout: the smaller half ascending in the even positions, and
+// the larger half descending in the odd positions.
+//
+// Reversing the back half puts it in the order the odd positions want, after
+// which it's a perfect out-shuffle of the first 2 * (n / 2) elements.  For
+// odd n, the reversal also moves the median to the last position, which is
+// exactly where the layout wants it.
+template <typename RandomIt>
+void folded_interleave_layout(RandomIt first, RandomIt last) {
+  const auto half = (last - first) / 2;
+  std::reverse(first + half, last);
+  out_shuffle(first, half);
+}
+
+// Inverts folded_interleave_layout(), bringing the layout back into
+// ascending order.
+template <typename RandomIt>
+void folded_interleave_unlayout(RandomIt first, RandomIt last) {
+  const auto half = (last - first) / 2;
+  out_unshuffle(first, half);
+  std::reverse(first + half, last);
+}
+
+}  // namespace detail
+
+// Sorts the elements of [first, last) by gathering them into contiguous
+// scratch storage, sorting the scratch storage, and scattering the result
+// back through [first, last).
+//
+// This is intended for ranges of projection iterators.  Sorting through a
+// ProjIter directly evaluates the projection on every compare and swap, and
+// the resulting access pattern jumps around the base container.  Gathering
+// and scattering each walks the projected view exactly once in order, and all
+// of the sort's traffic lands in contiguous memory.
+//
+// The scratch vector is cleared and refilled, so a caller that sorts many
+// ranges can reuse a single vector and only pay for allocation when the range
+// grows.  Its contents are unspecified afterwards, but its capacity is
+// retained.
+//
+// This costs an extra copy of the range.  When memory is tight, std::sort
+// directly over the ProjIter range remains the in-place alternative.
+template <typename RandomIt, typename Compare, typename Alloc>
+void projected_sort(
+    RandomIt first, RandomIt last, Compare comp,
+    std::vector<typename std::iterator_traits<RandomIt>::value_type, Alloc>&
+        scratch) {
+  detail::gather(first, last, scratch);
+  std::sort(scratch.begin(), scratch.end(), comp);
+  detail::scatter(scratch.begin(), first, last);
+  scratch.clear();
+}
+
+// As above, but allocates its own scratch storage.
+template <typename RandomIt, typename Compare>
+void projected_sort(RandomIt first, RandomIt last, Compare comp) {
+  auto scratch =
+      std::vector<typename std::iterator_traits<RandomIt>::value_type>{};
+  projected_sort(first, last, comp, scratch);
+}
+
+// As above, but sorts in ascending order with operator<.
+template <typename RandomIt>
+void projected_sort(RandomIt first, RandomIt last) {
+  projected_sort(first, last, std::less<>{});
+}
+
+// Stable counterpart of projected_sort(), above.
+template <typename RandomIt, typename Compare, typename Alloc>
+void projected_stable_sort(
+    RandomIt first, RandomIt last, Compare comp,
+    std::vector<typename std::iterator_traits<RandomIt>::value_type, Alloc>&
+        scratch) {
+  detail::gather(first, last, scratch);
+  std::stable_sort(scratch.begin(), scratch.end(), comp);
+  detail::scatter(scratch.begin(), first, last);
+  scratch.clear();
+}
+
+template <typename RandomIt, typename Compare>
+void projected_stable_sort(RandomIt first, RandomIt last, Compare comp) {
+  auto scratch =
+      std::vector<typename std::iterator_traits<RandomIt>::value_type>{};
+  projected_stable_sort(first, last, comp, scratch);
+}
+
+template <typename RandomIt>
+void projected_stable_sort(RandomIt first, RandomIt last) {
+  projected_stable_sort(first, last, std::less<>{});
+}
+
+// Sorts [first, last) directly into the folded interleave layout: the
+// smallest half of the elements in ascending order in the even positions, and
+// the largest half in descending order in the odd positions.  For example,
+// 3, 9, 6, 0, 1, 5, 4, 7, 2, 8 becomes 0, 9, 1, 8, 2, 7, 3, 6, 4, 5.
+//
+// This gives the same result as std::sort through a folded interleave
+// ProjIter, but it sorts the underlying range contiguously with no
+// projection, and then applies the layout, which is a fixed permutation that
+// needs no comparisons.  The in-place layout step is a cycle-following
+// shuffle that runs in O(n) time with O(1) extra space.
+template <typename RandomIt, typename Compare>
+void folded_interleave_sort(RandomIt first, RandomIt last, Compare comp) {
+  std::sort(first, last, comp);
+  detail::folded_interleave_layout(first, last);
+}
+
+// As above, but sorts in ascending order with operator<.
+template <typename RandomIt>
+void folded_interleave_sort(RandomIt first, RandomIt last) {
+  folded_interleave_sort(first, last, std::less<>{});
+}
+
+// As above, but sorts out of place in the caller's scratch vector, and then
+// lays out the result in a single linear pass: two sequential read streams,
+// from the front and back of the sorted scratch, feeding the even and odd
+// positions of [first, last) in turn.  The scratch vector's contents are
+// unspecified afterwards, but its capacity is retained.
+template <typename RandomIt, typename Compare, typename Alloc>
+void folded_interleave_sort(
+    RandomIt first, RandomIt last, Compare comp,
+    std::vector<typename std::iterator_traits<RandomIt>::value_type, Alloc>&
+        scratch) {
+  scratch.assign(std::make_move_iterator(first), std::make_move_iterator(last));
+  std::sort(scratch.begin(), scratch.end(), comp);
+
+  auto front = scratch.begin();
+  auto back  = scratch.end();
+  for (auto it = first; it != last; ++it) {
+    *it = std::move(*front++);
+    if (++it == last) {
+      break;
+    }
+    *it = std::move(*--back);
+  }
+  scratch.clear();
+}
+
+namespace detail {
+
+// Returns the view index of a changed element, given its base index.  For
+// ranges other than ProjIter ranges, the two are the same.
+template <typename RandomIt>
+std::ptrdiff_t resort_view_index(const RandomIt&, const std::ptrdiff_t index) {
+  return index;
+}
+
+template <typename Iter, typename Callable>
+std::ptrdiff_t resort_view_index(
+    const ProjIter<Iter, Callable>& first, const std::ptrdiff_t base_index) {
+  static_assert(has_inverse_projection<Callable>::value,
+                "Base indices can only be mapped through an invertible "
+                "projection.");
+  return first.projection().inverse(base_index) - first.index();
+}
+
+// Returns the number of entries in the ascending counts vector that are at
+// most index.
+template <typename Alloc>
+std::ptrdiff_t count_at_most(
+    const std::vector<std::ptrdiff_t, Alloc>& counts,
+    const std::ptrdiff_t index) {
+  return std::upper_bound(counts.begin(), counts.end(), index) -
+         counts.begin();
+}
+
+// Does the work of projected_resort(), below, taking its vectors' storage
+// from alloc.
+template <typename RandomIt, typename IndexIt, typename Compare,
+          typename Alloc>
+void projected_resort(
+    RandomIt first, RandomIt last, IndexIt dirty_first, IndexIt dirty_last,
+    Compare comp, const Alloc& alloc) {
+  using std::ptrdiff_t;
+  using T = typename std::iterator_traits<RandomIt>::value_type;
+  using Traits = std::allocator_traits<Alloc>;
+  using Indices = std::vector<
+      ptrdiff_t, typename Traits::template rebind_alloc<ptrdiff_t>>;
+  using Values = std::vector<T, typename Traits::template rebind_alloc<T>>;
+
+  auto holes = Indices(alloc);
+  for (; dirty_first != dirty_last; ++dirty_first) {
+    holes.push_back(detail::resort_view_index(first, *dirty_first));
+  }
+  std::sort(holes.begin(), holes.end());
+  holes.erase(std::unique(holes.begin(), holes.end()), holes.end());
+  const auto changed = static_cast<ptrdiff_t>(holes.size());
+  const auto unchanged = (last - first) - changed;
+
+  auto values = Values(alloc);
+  values.reserve(changed);
+  for (const auto hole : holes) {
+    values.push_back(std::move(first[hole]));
+  }
+  std::sort(values.begin(), values.end(), comp);
+
+  // From here on, holes[t] counts the unchanged elements ahead of hole t.
+  // The unchanged element with rank j among them sits at view index j plus
+  // the number of holes ahead of it.
+  for (auto t = ptrdiff_t{0}; t < changed; ++t) {
+    holes[t] -= t;
+  }
+  const auto unchanged_at = [first, &holes](const ptrdiff_t rank) {
+    return first + (rank + count_at_most(holes, rank));
+  };
+
+  // Each changed element goes back in after the unchanged elements that
+  // don't order after it.  The values are sorted, so each search can start
+  // from the last one's result.
+  auto ranks = Indices(static_cast<std::size_t>(changed), alloc);
+  auto lo = ptrdiff_t{0};
+  for (auto t = ptrdiff_t{0}; t < changed; ++t) {
+    auto hi = unchanged;
+    while (lo < hi) {
+      const auto mid = lo + (hi - lo) / 2;
+      if (comp(values[t], *unchanged_at(mid))) {
+        hi = mid;
+      } else {
+        lo = mid + 1;
+      }
+    }
+    ranks[t] = lo;
+  }
+
+  // Between consecutive holes and insertion points, the unchanged elements
+  // form runs that each shift by a single distance: the number of changed
+  // elements that go back in ahead of the run, less the number of holes
+  // ahead of it.  Moving the runs that shift down in ascending order, and
+  // then the ones that shift up in descending order, never overwrites an
+  // element that has yet to move.
+  auto bounds = Indices(alloc);
+  bounds.reserve(2 * changed + 2);
+  bounds.push_back(0);
+  std::merge(holes.begin(), holes.end(), ranks.begin(), ranks.end(),
+             std::back_inserter(bounds));
+  bounds.push_back(unchanged);
+  bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+
+  const auto runs = static_cast<ptrdiff_t>(bounds.size()) - 1;
+  const auto shift = [&](const ptrdiff_t run) {
+    return count_at_most(ranks, bounds[run]) -
+           count_at_most(holes, bounds[run]);
+  };
+  const auto source = [&](const ptrdiff_t run, const ptrdiff_t rank) {
+    return first + (rank + count_at_most(holes, bounds[run]));
+  };
+  for (auto run = ptrdiff_t{0}; run < runs; ++run) {
+    const auto delta = shift(run);
+    if (delta < 0) {
+      std::move(source(run, bounds[run]), source(run, bounds[run + 1]),
+                source(run, bounds[run]) + delta);
+    }
+  }
+  for (auto run = runs - 1; run >= 0; --run) {
+    const auto delta = shift(run);
+    if (delta > 0) {
+      std::move_backward(source(run, bounds[run]),
+                         source(run, bounds[run + 1]),
+                         source(run, bounds[run + 1]) + delta);
+    }
+  }
+
+  for (auto t = ptrdiff_t{0}; t < changed; ++t) {
+    first[ranks[t] + t] = std::move(values[t]);
+  }
+}
+
+}  // namespace detail
+
+// Restores the sorted order of [first, last) after changes to the elements at
+// the base indices in [dirty_first, dirty_last).  The other elements must
+// still be in order.  For a ProjIter range, the indices are relative to the
+// range's base, as make_projection_iterator_at() takes them, and map to view
+// indices through the projection's inverse (see has_inverse_projection).  For
+// other ranges, they're just positions in the range.  Duplicate indices are
+// fine.
+//
+// Rather than sort all n elements again, this moves the k changed elements
+// out and sorts them, and binary searches the unchanged ones for where each
+// goes back in.  It then shifts each run of unchanged elements between those
+// points over by the number of elements that left or entered ahead of it,
+// and moves the changed elements into the gaps.  That's O(k log(n) log(k))
+// for the searches, plus one move for each element whose position changes.
+// Elements the changes don't pass over stay put, so for a few changes in a
+// large range, this is much cheaper than a full sort.
+template <typename RandomIt, typename IndexIt, typename Compare>
+void projected_resort(
+    RandomIt first, RandomIt last, IndexIt dirty_first, IndexIt dirty_last,
+    Compare comp) {
+  detail::projected_resort(first, last, dirty_first, dirty_last, comp,
+                           std::allocator<std::ptrdiff_t>{});
+}
+
+// As above, but sorts in ascending order with operator<.
+template <typename RandomIt, typename IndexIt>
+void projected_resort(
+    RandomIt first, RandomIt last, IndexIt dirty_first, IndexIt dirty_last) {
+  projected_resort(first, last, dirty_first, dirty_last, std::less<>{});
+}
+
+namespace detail {
+
+// Maps the values projected_radix_sort() accepts to unsigned keys that sort
+// in the same order: integers with their sign bit flipped, and IEEE floats
+// with their sign bit flipped if positive, and all bits flipped if negative.
+template <typename T, typename = void>
+struct radix_traits {
+  static constexpr bool kIsSortable = false;
+};
+
+template <typename T>
+struct radix_traits<
+    T, std::enable_if_t<std::is_integral<T>::value &&
+                        !std::is_same<T, bool>::value>> {
+  static constexpr bool kIsSortable = true;
+  using key_type = std::make_unsigned_t<T>;
+
+  static key_type key(const T value) noexcept {
+    constexpr auto kSignBit = std::is_signed<T>::value
+        ? key_type(key_type{1} << (std::numeric_limits<key_type>::digits - 1))
+        : key_type{0};
+    return key_type(static_cast<key_type>(value) ^ kSignBit);
+  }
+};
+
+template <typename T>
+struct radix_traits<
+    T, std::enable_if_t<std::is_floating_point<T>::value &&
+                        std::numeric_limits<T>::is_iec559 &&
+                        (sizeof(T) == 4 || sizeof(T) == 8)>> {
+  static constexpr bool kIsSortable = true;
+  using key_type =
+      std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>;
+
+  static key_type key(const T value) noexcept {
+    constexpr auto kSignBit =
+        key_type{1} << (std::numeric_limits<key_type>::digits - 1);
+    auto bits = key_type{};
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits & kSignBit ? ~bits : bits | kSignBit;
+  }
+};
+
+// The radix sorts take one pass per byte of the key.
+constexpr int kRadixBits = 8;
+constexpr std::size_t kRadixBuckets = std::size_t{1} << kRadixBits;
+
+template <typename Key>
+std::size_t radix_digit(const Key key, const int digit) noexcept {
+  return static_cast<std::size_t>(key >> (digit * kRadixBits)) &
+         (kRadixBuckets - 1);
+}
+
+}  // namespace detail
+
+// Sorts [first, last) in ascending order with an LSD radix sort, for integer
+// and IEEE float value types.  Like projected_sort(), this is intended for
+// ranges of projection iterators, and only walks the projected view twice:
+// once to gather it into contiguous scratch storage, counting every digit's
+// histogram along the way, and once to scatter the result back.  Each digit
+// is then a sequential pass from one half of the scratch storage to the
+// other, which skips digits every key shares.  That takes O(n) time in all,
+// with no comparisons.
+//
+// Floats sort by their bits, which matches operator< except that -0.0 comes
+// before 0.0, and NaNs sort below negative numbers or above positive ones by
+// their sign bit.
+//
+// The scratch vector is resized to twice the range.  Its contents are
+// unspecified afterwards, but its capacity is retained.
+template <typename RandomIt, typename Alloc>
+void projected_radix_sort(
+    RandomIt first, RandomIt last,
+    std::vector<typename std::iterator_traits<RandomIt>::value_type, Alloc>&
+        scratch) {
+  using T = typename std::iterator_traits<RandomIt>::value_type;
+  using Traits = detail::radix_traits<T>;
+  static_assert(Traits::kIsSortable,
+                "Radix sort requires integer or IEEE float values.");
+  using Key = typename Traits::key_type;
+  constexpr auto kDigits = static_cast<int>(sizeof(Key));
+
+  const auto size = static_cast<std::size_t>(std::distance(first, last));
+  if (size < 2) {
+    return;
+  }
+  scratch.resize(2 * size);
+  auto src = scratch.data();
+  auto dst = src + size;
+
+  auto counts = std::array<std::array<std::size_t, detail::kRadixBuckets>,
+                           kDigits>{};
+  auto out = src;
+  projected_for_each(first, last, [&out, &counts](const T& value) {
+    *out++ = value;
+    const auto key = Traits::key(value);
+    for (auto digit = 0; digit < kDigits; ++digit) {
+      ++counts[digit][detail::radix_digit(key, digit)];
+    }
+  });
+
+  for (auto digit = 0; digit < kDigits; ++digit) {
+    auto& count = counts[digit];
+    if (count[detail::radix_digit(Traits::key(*src), digit)] == size) {
+      continue;
+    }
+    auto offset = std::size_t{0};
+    for (auto& bucket : count) {
+      offset += std::exchange(bucket, offset);
+    }
+    for (auto elem = src; elem != src + size; ++elem) {
+      dst[count[detail::radix_digit(Traits::key(*elem), digit)]++] = *elem;
+    }
+    std::swap(src, dst);
+  }
+
+  detail::scatter(src, first, last);
+  scratch.clear();
+}
+
+// As above, but allocates its own scratch storage.
+template <typename RandomIt>
+void projected_radix_sort(RandomIt first, RandomIt last) {
+  auto scratch =
+      std::vector<typename std::iterator_traits<RandomIt>::value_type>{};
+  projected_radix_sort(first, last, scratch);
+}
+
+namespace detail {
+
+// Splits the first diag elements of the stable merge of [a, a + na) and
+// [b, b + nb) at the point where the merge path crosses that diagonal.
+// Returns the number of elements taken from a; the rest, diag minus that,
+// come from b.  This is a binary search along the diagonal, so it's
+// O(log(min(na, nb))).
+template <typename RandomIt1, typename RandomIt2, typename Compare>
+std::ptrdiff_t merge_path_split(
+    RandomIt1 a, std::ptrdiff_t na, RandomIt2 b, std::ptrdiff_t nb,
+    std::ptrdiff_t diag, Compare comp) {
+  auto lo = std::max(std::ptrdiff_t{0}, diag - nb);
+  auto hi = std::min(diag, na);
+  while (lo < hi) {
+    const auto mid = lo + (hi - lo) / 2;
+    if (comp(b[diag - mid - 1], a[mid])) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  return lo;
+}
+
+// Stable merge that moves the elements to the output, like std::merge over
+// std::move_iterator, except that comp always sees lvalues.
+template <typename InputIt1, typename InputIt2, typename OutputIt,
+          typename Compare>
+OutputIt move_merge(
+    InputIt1 first1, InputIt1 last1, InputIt2 first2, InputIt2 last2,
+    OutputIt out, Compare comp) {
+  while (first1 != last1 && first2 != last2) {
+    if (comp(*first2, *first1)) {
+      *out = std::move(*first2);
+      ++first2;
+    } else {
+      *out = std::move(*first1);
+      ++first1;
+    }
+    ++out;
+  }
+  out = std::move(first1, last1, out);
+  return std::move(first2, last2, out);
+}
+
+// Replaces the contents of scratch with copies of [first, last), in order.
+template <typename InputIt, typename T, typename Alloc>
+void gather_copy(
+    InputIt first, InputIt last, std::vector<T, Alloc>& scratch,
+    std::false_type) {
+  scratch.assign(first, last);
+}
+
+template <typename InputIt, typename T, typename Alloc>
+void gather_copy(
+    InputIt first, InputIt last, std::vector<T, Alloc>& scratch,
+    std::true_type) {
+  scratch.resize(std::distance(first, last));
+  projected_copy(first, last, scratch.data());
+}
+
+template <typename InputIt, typename T, typename Alloc>
+void gather_copy(InputIt first, InputIt last, std::vector<T, Alloc>& scratch) {
+  gather_copy(first, last, scratch, is_block_gatherable<InputIt, T>{});
+}
+
+// How many output elements projected_merge() merges from each pair of
+// gathers.
+constexpr std::ptrdiff_t kMergeBlockSize = 4096;
+
+// Writes output elements [diag_first, diag_last) of the stable merge of
+// [a, a + na) and [b, b + nb) to out, and returns the end of the output.
+// Each block of the output is split off along a merge path diagonal, and the
+// inputs it takes are gathered into scratch_a and scratch_b, so the merge
+// itself compares contiguous copies.
+template <typename RandomIt1, typename RandomIt2, typename OutputIt,
+          typename Compare, typename T, typename Alloc>
+OutputIt merge_slice(
+    RandomIt1 a, const std::ptrdiff_t na, RandomIt2 b, const std::ptrdiff_t nb,
+    const std::ptrdiff_t diag_first, const std::ptrdiff_t diag_last,
+    OutputIt out, Compare comp, std::vector<T, Alloc>& scratch_a,
+    std::vector<T, Alloc>& scratch_b) {
+  auto split = merge_path_split(a, na, b, nb, diag_first, comp);
+  for (auto diag = diag_first; diag < diag_last;) {
+    const auto next_diag = std::min(diag + kMergeBlockSize, diag_last);
+    const auto next_split = merge_path_split(a, na, b, nb, next_diag, comp);
+    gather_copy(a + split, a + next_split, scratch_a);
+    gather_copy(b + (diag - split), b + (next_diag - next_split), scratch_b);
+    out = move_merge(scratch_a.begin(), scratch_a.end(),
+                     scratch_b.begin(), scratch_b.end(), out, comp);
+    split = next_split;
+    diag = next_diag;
+  }
+  return out;
+}
+
+}  // namespace detail
+
+// Merges the sorted ranges [first1, last1) and [first2, last2) into out,
+// stably, as std::merge does.  This is intended for ranges of projection
+// iterators.  std::merge through a ProjIter evaluates the projection every
+// time it compares an element, and compares most elements more than once.
+// Instead, this cuts the output into blocks along merge path diagonals,
+// found by binary searches of the inputs, gathers each block's inputs into
+// contiguous scratch storage, and merges those copies.  Each input element
+// is thus read through its projection about once.
+//
+// The inputs must be random access.  out may be any output iterator, and
+// mustn't overlap the inputs.  Returns the end of the output.
+template <typename RandomIt1, typename RandomIt2, typename OutputIt,
+          typename Compare>
+OutputIt projected_merge(
+    RandomIt1 first1, RandomIt1 last1, RandomIt2 first2, RandomIt2 last2,
+    OutputIt out, Compare comp) {
+  using T = typename std::iterator_traits<RandomIt1>::value_type;
+  const auto na = static_cast<std::ptrdiff_t>(last1 - first1);
+  const auto nb = static_cast<std::ptrdiff_t>(last2 - first2);
+  auto scratch_a = std::vector<T>{};
+  auto scratch_b = std::vector<T>{};
+  return detail::merge_slice(first1, na, first2, nb, 0, na + nb, out, comp,
+                             scratch_a, scratch_b);
+}
+
+// As above, but merges in ascending order with operator<.
+template <typename RandomIt1, typename RandomIt2, typename OutputIt>
+OutputIt projected_merge(
+    RandomIt1 first1, RandomIt1 last1, RandomIt2 first2, RandomIt2 last2,
+    OutputIt out) {
+  return projected_merge(first1, last1, first2, last2, out, std::less<>{});
+}
+
+#ifdef JZ_PROJECTED_ALGORITHMS_HAS_EXECUTION
+
+namespace detail {
+
+// Returns how many threads to spread n elements over, leaving each thread at
+// least a minimum amount of work.
+inline unsigned parallel_task_count(const std::ptrdiff_t n) {
+  constexpr auto kMinElementsPerTask = std::ptrdiff_t{1} << 14;
+  const auto hardware = std::max(1u, std::thread::hardware_concurrency());
+  const auto useful = std::max(std::ptrdiff_t{1}, n / kMinElementsPerTask);
+  return static_cast<unsigned>(std::min<std::ptrdiff_t>(hardware, useful));
+}
+
+// Runs task(0), ..., task(count - 1) concurrently, with task 0 on the calling
+// thread.  If the system won't start another thread, the calling thread runs
+// the tasks that didn't get one too, as the tasks don't wait on each other.
+// As with the standard parallel algorithms, an exception escaping a task
+// calls std::terminate().
+template <typename Task>
+void run_parallel_tasks(const unsigned count, const Task& task) {
+  auto threads = std::vector<std::thread>{};
+  threads.reserve(count > 0 ? count - 1 : 0);
+  auto started = 1u;
+  try {
+    for (; started < count; ++started) {
+      const auto i = started;
+      threads.emplace_back([&task, i]() noexcept { task(i); });
+    }
+  } catch (const std::system_error&) {
+    // Fall through, and run the rest here.
+  }
+  const auto run_here = [&task](const unsigned i) noexcept { task(i); };
+  if (count > 0) {
+    run_here(0);
+  }
+  for (auto i = started; i < count; ++i) {
+    run_here(i);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+// Merges adjacent pairs of the sorted runs in src, delimited by bounds, into
+// the same positions in dst, and returns the bounds of the merged runs.  Each
+// pair's output is cut into pieces along merge path diagonals, in proportion
+// to its share of the total, so the tasks get roughly equal amounts of work no
+// matter how few pairs remain.  A leftover odd run is moved across unchanged.
+template <typename SrcIt, typename DstIt, typename Compare>
+std::vector<std::ptrdiff_t> parallel_merge_round(
+    SrcIt src, DstIt dst, const std::vector<std::ptrdiff_t>& bounds,
+    Compare comp, const unsigned tasks) {
+  struct Piece {
+    std::ptrdiff_t a_first, a_last, b_first, b_last, out;
+  };
+
+  const auto n = std::max(bounds.back(), std::ptrdiff_t{1});
+  auto pieces = std::vector<Piece>{};
+  auto merged_bounds = std::vector<std::ptrdiff_t>{0};
+  for (auto run = std::size_t{0}; run + 1 < bounds.size(); run += 2) {
+    const auto a_first = bounds[run];
+    const auto b_first = bounds[run + 1];
+    const auto b_last  = run + 2 < bounds.size() ? bounds[run + 2] : b_first;
+    const auto na = b_first - a_first;
+    const auto nb = b_last - b_first;
+    const auto share = std::max<std::ptrdiff_t>(1, tasks * (na + nb) / n);
+
+    auto prev_split = std::ptrdiff_t{0};
+    auto prev_diag  = std::ptrdiff_t{0};
+    for (auto piece = std::ptrdiff_t{1}; piece <= share; ++piece) {
+      const auto diag = (na + nb) * piece / share;
+      const auto split =
+          merge_path_split(src + a_first, na, src + b_first, nb, diag, comp);
+      pieces.push_back(Piece{
+          a_first + prev_split, a_first + split,
+          b_first + prev_diag - prev_split, b_first + diag - split,
+          a_first + prev_diag});
+      prev_split = split;
+      prev_diag  = diag;
+    }
+    merged_bounds.push_back(b_last);
+  }
+
+  const auto piece_count = pieces.size();
+  run_parallel_tasks(tasks, [&](const unsigned task) {
+    const auto lo = piece_count * task / tasks;
+    const auto hi = piece_count * (task + 1) / tasks;
+    for (auto i = lo; i < hi; ++i) {
+      const auto& piece = pieces[i];
+      move_merge(src + piece.a_first, src + piece.a_last,
+                 src + piece.b_first, src + piece.b_last,
+                 dst + piece.out, comp);
+    }
+  });
+  return merged_bounds;
+}
+
+// Sorts [first, last) across the given number of tasks.  Each task gathers a
+// contiguous chunk of the projected view into a scratch buffer and sorts it
+// there.  Rounds of merges then combine the sorted chunks, ping-ponging
+// between two scratch buffers, and the final round writes straight back
+// through [first, last).  Every round is split evenly across all of the tasks
+// by merge path partitioning.
+template <bool IsStable, typename RandomIt, typename Compare>
+void parallel_projected_sort(
+    RandomIt first, RandomIt last, Compare comp, const unsigned tasks) {
+  using T = typename std::iterator_traits<RandomIt>::value_type;
+  const auto n = static_cast<std::ptrdiff_t>(last - first);
+  if (tasks <= 1) {
+    if constexpr (IsStable) {
+      projected_stable_sort(first, last, comp);
+    } else {
+      projected_sort(first, last, comp);
+    }
+    return;
+  }
+
+  auto buffer = std::vector<T>(n);
+  auto spare  = std::vector<T>(n);
+  auto bounds = std::vector<std::ptrdiff_t>(tasks + 1);
+  for (auto i = 0u; i <= tasks; ++i) {
+    bounds[i] = n * i / tasks;
+  }
+
+  run_parallel_tasks(tasks, [&](const unsigned task) {
+    const auto chunk_first = buffer.begin() + bounds[task];
+    const auto chunk_last  = buffer.begin() + bounds[task + 1];
+    move_out(first + bounds[task], first + bounds[task + 1], chunk_first);
+    if constexpr (IsStable) {
+      std::stable_sort(chunk_first, chunk_last, comp);
+    } else {
+      std::sort(chunk_first, chunk_last, comp);
+    }
+  });
+
+  auto* src = &buffer;
+  auto* dst = &spare;
+  while (bounds.size() > 3) {
+    bounds = parallel_merge_round(src->begin(), dst->begin(), bounds, comp,
+                                  tasks);
+    std::swap(src, dst);
+  }
+  parallel_merge_round(src->begin(), first, bounds, comp, tasks);
+}
+
+template <typename ExecutionPolicy>
+using enable_if_execution_policy_t = std::enable_if_t<
+    std::is_execution_policy_v<std::decay_t<ExecutionPolicy>>>;
+
+// Only the parallel policies fan out across threads.  The others run the
+// serial algorithm.
+template <typename ExecutionPolicy>
+constexpr bool is_parallel_policy_v =
+    std::is_same_v<std::decay_t<ExecutionPolicy>,
+                   std::execution::parallel_policy> ||
+    std::is_same_v<std::decay_t<ExecutionPolicy>,
+                   std::execution::parallel_unsequenced_policy>;
+
+template <bool IsStable, typename ExecutionPolicy, typename RandomIt,
+          typename Compare>
+void projected_sort_with_policy(RandomIt first, RandomIt last, Compare comp) {
+  const auto tasks = is_parallel_policy_v<ExecutionPolicy>
+      ? parallel_task_count(last - first) : 1u;
+  parallel_projected_sort<IsStable>(first, last, comp, tasks);
+}
+
+}  // namespace detail
+
+// Parallel counterparts of projected_sort() and projected_stable_sort().
+// With std::execution::par or par_unseq, the projected index space is split
+// into one chunk per thread.  Each thread gathers its chunk contiguously and
+// sorts it locally, and the chunks are then combined by merge path
+// partitioned parallel merges, the last of which writes back through the
+// projection.  This needs room for two copies of the range, and the value
+// type must be default constructible.  Other policies run serially.
+template <typename ExecutionPolicy, typename RandomIt, typename Compare,
+          typename = detail::enable_if_execution_policy_t<ExecutionPolicy>>
+void projected_sort(
+    ExecutionPolicy&&, RandomIt first, RandomIt last, Compare comp) {
+  detail::projected_sort_with_policy<false, ExecutionPolicy>(
+      first, last, comp);
+}
+
+template <typename ExecutionPolicy, typename RandomIt,
+          typename = detail::enable_if_execution_policy_t<ExecutionPolicy>>
+void projected_sort(ExecutionPolicy&& policy, RandomIt first, RandomIt last) {
+  projected_sort(std::forward<ExecutionPolicy>(policy), first, last,
+                 std::less<>{});
+}
+
+template <typename ExecutionPolicy, typename RandomIt, typename Compare,
+          typename = detail::enable_if_execution_policy_t<ExecutionPolicy>>
+void projected_stable_sort(
+    ExecutionPolicy&&, RandomIt first, RandomIt last, Compare comp) {
+  detail::projected_sort_with_policy<true, ExecutionPolicy>(
+      first, last, comp);
+}
+
+template <typename ExecutionPolicy, typename RandomIt,
+          typename = detail::enable_if_execution_policy_t<ExecutionPolicy>>
+void projected_stable_sort(
+    ExecutionPolicy&& policy, RandomIt first, RandomIt last) {
+  projected_stable_sort(std::forward<ExecutionPolicy>(policy), first, last,
+                        std::less<>{});
+}
+
+// Parallel counterparts of projected_merge().  With std::execution::par or
+// par_unseq, the output is split along merge path diagonals into one equal
+// share per thread, and each thread merges its share as projected_merge()
+// does.  out must be random access.  Other policies run serially.
+template <typename ExecutionPolicy, typename RandomIt1, typename RandomIt2,
+          typename RandomIt3, typename Compare,
+          typename = detail::enable_if_execution_policy_t<ExecutionPolicy>>
+RandomIt3 projected_merge(
+    ExecutionPolicy&&, RandomIt1 first1, RandomIt1 last1, RandomIt2 first2,
+    RandomIt2 last2, RandomIt3 out, Compare comp) {
+  using T = typename std::iterator_traits<RandomIt1>::value_type;
+  const auto na = static_cast<std::ptrdiff_t>(last1 - first1);
+  const auto nb = static_cast<std::ptrdiff_t>(last2 - first2);
+  const auto n = na + nb;
+  const auto tasks = detail::is_parallel_policy_v<ExecutionPolicy>
+      ? detail::parallel_task_count(n) : 1u;
+  detail::run_parallel_tasks(tasks, [&](const unsigned task) {
+    const auto diag_first = n * task / tasks;
+    auto scratch_a = std::vector<T>{};
+    auto scratch_b = std::vector<T>{};
+    detail::merge_slice(first1, na, first2, nb, diag_first,
+                        n * (task + 1) / tasks, out + diag_first, comp,
+                        scratch_a, scratch_b);
+  });
+  return out + n;
+}
+
+template <typename ExecutionPolicy, typename RandomIt1, typename RandomIt2,
+          typename RandomIt3,
+          typename = detail::enable_if_execution_policy_t<ExecutionPolicy>>
+RandomIt3 projected_merge(
+    ExecutionPolicy&& policy, RandomIt1 first1, RandomIt1 last1,
+    RandomIt2 first2, RandomIt2 last2, RandomIt3 out) {
+  return projected_merge(std::forward<ExecutionPolicy>(policy), first1, last1,
+                         first2, last2, out, std::less<>{});
+}
+
+#endif  // JZ_PROJECTED_ALGORITHMS_HAS_EXECUTION
+
+}  // namespace jz
+
+#endif // PROJECTED_ALGORITHMS_HH_
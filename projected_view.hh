@@ -0,0 +1,235 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+#ifndef PROJECTED_VIEW_HH_
+#define PROJECTED_VIEW_HH_
+
+static_assert(__cplusplus >= 201402L, "Requires C++14 or newer.");
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#if __cplusplus >= 202002L
+#  include <ranges>
+#endif
+
+#include "projection_iterator.hh"
+
+namespace jz {
+
+// Implements a range that views an indexed container through a projection,
+// in the same manner as ProjIter.  The view refers to the container rather
+// than owning it, but it owns the projection, and begin() and end() already
+// know the container's size:
+//
+//     auto view = make_projected_view(v, make_folded_interleave_projection(
+//                                            v.size()));
+//     std::sort(view.begin(), view.end());
+//
+// Unlike a ProjIter pair, which carries a copy of the projection in each
+// iterator, the view's iterators hold just a pointer to the view and an
+// index.  That keeps them small for projections that carry a lot of state,
+// such as lookup tables.  (To share one projection among several views, wrap
+// it with proj_ref().)  It also means the iterators refer back to the view
+// itself, so the view must outlive them and must not be moved while they are
+// in use.
+//
+// As of C++20, this is a std::ranges::view_interface, so works with the
+// range algorithms, e.g. std::ranges::sort(view).
+template <typename Range, typename Proj>
+class ProjectedView
+#if __cplusplus >= 202002L
+    : public std::ranges::view_interface<ProjectedView<Range, Proj>>
+#endif
+{
+  using BaseIter   = decltype(std::begin(std::declval<Range&>()));
+  using Base       = detail::proj_base_t<BaseIter>;
+  using IterTraits = std::iterator_traits<BaseIter>;
+
+  static_assert(
+    std::is_base_of<
+      std::random_access_iterator_tag,
+      typename IterTraits::iterator_category>::value,
+      "Must view a random access range.");
+
+  static_assert(
+    std::is_integral<decltype(std::declval<const Proj&>()(std::ptrdiff_t{}))>
+        ::value,
+    "Projection callable must return an integral type.");
+
+ public:
+  class iterator;
+
+  using value_type      = typename IterTraits::value_type;
+  using reference       = typename IterTraits::reference;
+  using difference_type = std::ptrdiff_t;
+  using size_type       = std::size_t;
+
+  constexpr ProjectedView(Range& range, Proj projection)
+  : storage_{Base{std::begin(range)}, std::move(projection)},
+    size_{std::distance(std::begin(range), std::end(range))} {}
+
+  constexpr iterator begin() const noexcept { return iterator{this, 0}; }
+  constexpr iterator end() const noexcept { return iterator{this, size_}; }
+
+  constexpr size_type size() const noexcept {
+    return static_cast<size_type>(size_);
+  }
+
+  constexpr bool empty() const noexcept { return size_ == 0; }
+
+  // Returns the element at index in the projected view.
+  constexpr reference operator[](const difference_type index) const {
+    return detail::note_dereference<reference>(*projected_(index));
+  }
+
+  // Returns the projection.
+  constexpr const Proj& projection() const noexcept {
+    return storage_.projection();
+  }
+
+ private:
+  detail::ProjStorage<Base, Proj> storage_;
+  difference_type size_;
+
+  constexpr typename Base::type projected_(const difference_type index) const {
+    return storage_.base().at(
+        detail::note_projection_call(storage_.projection()(index)));
+  }
+};
+
+// The random access iterator for ProjectedView.
+template <typename Range, typename Proj>
+class ProjectedView<Range, Proj>::iterator {
+ public:
+  using iterator_category = std::random_access_iterator_tag;
+#if __cplusplus >= 202002L
+  using iterator_concept  = std::random_access_iterator_tag;
+#endif
+  using difference_type   = std::ptrdiff_t;
+  using value_type        = typename IterTraits::value_type;
+  using pointer           = typename IterTraits::pointer;
+  using reference         = typename IterTraits::reference;
+
+  // Constructs a singular iterator, which may only be assigned to.
+  constexpr iterator() noexcept = default;
+
+  constexpr reference operator*() const { return (*view_)[index_]; }
+
+  constexpr pointer operator->() const { return std::addressof(**this); }
+
+  constexpr reference operator[](const difference_type delta) const {
+    return (*view_)[index_ + delta];
+  }
+
+  constexpr iterator& operator++() noexcept {
+    ++index_;
+    return *this;
+  }
+
+  constexpr iterator operator++(int) noexcept {
+    auto copy = *this;
+    ++index_;
+    return copy;
+  }
+
+  constexpr iterator& operator--() noexcept {
+    --index_;
+    return *this;
+  }
+
+  constexpr iterator operator--(int) noexcept {
+    auto copy = *this;
+    --index_;
+    return copy;
+  }
+
+  constexpr iterator& operator+=(const difference_type delta) noexcept {
+    index_ += delta;
+    return *this;
+  }
+
+  constexpr iterator& operator-=(const difference_type delta) noexcept {
+    index_ -= delta;
+    return *this;
+  }
+
+  friend constexpr iterator operator+(
+      iterator it, const difference_type delta) noexcept {
+    return it += delta;
+  }
+
+  friend constexpr iterator operator+(
+      const difference_type delta, iterator it) noexcept {
+    return it += delta;
+  }
+
+  friend constexpr iterator operator-(
+      iterator it, const difference_type delta) noexcept {
+    return it -= delta;
+  }
+
+  friend constexpr difference_type operator-(
+      const iterator& lhs, const iterator& rhs) noexcept {
+    return lhs.index_ - rhs.index_;
+  }
+
+  // As with ProjIter, these don't check whether both iterators refer to the
+  // same view.
+  friend constexpr bool operator==(
+      const iterator& lhs, const iterator& rhs) noexcept {
+    return lhs.index_ == rhs.index_;
+  }
+
+  friend constexpr bool operator!=(
+      const iterator& lhs, const iterator& rhs) noexcept {
+    return !(lhs == rhs);
+  }
+
+  friend constexpr bool operator<(
+      const iterator& lhs, const iterator& rhs) noexcept {
+    return lhs.index_ < rhs.index_;
+  }
+
+  friend constexpr bool operator>(
+      const iterator& lhs, const iterator& rhs) noexcept {
+    return rhs < lhs;
+  }
+
+  friend constexpr bool operator<=(
+      const iterator& lhs, const iterator& rhs) noexcept {
+    return !(rhs < lhs);
+  }
+
+  friend constexpr bool operator>=(
+      const iterator& lhs, const iterator& rhs) noexcept {
+    return !(lhs < rhs);
+  }
+
+  // Returns our index within the view.
+  constexpr difference_type index() const noexcept { return index_; }
+
+ private:
+  friend class ProjectedView;
+
+  constexpr iterator(
+      const ProjectedView* const view, const difference_type index) noexcept
+  : view_{view}, index_{index} {}
+
+  const ProjectedView* view_ = nullptr;
+  difference_type index_ = 0;
+};
+
+// Provides template argument deduction for ProjectedView for C++14.  C++17
+// onward can deduce the template parameters from the constructor.
+template <typename Range, typename Proj>
+constexpr inline ProjectedView<Range, Proj> make_projected_view(
+    Range& range, Proj projection) {
+  return ProjectedView<Range, Proj>(range, std::move(projection));
+}
+
+}  // namespace jz
+
+#endif // PROJECTED_VIEW_HH_
@@ -15,14 +15,377 @@ static_assert(__cplusplus, "Requires C++11 or newer.");
 
 #include <cstddef>
 #include <iterator>
+#include <memory>
 #include <type_traits>
+#include <utility>
+
+#ifdef JZ_PROJECTION_STATS
+#  include "projection_stats.hh"
+#endif
 
 namespace jz {
 
+// Describes a run of view indices, [first, last), over which a projection is
+// affine.  That is, for each index in the run, projection(index) equals
+// offset + stride * index.
+struct AffineSegment {
+  std::ptrdiff_t first;
+  std::ptrdiff_t last;
+  std::ptrdiff_t offset;
+  std::ptrdiff_t stride;
+};
+
+namespace detail {
+
+#ifndef JZ_PROJECTION_STATS
+// The access counting hooks, which projection_stats.hh defines when
+// JZ_PROJECTION_STATS is defined.  Otherwise, each just passes its argument
+// through.
+template <typename Ref>
+constexpr Ref note_dereference(Ref elem) noexcept {
+  return static_cast<Ref>(elem);
+}
+
+template <typename T>
+constexpr T note_projection_call(T value) noexcept {
+  return value;
+}
+
+constexpr inline std::ptrdiff_t note_advance(
+    const std::ptrdiff_t distance) noexcept {
+  return distance;
+}
+#endif
+
+template <typename Callable, typename = void>
+struct has_affine_segments_impl : std::false_type {};
+
+template <typename Callable>
+struct has_affine_segments_impl<
+    Callable,
+    decltype(void(std::declval<const Callable&>().segment(std::ptrdiff_t{})))>
+    : std::is_same<
+          decltype(std::declval<const Callable&>().segment(std::ptrdiff_t{})),
+          AffineSegment> {};
+
+}  // namespace detail
+
+// Indicates whether a projection is piecewise affine, and exposes its pieces.
+// Such a projection provides a member function:
+//
+//     AffineSegment segment(ptrdiff_t index) const;
+//
+// that returns the segment containing index.  Algorithms that walk a
+// projected view in order, such as projected_for_each(), use this to step
+// through each segment by its stride, only calling back into the projection
+// once per segment.
+//
+// ProjIter itself doesn't cache segments.  Checking the cache on every
+// dereference costs as much as cheap projections do, and random access
+// patterns such as std::sort's defeat it; caching in the iterator made
+// std::sort through a folded interleave view roughly twice as slow.
+template <typename Callable>
+struct has_affine_segments : detail::has_affine_segments_impl<Callable> {};
+
+namespace detail {
+
+template <typename Callable, typename = void>
+struct has_inverse_projection_impl : std::false_type {};
+
+template <typename Callable>
+struct has_inverse_projection_impl<
+    Callable,
+    decltype(void(std::declval<const Callable&>().inverse(std::ptrdiff_t{})))>
+    : std::is_integral<
+          decltype(std::declval<const Callable&>().inverse(std::ptrdiff_t{}))>
+      {};
+
+}  // namespace detail
+
+// Indicates whether a projection is one-to-one, and exposes its inverse.
+// Such a projection provides a member function:
+//
+//     ptrdiff_t inverse(ptrdiff_t base_index) const;
+//
+// that returns the view index that projects to base_index.  It's only
+// defined for base indices the projection reaches.  This lets code that
+// knows an element's position in the base, e.g. from a lookup on the base
+// container, find its position in the view without searching for it.  See
+// make_projection_iterator_at() below.
+template <typename Callable>
+struct has_inverse_projection
+    : detail::has_inverse_projection_impl<Callable> {};
+
+namespace detail {
+
+// Stands in for the callback in detecting walk().
+struct WalkProbe {
+  void operator()(std::ptrdiff_t) const noexcept {}
+};
+
+template <typename Callable, typename = void>
+struct has_projection_walk_impl : std::false_type {};
+
+template <typename Callable>
+struct has_projection_walk_impl<
+    Callable,
+    decltype(void(std::declval<const Callable&>().walk(
+        std::ptrdiff_t{}, std::ptrdiff_t{}, std::declval<WalkProbe&>())))>
+    : std::true_type {};
+
+}  // namespace detail
+
+// Indicates whether a projection can walk a run of view indices itself.  Such
+// a projection provides a member function template:
+//
+//     template <typename Fn>
+//     void walk(ptrdiff_t first, ptrdiff_t last, Fn& fn) const;
+//
+// that calls fn(projection(index)) for each index in [first, last), in
+// order.  This suits projections, such as space-filling curves, that have no
+// affine runs worth describing, but can step from one index's projection to
+// the next far more cheaply than they can compute one from scratch.
+// projected_for_each() and projected_copy() use it when a projection has no
+// segment().
+template <typename Callable>
+struct has_projection_walk : detail::has_projection_walk_impl<Callable> {};
+
+namespace detail {
+
+// Indicates whether an iterator is a standard library's thin wrapper around a
+// pointer, as std::vector's and std::string's iterators are.  Before C++20
+// there's no standard way to ask, so this recognizes libstdc++'s
+// __normal_iterator, whose base() returns the pointer.  Other libraries'
+// wrappers only count as contiguous from C++20 on.
+template <typename Iter>
+struct is_wrapped_pointer : std::false_type {};
+
+#if defined(__GLIBCXX__)
+template <typename T, typename Container>
+struct is_wrapped_pointer<__gnu_cxx::__normal_iterator<T*, Container>>
+    : std::true_type {};
+#endif
+
+}  // namespace detail
+
+// Indicates whether a base iterator is known to refer to contiguous storage.
+// ProjIter holds such bases as raw pointers.  This covers plain pointers,
+// libstdc++'s std::vector and std::string iterators, and as of C++20,
+// anything that models std::contiguous_iterator.
+template <typename Iter>
+struct is_contiguous_base
+    : std::integral_constant<
+          bool,
+          std::is_pointer<Iter>::value ||
+              detail::is_wrapped_pointer<Iter>::value
+#if __cplusplus >= 202002L
+          || std::contiguous_iterator<Iter>
+#endif
+      > {};
+
+// Describes how a segmented base iterator, such as a std::deque iterator,
+// splits a position into a segment and an offset within it.  ProjIter uses
+// this to go straight from a projected index to the element: one division by
+// a constant to find the segment, and one load from the segment map, rather
+// than advancing a copy of the base iterator.
+//
+// Segmented iterators specialize this with:
+//
+//     static constexpr bool is_segmented = true;
+//
+//     // The element pointer type, and a random access iterator over the
+//     // pointers to the start of each segment.
+//     using pointer     = ...;
+//     using segment_map = ...;
+//
+//     // The number of elements in every segment.
+//     static constexpr std::ptrdiff_t segment_size = ...;
+//
+//     // Return the segment map entry for it's segment, and its offset from
+//     // the start of that segment.  compose() is the inverse.
+//     static segment_map segment(const Iter& it);
+//     static std::ptrdiff_t local(const Iter& it);
+//     static Iter compose(segment_map segment, std::ptrdiff_t local);
+//
+// deque_segments.hh provides the specialization for libstdc++'s std::deque.
+// A specialization must be visible everywhere ProjIter is used with that
+// iterator, or translation units will disagree on how ProjIter holds it.
+template <typename Iter, typename = void>
+struct segmented_iterator_traits {
+  static constexpr bool is_segmented = false;
+};
+
+namespace detail {
+
+// Returns the address of the element a contiguous base iterator refers to,
+// without dereferencing it.
+template <typename T>
+constexpr T* to_address(T* const ptr) noexcept {
+  return ptr;
+}
+
+#if __cplusplus >= 202002L
+template <typename Iter>
+constexpr auto to_address(const Iter& iter) noexcept
+    -> decltype(std::to_address(iter)) {
+  return std::to_address(iter);
+}
+#elif defined(__GLIBCXX__)
+template <typename T, typename Container>
+constexpr T* to_address(
+    const __gnu_cxx::__normal_iterator<T*, Container>& iter) noexcept {
+  return iter.base();
+}
+#endif
+
+// Holds the base for ProjIter, and offsets it to the projected index.  This
+// general case keeps the base iterator and steps a copy of it on each access.
+// std::advance makes that a simple addition for random access bases, and a
+// walk from the base for forward and bidirectional ones.
+template <typename Iter, bool IsContiguous>
+class ProjBase {
+ public:
+  using type      = Iter;
+  using base_type = Iter;
+
+  explicit constexpr ProjBase(Iter base) noexcept : base_{std::move(base)} {}
+
+  CONSTEXPR_AS_OF_CXX14 Iter at(const std::ptrdiff_t offset) const {
+    Iter copy = base_;
+    std::advance(copy, detail::note_advance(offset));
+    return copy;
+  }
+
+  constexpr const Iter& get() const noexcept { return base_; }
+
+ private:
+  Iter base_;
+};
+
+// For contiguous bases, holds a raw pointer to the base element instead, so
+// each access is a single pointer addition.  This sidesteps the cost of
+// copying and advancing debug or checked iterators, and gives the optimizer
+// plain pointer arithmetic to work with.
+template <typename Iter>
+class ProjBase<Iter, true> {
+ public:
+  using type      = decltype(detail::to_address(std::declval<const Iter&>()));
+  using base_type = type;
+
+  explicit constexpr ProjBase(const Iter& base) noexcept
+  : base_{detail::to_address(base)} {}
+
+  constexpr type at(const std::ptrdiff_t offset) const noexcept {
+    return base_ + offset;
+  }
+
+  constexpr type get() const noexcept { return base_; }
+
+ private:
+  type base_;
+};
+
+// For segmented bases (see segmented_iterator_traits), holds the base's
+// segment map entry and offset, and finds each projected element from those.
+// Accesses return element pointers, but get() rebuilds the base iterator.
+template <typename Iter>
+class SegmentedProjBase {
+  using Traits = segmented_iterator_traits<Iter>;
+  using SegmentMap = typename Traits::segment_map;
+
+ public:
+  using type      = typename Traits::pointer;
+  using base_type = Iter;
+
+  explicit constexpr SegmentedProjBase(const Iter& base) noexcept
+  : segment_{Traits::segment(base)}, local_{Traits::local(base)} {}
+
+  // Floors the division, since projections may reach back before the base.
+  CONSTEXPR_AS_OF_CXX14 type at(const std::ptrdiff_t offset) const noexcept {
+    constexpr auto kSegmentSize = Traits::segment_size;
+    const auto index = local_ + offset;
+    const auto segment =
+        (index < 0 ? index - (kSegmentSize - 1) : index) / kSegmentSize;
+    return *(segment_ + segment) + (index - segment * kSegmentSize);
+  }
+
+  Iter get() const noexcept { return Traits::compose(segment_, local_); }
+
+ private:
+  SegmentMap segment_;
+  std::ptrdiff_t local_;
+};
+
+// Selects how ProjIter and ProjectedView hold a base.
+template <typename Iter>
+using proj_base_t = typename std::conditional<
+    is_contiguous_base<Iter>::value,
+    ProjBase<Iter, true>,
+    typename std::conditional<
+        segmented_iterator_traits<Iter>::is_segmented,
+        SegmentedProjBase<Iter>,
+        ProjBase<Iter, false>>::type>::type;
+
+// Indicates whether we can store a projection as an empty base class.  This
+// requires std::is_final to rule out final classes, so isn't done for C++11.
+template <typename Callable>
+struct is_empty_base_candidate
+    : std::integral_constant<
+          bool,
+#if __cplusplus >= 201402L
+          std::is_empty<Callable>::value && !std::is_final<Callable>::value
+#else
+          false
+#endif
+      > {};
+
+// Holds a base together with its projection.  When the projection is a
+// stateless class, such as a captureless lambda, we inherit from it rather
+// than holding it as a member, so it takes no space.  Otherwise it takes up a
+// member's worth of space, plus padding, in every copy of the iterator, and
+// std::sort copies iterators constantly.
+template <typename Base, typename Callable,
+          bool IsEmpty = is_empty_base_candidate<Callable>::value>
+class ProjStorage {
+ public:
+  constexpr ProjStorage(Base base, Callable projection) noexcept
+  : base_{std::move(base)}, projection_{std::move(projection)} {}
+
+  CONSTEXPR_AS_OF_CXX14 Base& base() noexcept { return base_; }
+  constexpr const Base& base() const noexcept { return base_; }
+
+  constexpr const Callable& projection() const noexcept { return projection_; }
+
+ private:
+  Base base_;
+  // C++20 can also overlap final empty classes, which we can't inherit from.
+#if __cplusplus >= 202002L
+  [[no_unique_address]]
+#endif
+  Callable projection_;
+};
+
+template <typename Base, typename Callable>
+class ProjStorage<Base, Callable, true> : private Callable {
+ public:
+  constexpr ProjStorage(Base base, Callable projection) noexcept
+  : Callable(std::move(projection)), base_{std::move(base)} {}
+
+  CONSTEXPR_AS_OF_CXX14 Base& base() noexcept { return base_; }
+  constexpr const Base& base() const noexcept { return base_; }
+
+  constexpr const Callable& projection() const noexcept { return *this; }
+
+ private:
+  Base base_;
+};
+
+}  // namespace detail
+
 // Implements an iterator that applies permutes the view of an indexed container
-// by applying a projection to the index.  The base iterator currently must be a
-// random access iterator.  The returned iterator is also a random access
-// iterator.
+// by applying a projection to the index.  The base iterator must be at least a
+// forward iterator.  The returned iterator is always a random access iterator,
+// since it only does arithmetic on its index.
 //
 // The projection() callable must accept an index of type ptrdiff_t relative to
 // base, and return the projected index as an integral type.  It's up to the
@@ -33,19 +396,30 @@ namespace jz {
 // and Callable.  That's useful for pre-C++17 environments.  C++17 onward deduce
 // template arguments from the constructor directly.
 //
-// Eventually, this may support other iterator categories such as bidirectional 
-// and forward iterators; howeever, they will not meet the usual iterator
-// performance guarantees for their category unless this iterator carries
-// additional secondary storage.
+// If the base iterator is contiguous (see is_contiguous_base above), the
+// iterator holds it as a raw pointer, and each access computes base +
+// projection(index) directly.
+//
+// Stateless projections, such as captureless lambdas and the compile-time
+// sized projections in projections.hh, take up no space in the iterator.  To
+// share a projection with a lot of state among iterators rather than copying
+// it into each, wrap it with proj_ref() below.
+//
+// Forward and bidirectional bases, such as std::list iterators, work, but
+// each access walks from the base to the projected index, so it takes time
+// proportional to that index rather than constant time.  For more than a few
+// accesses, view such containers through the checkpointed base iterators in
+// base_checkpoints.hh instead, which bound the walk.
 template <typename Iter, typename Callable>
 class ProjIter {
   using ptrdiff_t = std::ptrdiff_t;
+  using Base      = detail::proj_base_t<Iter>;
 
   static_assert(
     std::is_base_of<
-      std::random_access_iterator_tag,
+      std::forward_iterator_tag,
       typename std::iterator_traits<Iter>::iterator_category>::value,
-      "Must use a random access iterator.");
+      "Must use a forward iterator.");
 
 #if __cplusplus >= 201703L
   static_assert(
@@ -67,7 +441,7 @@ class ProjIter {
   using reference         = typename IterTraits::reference;
 
   explicit constexpr ProjIter(Iter base, Callable projection) noexcept
-  : base_{std::move(base)}, projection_{std::move(projection)}, index_{0} {}
+  : storage_{Base{std::move(base)}, std::move(projection)}, index_{0} {}
 
   ProjIter(const ProjIter&) = default;
   ProjIter(ProjIter&&) = default;
@@ -76,24 +450,30 @@ class ProjIter {
   // For copy and move assignment, assume base and projection are the
   // same for both.  It's undefined behavior if it's not.
   ProjIter& operator=(const ProjIter& rhs) noexcept {
-    base_  = rhs.base_;
+    storage_.base() = rhs.storage_.base();
     index_ = rhs.index_;
     return *this;
   }
   ProjIter& operator=(ProjIter&& rhs) noexcept {
-    base_  = rhs.base_;
+    storage_.base() = rhs.storage_.base();
     index_ = rhs.index_;
     return *this;
   } 
 
   // Dereference returns an lvalue reference to the element.
   CONSTEXPR_AS_OF_CXX14 reference operator*() const noexcept {
-    return *projected_();
+    return detail::note_dereference<reference>(*projected_());
+  }
+
+  // Returns a pointer to the element.
+  CONSTEXPR_AS_OF_CXX14 pointer operator->() const noexcept {
+    return std::addressof(**this);
   }
 
-  // Returns the original iterator offset to the correct point.
-  CONSTEXPR_AS_OF_CXX14 value_type operator->() const noexcept {
-    return projected_();
+  // Returns the element delta positions past us.
+  CONSTEXPR_AS_OF_CXX14 reference operator[](const ptrdiff_t delta)
+      const noexcept {
+    return *(*this + delta);
   }
 
   // Increments our index relative to first.
@@ -135,7 +515,7 @@ class ProjIter {
 
   // Subtracts from our iterator.
   CONSTEXPR_AS_OF_CXX14 ProjIter& operator-=(const ptrdiff_t delta) noexcept {
-    index_ += delta;
+    index_ -= delta;
     return *this;
   }
 
@@ -146,6 +526,11 @@ class ProjIter {
     return copy;
   }
 
+  friend CONSTEXPR_AS_OF_CXX14 ProjIter operator+(
+      const ptrdiff_t delta, const ProjIter& it) noexcept {
+    return it + delta;
+  }
+
   // Returns difference between two iterators.
   constexpr difference_type operator-(const ProjIter& rhs) const noexcept {
     return index_ - rhs.index_;
@@ -178,18 +563,29 @@ class ProjIter {
     return !(*this == rhs);
   }
 
+  // Returns the base iterator, or for contiguous bases, a pointer to the
+  // same element.
+  constexpr typename Base::base_type base() const noexcept {
+    return storage_.base().get();
+  }
+
+  // Returns the projection.
+  constexpr const Callable& projection() const noexcept {
+    return storage_.projection();
+  }
+
+  // Returns our index relative to base.
+  constexpr ptrdiff_t index() const noexcept { return index_; }
+
  private:
-  Iter base_;
-  Callable projection_;
+  detail::ProjStorage<Base, Callable> storage_;
   ptrdiff_t index_;
 
-  // Returns the advanced pointer.  While we could do this with a simple
-  // addition, std::advance opens the possibility we include other iterator
-  // categories eventually.
-  CONSTEXPR_AS_OF_CXX14 Iter projected_() const {
-    Iter copy = base_;
-    std::advance(copy, projection_(index_));
-    return copy;
+  // Returns the base advanced to the projected index.  For contiguous bases,
+  // this is a pointer rather than an Iter.
+  CONSTEXPR_AS_OF_CXX14 typename Base::type projected_() const {
+    return storage_.base().at(
+        detail::note_projection_call(storage_.projection()(index_)));
   }
 };
 
@@ -202,6 +598,87 @@ constexpr inline auto make_projection_iterator(
   return ProjIter<Iter, Callable>(base, std::move(projection));
 }
 
+// Returns a ProjIter over base through projection, positioned at the view
+// index that projects to base_offset.  The projection must provide an inverse
+// (see has_inverse_projection above).  For example, given an element's
+// position pos in a vector v that's viewed through a folded interleave
+// projection:
+//
+//     auto it = make_projection_iterator_at(v.begin(), projection, pos);
+//
+// refers to the same element, at view index it.index().
+template <typename Iter, typename Callable>
+CONSTEXPR_AS_OF_CXX14 inline auto make_projection_iterator_at(
+    Iter base, Callable projection, const std::ptrdiff_t base_offset)
+    -> ProjIter<Iter, Callable> {
+  static_assert(has_inverse_projection<Callable>::value,
+                "Projection callable must provide inverse().");
+  const auto index = static_cast<std::ptrdiff_t>(
+      projection.inverse(base_offset));
+  return ProjIter<Iter, Callable>(std::move(base), std::move(projection)) +
+         index;
+}
+
+// Refers to a projection held elsewhere, in the manner of
+// std::reference_wrapper.  Iterators and views that hold a ProjRef carry a
+// single pointer, rather than a copy of the projection's state, which keeps
+// them small and cheap to copy for projections such as lookup tables.  The
+// referenced projection must outlive them.
+//
+// A ProjRef passes segment(), inverse() and walk() through, so it keeps
+// those properties of the projection.
+template <typename Callable>
+class ProjRef {
+ public:
+  explicit constexpr ProjRef(const Callable& projection) noexcept
+  : projection_{std::addressof(projection)} {}
+
+  // Returns the referenced projection.
+  constexpr const Callable& get() const noexcept { return *projection_; }
+
+  constexpr auto operator()(const std::ptrdiff_t index) const
+      -> decltype(std::declval<const Callable&>()(index)) {
+    return (*projection_)(index);
+  }
+
+  template <typename C = Callable>
+  constexpr auto segment(const std::ptrdiff_t index) const
+      -> decltype(std::declval<const C&>().segment(index)) {
+    return projection_->segment(index);
+  }
+
+  template <typename C = Callable>
+  constexpr auto inverse(const std::ptrdiff_t base_index) const
+      -> decltype(std::declval<const C&>().inverse(base_index)) {
+    return projection_->inverse(base_index);
+  }
+
+  template <typename Fn, typename C = Callable>
+  auto walk(const std::ptrdiff_t first, const std::ptrdiff_t last, Fn& fn) const
+      -> decltype(std::declval<const C&>().walk(first, last, fn)) {
+    return projection_->walk(first, last, fn);
+  }
+
+ private:
+  const Callable* projection_;
+};
+
+// Returns a ProjRef to projection, in the manner of std::cref().
+template <typename Callable>
+constexpr inline ProjRef<Callable> proj_ref(
+    const Callable& projection) noexcept {
+  return ProjRef<Callable>(projection);
+}
+
+// Returns a copy of ref, rather than a reference to a reference.
+template <typename Callable>
+constexpr inline ProjRef<Callable> proj_ref(ProjRef<Callable> ref) noexcept {
+  return ref;
+}
+
+template <typename Callable>
+void proj_ref(const Callable&&) = delete;
+
 }  // namespace jz
 
 #undef CONSTEXPR_AS_OF_CXX14
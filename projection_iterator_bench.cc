@@ -0,0 +1,515 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+//
+// Measures the overhead of running standard algorithms through a ProjIter,
+// compared with running them directly on a vector.  The projected view uses
+// the identity projection, so both sides touch the same elements in the same
+// order, and any difference is the cost of the abstraction itself.  Uses
+// Google Benchmark, e.g.:
+//
+//   g++ -std=c++14 -O2 projection_iterator_bench.cc -lbenchmark -lpthread
+//
+// Each benchmark runs at a working set sized for L1, L2, L3 and DRAM, with
+// element counts scaled to the element type.
+//
+// The copy-through benchmarks at the end compare std::copy through a
+// permuting ProjIter with jz::projected_copy, which copies a block at a time.
+// Build with -mavx2 or the native preset to enable its SIMD kernels.  The
+// copy-into benchmarks compare scattering into a permuting ProjIter with
+// std::copy against jz::projected_copy_streaming.  The shuffled accumulate
+// benchmarks sum through a random permutation table, with and without a
+// jz::PrefetchingProjIter at a range of distances.  The cached accumulate
+// benchmarks sum through folded interleave and tiled views, with and without
+// a jz::CachedProjIter.  The merge benchmarks merge two sorted permuted views
+// with std::merge and jz::projected_merge.
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "cached_projection_iterator.hh"
+#include "prefetching_iterator.hh"
+#include "projected_algorithms.hh"
+#include "projection_iterator.hh"
+#include "projections.hh"
+#include "table_projection.hh"
+#include "tiled_projections.hh"
+
+namespace {
+
+using std::ptrdiff_t;
+using jz::make_projection_iterator;
+
+// A 64-byte element that is ordered by its key and only moved as a whole.
+struct Payload64 {
+  std::uint64_t key;
+  std::uint64_t padding[7];
+
+  friend bool operator<(const Payload64& lhs, const Payload64& rhs) noexcept {
+    return lhs.key < rhs.key;
+  }
+};
+
+static_assert(sizeof(Payload64) == 64, "Payload64 should be 64 bytes.");
+
+// Returns a random value of each element type.  The strings are long enough
+// that some of them don't fit in the small string buffer.
+template <typename T>
+T random_value(std::mt19937_64& g) {
+  return static_cast<T>(g());
+}
+
+template <>
+double random_value<double>(std::mt19937_64& g) {
+  return std::uniform_real_distribution<double>{}(g);
+}
+
+template <>
+Payload64 random_value<Payload64>(std::mt19937_64& g) {
+  auto value = Payload64{};
+  value.key = g();
+  return value;
+}
+
+template <>
+std::string random_value<std::string>(std::mt19937_64& g) {
+  auto length = std::uniform_int_distribution<std::size_t>{8, 24}(g);
+  auto letter = std::uniform_int_distribution<int>{'a', 'z'};
+  auto s = std::string(length, ' ');
+  for (auto& c : s) {
+    c = static_cast<char>(letter(g));
+  }
+  return s;
+}
+
+// Returns size random values.  The generator is seeded from the size, so
+// every benchmark at a given size and type sees the same input.
+template <typename T>
+std::vector<T> random_input(ptrdiff_t size) {
+  auto g = std::mt19937_64{static_cast<std::uint64_t>(size)};
+  auto v = std::vector<T>{};
+  v.reserve(size);
+  for (ptrdiff_t i = 0; i < size; ++i) {
+    v.push_back(random_value<T>(g));
+  }
+  return v;
+}
+
+// Returns the part of an element that std::accumulate sums.
+template <typename T>
+double summand(const T& value) noexcept { return static_cast<double>(value); }
+
+double summand(const Payload64& value) noexcept {
+  return static_cast<double>(value.key);
+}
+
+double summand(const std::string& value) noexcept {
+  return static_cast<double>(value.size());
+}
+
+// Selects how a benchmark views its vector: directly, or through a ProjIter
+// with the identity projection.
+struct RawVector {
+  template <typename T>
+  static auto begin(std::vector<T>& v) { return v.begin(); }
+
+  template <typename T>
+  static auto end(std::vector<T>& v) { return v.end(); }
+};
+
+struct IdentityProjIter {
+  template <typename T>
+  static auto begin(std::vector<T>& v) {
+    return make_projection_iterator(v.begin(), jz::StrideProjection<1>{});
+  }
+
+  template <typename T>
+  static auto end(std::vector<T>& v) {
+    return begin(v) + v.size();
+  }
+};
+
+// Runs a mutating algorithm over a fresh copy of the same random input each
+// iteration.
+template <typename T, typename View, typename AlgorithmFn>
+void run_mutating_benchmark(benchmark::State& state, AlgorithmFn fn) {
+  const auto size = static_cast<ptrdiff_t>(state.range(0));
+  const auto input = random_input<T>(size);
+  auto v = input;
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::copy(input.begin(), input.end(), v.begin());
+    state.ResumeTiming();
+    fn(View::begin(v), View::end(v));
+    benchmark::DoNotOptimize(v.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * size);
+  state.SetBytesProcessed(state.iterations() * size * sizeof(T));
+}
+
+template <typename T, typename View>
+void BM_Sort(benchmark::State& state) {
+  run_mutating_benchmark<T, View>(state, [](auto first, auto last) {
+    std::sort(first, last);
+  });
+}
+
+template <typename T, typename View>
+void BM_StableSort(benchmark::State& state) {
+  run_mutating_benchmark<T, View>(state, [](auto first, auto last) {
+    std::stable_sort(first, last);
+  });
+}
+
+template <typename T, typename View>
+void BM_NthElement(benchmark::State& state) {
+  run_mutating_benchmark<T, View>(state, [](auto first, auto last) {
+    std::nth_element(first, first + (last - first) / 2, last);
+  });
+}
+
+template <typename T, typename View>
+void BM_Accumulate(benchmark::State& state) {
+  const auto size = static_cast<ptrdiff_t>(state.range(0));
+  auto v = random_input<T>(size);
+  for (auto _ : state) {
+    auto sum = std::accumulate(
+        View::begin(v), View::end(v), 0.0,
+        [](const double acc, const T& value) { return acc + summand(value); });
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * size);
+  state.SetBytesProcessed(state.iterations() * size * sizeof(T));
+}
+
+// Copies out of the view into a plain vector.
+template <typename T, typename View>
+void BM_Copy(benchmark::State& state) {
+  const auto size = static_cast<ptrdiff_t>(state.range(0));
+  auto v = random_input<T>(size);
+  auto out = std::vector<T>(size);
+  for (auto _ : state) {
+    std::copy(View::begin(v), View::end(v), out.begin());
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * size);
+  state.SetBytesProcessed(state.iterations() * size * sizeof(T));
+}
+
+// Selects the projection for the copy benchmarks below.
+struct FoldedInterleave {
+  static auto make(ptrdiff_t size) {
+    return jz::make_folded_interleave_projection(size);
+  }
+};
+
+struct Stride3 {
+  static auto make(ptrdiff_t) { return jz::StrideProjection<3>{}; }
+};
+
+struct BitReverse {
+  static auto make(ptrdiff_t size) {
+    return jz::make_bit_reverse_projection(size);
+  }
+};
+
+// The 2D views treat the size, a power of two, as a matrix that's square or
+// twice as wide as it is tall.
+ptrdiff_t matrix_rows(ptrdiff_t size) {
+  auto rows = ptrdiff_t{1};
+  while (rows * rows * 4 <= size) {
+    rows *= 2;
+  }
+  return rows;
+}
+
+struct Tiled16x16 {
+  static auto make(ptrdiff_t size) {
+    const auto rows = matrix_rows(size);
+    return jz::TiledProjection<16, 16>(rows, size / rows);
+  }
+};
+
+struct Morton {
+  static auto make(ptrdiff_t size) {
+    const auto rows = matrix_rows(size);
+    return jz::make_morton_projection(rows, size / rows);
+  }
+};
+
+struct Hilbert {
+  static auto make(ptrdiff_t size) {
+    const auto rows = matrix_rows(size);
+    return jz::make_hilbert_projection(rows, size / rows);
+  }
+};
+
+// Copies out of a projected view with std::copy, one projected element at a
+// time, or with jz::projected_copy, a block at a time.
+template <typename T, typename Proj, bool UseProjectedCopy>
+void run_projected_copy_benchmark(benchmark::State& state) {
+  const auto size = static_cast<ptrdiff_t>(state.range(0));
+  // Strided views read up to 3x the output size.
+  auto v = random_input<T>(3 * size);
+  auto out = std::vector<T>(size);
+  const auto first = make_projection_iterator(v.data(), Proj::make(size));
+  const auto last = first + size;
+  for (auto _ : state) {
+    if (UseProjectedCopy) {
+      jz::projected_copy(first, last, out.data());
+    } else {
+      std::copy(first, last, out.data());
+    }
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * size);
+  state.SetBytesProcessed(state.iterations() * size * sizeof(T));
+}
+
+template <typename T, typename Proj>
+void BM_StdCopyThrough(benchmark::State& state) {
+  run_projected_copy_benchmark<T, Proj, false>(state);
+}
+
+template <typename T, typename Proj>
+void BM_ProjectedCopyThrough(benchmark::State& state) {
+  run_projected_copy_benchmark<T, Proj, true>(state);
+}
+
+// Copies into a projected view with std::copy, scattering one element at a
+// time, or with jz::projected_copy_streaming, which writes the base in order
+// through the projection's inverse.
+template <typename T, typename Proj, bool UseStreamingCopy>
+void run_projected_scatter_benchmark(benchmark::State& state) {
+  const auto size = static_cast<ptrdiff_t>(state.range(0));
+  const auto in = random_input<T>(size);
+  auto v = std::vector<T>(size);
+  const auto out = make_projection_iterator(v.data(), Proj::make(size));
+  for (auto _ : state) {
+    if (UseStreamingCopy) {
+      jz::projected_copy_streaming(in.data(), in.data() + size, out);
+    } else {
+      std::copy(in.data(), in.data() + size, out);
+    }
+    benchmark::DoNotOptimize(v.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * size);
+  state.SetBytesProcessed(state.iterations() * size * sizeof(T));
+}
+
+template <typename T, typename Proj>
+void BM_StdCopyInto(benchmark::State& state) {
+  run_projected_scatter_benchmark<T, Proj, false>(state);
+}
+
+template <typename T, typename Proj>
+void BM_StreamingCopyInto(benchmark::State& state) {
+  run_projected_scatter_benchmark<T, Proj, true>(state);
+}
+
+// Merges two sorted views, each of half the elements, through permuting
+// ProjIters into a vector with std::merge, or with jz::projected_merge, which
+// gathers each block of the inputs before merging it.
+template <typename T, typename Proj, bool UseProjectedMerge>
+void run_projected_merge_benchmark(benchmark::State& state) {
+  const auto half = static_cast<ptrdiff_t>(state.range(0)) / 2;
+  auto a = random_input<T>(half);
+  auto b = random_input<T>(half + 1);
+  b.pop_back();
+  const auto first1 = make_projection_iterator(a.data(), Proj::make(half));
+  const auto first2 = make_projection_iterator(b.data(), Proj::make(half));
+  const auto last1 = first1 + half;
+  const auto last2 = first2 + half;
+  jz::projected_sort(first1, last1);
+  jz::projected_sort(first2, last2);
+  auto out = std::vector<T>(2 * half);
+  for (auto _ : state) {
+    if (UseProjectedMerge) {
+      jz::projected_merge(first1, last1, first2, last2, out.data());
+    } else {
+      std::merge(first1, last1, first2, last2, out.data());
+    }
+    benchmark::DoNotOptimize(out.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * 2 * half);
+}
+
+template <typename T, typename Proj>
+void BM_StdMergeThrough(benchmark::State& state) {
+  run_projected_merge_benchmark<T, Proj, false>(state);
+}
+
+template <typename T, typename Proj>
+void BM_ProjectedMergeThrough(benchmark::State& state) {
+  run_projected_merge_benchmark<T, Proj, true>(state);
+}
+
+// Sums a vector through a table holding a random permutation, so that each
+// element is likely a cache miss.  A distance of 0 walks a plain ProjIter;
+// others walk a PrefetchingProjIter prefetching that far ahead.
+void BM_AccumulateThroughShuffle(benchmark::State& state) {
+  const auto size = static_cast<ptrdiff_t>(state.range(0));
+  const auto distance = static_cast<ptrdiff_t>(state.range(1));
+  const auto v = random_input<std::int32_t>(size);
+  auto order = std::vector<ptrdiff_t>(size);
+  std::iota(order.begin(), order.end(), ptrdiff_t{0});
+  std::shuffle(order.begin(), order.end(),
+               std::mt19937_64{static_cast<std::uint64_t>(size)});
+  const auto table = jz::make_table_projection<std::uint32_t>(
+      [&order](const ptrdiff_t index) { return order[index]; }, size);
+
+  const auto first = make_projection_iterator(v.data(), jz::proj_ref(table));
+  const auto last = first + size;
+  for (auto _ : state) {
+    auto sum = std::int64_t{0};
+    if (distance == 0) {
+      sum = std::accumulate(first, last, sum);
+    } else {
+      sum = std::accumulate(
+          jz::make_prefetching_iterator(first, last, distance),
+          jz::make_prefetching_iterator(last, last, distance), sum);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * size);
+  state.SetBytesProcessed(
+      state.iterations() * size * sizeof(std::int32_t));
+}
+
+// Sums a vector through a piecewise affine projection with std::accumulate,
+// through a plain ProjIter, or through a CachedProjIter.
+template <typename Proj, bool UseCache>
+void run_cached_accumulate_benchmark(benchmark::State& state) {
+  const auto size = static_cast<ptrdiff_t>(state.range(0));
+  const auto v = random_input<std::int32_t>(size);
+  const auto first = make_projection_iterator(v.data(), Proj::make(size));
+  const auto last = first + size;
+  for (auto _ : state) {
+    auto sum = std::int64_t{0};
+    if (UseCache) {
+      sum = std::accumulate(jz::make_cached_projection_iterator(first, last),
+                            jz::make_cached_projection_iterator(last, last),
+                            sum);
+    } else {
+      sum = std::accumulate(first, last, sum);
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * size);
+  state.SetBytesProcessed(
+      state.iterations() * size * sizeof(std::int32_t));
+}
+
+template <typename Proj>
+void BM_AccumulateThrough(benchmark::State& state) {
+  run_cached_accumulate_benchmark<Proj, false>(state);
+}
+
+template <typename Proj>
+void BM_CachedAccumulateThrough(benchmark::State& state) {
+  run_cached_accumulate_benchmark<Proj, true>(state);
+}
+
+// Adds one element count per cache level, sized so the vector's footprint
+// lands in that level.  The footprint ignores the heap storage of long
+// strings.
+template <typename T>
+void working_set_sizes(benchmark::internal::Benchmark* b) {
+  constexpr std::int64_t kL1Bytes   = std::int64_t{16} << 10;
+  constexpr std::int64_t kL2Bytes   = std::int64_t{256} << 10;
+  constexpr std::int64_t kL3Bytes   = std::int64_t{4} << 20;
+  constexpr std::int64_t kDramBytes = std::int64_t{64} << 20;
+  for (const auto bytes : {kL1Bytes, kL2Bytes, kL3Bytes, kDramBytes}) {
+    b->Arg(bytes / static_cast<std::int64_t>(sizeof(T)));
+  }
+}
+
+#define JZ_BENCHMARK_VIEWS(algorithm, type)                             \
+  BENCHMARK_TEMPLATE(algorithm, type, RawVector)                        \
+      ->Apply(working_set_sizes<type>);                                 \
+  BENCHMARK_TEMPLATE(algorithm, type, IdentityProjIter)                 \
+      ->Apply(working_set_sizes<type>)
+
+#define JZ_BENCHMARK_TYPES(algorithm)                                   \
+  JZ_BENCHMARK_VIEWS(algorithm, std::int32_t);                          \
+  JZ_BENCHMARK_VIEWS(algorithm, std::int64_t);                          \
+  JZ_BENCHMARK_VIEWS(algorithm, double);                                \
+  JZ_BENCHMARK_VIEWS(algorithm, Payload64);                             \
+  JZ_BENCHMARK_VIEWS(algorithm, std::string)
+
+JZ_BENCHMARK_TYPES(BM_Sort);
+JZ_BENCHMARK_TYPES(BM_StableSort);
+JZ_BENCHMARK_TYPES(BM_NthElement);
+JZ_BENCHMARK_TYPES(BM_Accumulate);
+JZ_BENCHMARK_TYPES(BM_Copy);
+
+#define JZ_BENCHMARK_COPIES(type, projection)                           \
+  BENCHMARK_TEMPLATE(BM_StdCopyThrough, type, projection)               \
+      ->Apply(working_set_sizes<type>);                                 \
+  BENCHMARK_TEMPLATE(BM_ProjectedCopyThrough, type, projection)         \
+      ->Apply(working_set_sizes<type>)
+
+JZ_BENCHMARK_COPIES(std::int32_t, FoldedInterleave);
+JZ_BENCHMARK_COPIES(std::int32_t, Stride3);
+JZ_BENCHMARK_COPIES(std::int32_t, BitReverse);
+JZ_BENCHMARK_COPIES(double, FoldedInterleave);
+JZ_BENCHMARK_COPIES(double, Stride3);
+JZ_BENCHMARK_COPIES(double, BitReverse);
+JZ_BENCHMARK_COPIES(std::int32_t, Tiled16x16);
+JZ_BENCHMARK_COPIES(std::int32_t, Morton);
+JZ_BENCHMARK_COPIES(std::int32_t, Hilbert);
+
+#define JZ_BENCHMARK_SCATTERS(type, projection)                         \
+  BENCHMARK_TEMPLATE(BM_StdCopyInto, type, projection)                  \
+      ->Apply(working_set_sizes<type>);                                 \
+  BENCHMARK_TEMPLATE(BM_StreamingCopyInto, type, projection)            \
+      ->Apply(working_set_sizes<type>)
+
+JZ_BENCHMARK_SCATTERS(std::int32_t, FoldedInterleave);
+JZ_BENCHMARK_SCATTERS(double, FoldedInterleave);
+JZ_BENCHMARK_SCATTERS(std::int32_t, Tiled16x16);
+
+#define JZ_BENCHMARK_MERGES(type, projection)                           \
+  BENCHMARK_TEMPLATE(BM_StdMergeThrough, type, projection)              \
+      ->Apply(working_set_sizes<type>);                                 \
+  BENCHMARK_TEMPLATE(BM_ProjectedMergeThrough, type, projection)        \
+      ->Apply(working_set_sizes<type>)
+
+JZ_BENCHMARK_MERGES(std::int32_t, FoldedInterleave);
+JZ_BENCHMARK_MERGES(double, FoldedInterleave);
+JZ_BENCHMARK_MERGES(std::int32_t, BitReverse);
+
+BENCHMARK(BM_AccumulateThroughShuffle)
+    ->ArgsProduct({{std::int64_t{64} << 10, std::int64_t{16} << 20},
+                   {0, 4, 8, 16, 32, 64}});
+
+#define JZ_BENCHMARK_CACHED_WALKS(projection)                           \
+  BENCHMARK_TEMPLATE(BM_AccumulateThrough, projection)                  \
+      ->RangeMultiplier(16)->Range(1 << 12, 1 << 24);                   \
+  BENCHMARK_TEMPLATE(BM_CachedAccumulateThrough, projection)            \
+      ->RangeMultiplier(16)->Range(1 << 12, 1 << 24)
+
+JZ_BENCHMARK_CACHED_WALKS(FoldedInterleave);
+JZ_BENCHMARK_CACHED_WALKS(Tiled16x16);
+
+#undef JZ_BENCHMARK_CACHED_WALKS
+#undef JZ_BENCHMARK_MERGES
+#undef JZ_BENCHMARK_SCATTERS
+#undef JZ_BENCHMARK_COPIES
+#undef JZ_BENCHMARK_TYPES
+#undef JZ_BENCHMARK_VIEWS
+
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,1308 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+//
+// Checks each projected algorithm against what the standard algorithm does
+// through a plain ProjIter over the same projection, over every kind of
+// projection and a spread of sizes.  Prints each mismatch, and exits with
+// status 1 if there were any.
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <numeric>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <unistd.h>
+
+#include "algorithms.hh"
+#include "apply_projection.hh"
+#include "base_checkpoints.hh"
+#include "batch_sort.hh"
+#include "cached_projection_iterator.hh"
+#include "deque_segments.hh"
+#include "external_sort.hh"
+#include "mmap_array.hh"
+#include "prefetching_iterator.hh"
+#include "projected_algorithms.hh"
+#include "projected_view.hh"
+#include "projection_iterator.hh"
+#include "projection_stats.hh"
+#include "projections.hh"
+#include "table_projection.hh"
+#include "tiled_projections.hh"
+#if __cplusplus >= 201703L
+#  include "scratch_arena.hh"
+#endif
+
+namespace {
+
+using std::ptrdiff_t;
+using jz::make_projection_iterator;
+
+// Includes 0, 1, odd sizes, powers of two for the projections that need
+// them, and sizes past a few thousand elements.
+const ptrdiff_t kSizes[] = {
+    0, 1, 2, 3, 7, 8, 10, 31, 64, 100, 1000, 1001, 4096, 4097};
+
+int failures = 0;
+std::mt19937 rng(20240917);
+
+void check(const bool ok, const std::string& what, const char* const name,
+           const ptrdiff_t n) {
+  if (!ok) {
+    ++failures;
+    std::fprintf(stderr, "FAILED: %s, %s, n = %td\n", what.c_str(), name, n);
+  }
+}
+
+// Returns size random values in [0, limit), so larger ranges have repeats.
+std::vector<int> random_ints(const ptrdiff_t size, const int limit) {
+  auto dist = std::uniform_int_distribution<int>(0, std::max(limit, 1) - 1);
+  auto values = std::vector<int>(static_cast<std::size_t>(size));
+  for (auto& value : values) {
+    value = dist(rng);
+  }
+  return values;
+}
+
+// Returns random keys tagged with their positions, to check stability.
+std::vector<std::pair<int, int>> random_pairs(const ptrdiff_t size) {
+  const auto keys = random_ints(size, static_cast<int>(size / 4 + 1));
+  auto pairs = std::vector<std::pair<int, int>>{};
+  for (const auto key : keys) {
+    pairs.emplace_back(key, static_cast<int>(pairs.size()));
+  }
+  return pairs;
+}
+
+const auto by_key = [](const std::pair<int, int>& lhs,
+                       const std::pair<int, int>& rhs) {
+  return lhs.first < rhs.first;
+};
+
+struct Shape {
+  ptrdiff_t rows;
+  ptrdiff_t cols;
+};
+
+// Returns the squarest rows x cols shape with n elements, with rows <= cols.
+Shape matrix_shape(const ptrdiff_t n) {
+  auto rows = ptrdiff_t{n == 0 ? 0 : 1};
+  for (auto d = ptrdiff_t{2}; d * d <= n; ++d) {
+    if (n % d == 0) {
+      rows = d;
+    }
+  }
+  return Shape{rows, rows == 0 ? 1 : n / rows};
+}
+
+bool is_pow2(const ptrdiff_t n) { return n > 0 && (n & (n - 1)) == 0; }
+
+// The compile-time sized projections are constant expressions.
+static_assert(jz::StrideProjection<3>{}(4) == 12, "");
+static_assert(jz::StrideProjection<-1>{}(4) == -4, "");
+static_assert(jz::ReverseProjection<8>{}(2) == 5, "");
+static_assert(jz::FoldedInterleaveProjection<8>{}(5) == 5, "");
+static_assert(jz::BitReverseProjection<8>{}(1) == 4, "");
+static_assert(jz::BitReverseProjection<>(8)(1) == 4, "");
+
+// Only projections that their size determines share cached tables by size.
+static_assert(jz::is_size_determined_projection<
+                  jz::FoldedInterleaveProjection<>>::value,
+              "");
+static_assert(!jz::is_size_determined_projection<
+                  jz::TranspositionProjection<>>::value,
+              "");
+
+// std::vector's iterators are contiguous bases, so ProjIter holds them as
+// raw pointers, before C++20 too where the library is known.
+#if defined(__GLIBCXX__) || __cplusplus >= 202002L
+static_assert(jz::is_contiguous_base<std::vector<int>::iterator>::value, "");
+static_assert(
+    jz::is_contiguous_base<std::vector<int>::const_iterator>::value, "");
+static_assert(
+    std::is_same<decltype(std::declval<jz::ProjIter<
+                              std::vector<int>::iterator,
+                              jz::ReverseProjection<8>>>().base()),
+                 int*>::value,
+    "");
+#endif
+
+// With deque_segments.hh, libstdc++'s std::deque iterators are segmented
+// bases, and other libraries' fall back to advancing the iterator.
+static_assert(jz::segmented_iterator_traits<std::deque<int>::iterator>::
+                      is_segmented ==
+#if defined(__GLIBCXX__)
+                  true,
+#else
+                  false,
+#endif
+              "");
+
+// Stateless projections take no space in a ProjIter, and proj_ref() holds a
+// stateful one by pointer.
+static_assert(sizeof(jz::ProjIter<int*, jz::StrideProjection<2>>) ==
+                  sizeof(int*) + sizeof(ptrdiff_t),
+              "");
+static_assert(
+    sizeof(jz::ProjIter<int*, jz::ProjRef<jz::ReverseProjection<>>>) ==
+        2 * sizeof(int*) + sizeof(ptrdiff_t),
+    "");
+
+// Neighbouring affine projections fuse, keeping compile-time strides.
+static_assert(
+    std::is_same<decltype(jz::compose(jz::StrideProjection<2>{},
+                                      jz::StrideProjection<-3>{})),
+                 jz::StrideProjection<-6>>::value,
+    "");
+static_assert(jz::compose(jz::StrideProjection<2>{},
+                          jz::make_affine_projection(1, 3))(4) == 26,
+              "");
+static_assert(
+    jz::has_affine_segments<decltype(jz::compose(
+        jz::make_reverse_projection(8),
+        jz::make_folded_interleave_projection(8)))>::value,
+    "");
+
+// Calls fn(name, base_size, projection) for each projection we check over a
+// view of n elements, where base_size is how many elements the view's base
+// needs.  The base and view sizes match for the permutations.
+template <typename Fn>
+void for_each_projection(const ptrdiff_t n, Fn&& fn) {
+  const auto shape = matrix_shape(n);
+  fn("folded", n, jz::make_folded_interleave_projection(n));
+  fn("reverse", n, jz::make_reverse_projection(n));
+  fn("stride", 3 * n, jz::make_stride_projection(3));
+  fn("stride<2>", 2 * n, jz::StrideProjection<2>{});
+  fn("transposition", n,
+     jz::make_transposition_projection(shape.rows, shape.cols));
+  fn("tiled", n, jz::make_tiled_projection(shape.rows, shape.cols, 4, 3));
+  if (n % 4 == 0) {
+    fn("block interleave", n, jz::make_block_interleave_projection<2>(n));
+  }
+  if (is_pow2(n)) {
+    auto rows = ptrdiff_t{1};
+    while (rows * rows * 2 <= n) {
+      rows *= 2;
+    }
+    fn("bit reverse", n, jz::make_bit_reverse_projection(n));
+    fn("morton", n, jz::make_morton_projection(rows, n / rows));
+    fn("hilbert", n, jz::make_hilbert_projection(rows, n / rows));
+  }
+
+  const auto folded = jz::make_folded_interleave_projection(n);
+  fn("folded by reference", n, jz::proj_ref(folded));
+
+  auto permutation = std::vector<ptrdiff_t>(static_cast<std::size_t>(n));
+  std::iota(permutation.begin(), permutation.end(), 0);
+  std::shuffle(permutation.begin(), permutation.end(), rng);
+  const auto table = jz::make_table_projection<std::uint32_t>(
+      [&permutation](const ptrdiff_t index) { return permutation[index]; },
+      n);
+  fn("table", n, jz::proj_ref(table));
+
+  fn("reverse of folded", n,
+     jz::compose(jz::make_reverse_projection(n),
+                 jz::make_folded_interleave_projection(n)));
+  fn("stride of tiled", 2 * n,
+     jz::compose(jz::make_stride_projection(2),
+                 jz::make_tiled_projection(shape.rows, shape.cols, 2, 5)));
+}
+
+// Returns values sorted through projection with std::sort, or with
+// std::stable_sort if IsStable.
+template <bool IsStable, typename T, typename Proj, typename Compare>
+std::vector<T> std_sorted(std::vector<T> values, const Proj& projection,
+                          const ptrdiff_t n, Compare comp) {
+  const auto first = make_projection_iterator(values.begin(), projection);
+  if (IsStable) {
+    std::stable_sort(first, first + n, comp);
+  } else {
+    std::sort(first, first + n, comp);
+  }
+  return values;
+}
+
+// Checks that each segment() covers the index it was asked about, and agrees
+// with the projection there.
+template <typename Proj>
+void check_segments(const char*, ptrdiff_t, const Proj&, ptrdiff_t,
+                    std::false_type) {}
+
+template <typename Proj>
+void check_segments(const char* const name, ptrdiff_t,
+                    const Proj& projection, const ptrdiff_t n,
+                    std::true_type) {
+  auto ok = true;
+  for (auto i = ptrdiff_t{0}; i < n; ++i) {
+    const auto segment = projection.segment(i);
+    ok = ok && segment.first <= i && i < segment.last &&
+         segment.offset + segment.stride * i ==
+             static_cast<ptrdiff_t>(projection(i));
+  }
+  check(ok, "segment()", name, n);
+}
+
+// Checks that projected_for_each() visits the view in order, over contiguous
+// and other bases.
+template <typename Proj>
+void check_for_each(const char* const name, const ptrdiff_t base_size,
+                    const Proj& projection, const ptrdiff_t n) {
+  auto values = random_ints(base_size, 1000);
+  const auto view = make_projection_iterator(values.data(), projection);
+  const auto expected = std::vector<int>(view, view + n);
+  const auto run = [&](const char* const what, auto first) {
+    auto actual = std::vector<int>{};
+    jz::projected_for_each(first, first + n, [&actual](const int value) {
+      actual.push_back(value);
+    });
+    check(actual == expected, what, name, n);
+  };
+
+  run("projected_for_each", view);
+  run("projected_for_each over a vector iterator",
+      make_projection_iterator(values.begin(), projection));
+  auto deque = std::deque<int>(values.begin(), values.end());
+  run("projected_for_each over a deque",
+      make_projection_iterator(deque.begin(), projection));
+}
+
+template <typename Proj>
+void check_sorts(const char* const name, const ptrdiff_t base_size,
+                 const Proj& projection, const ptrdiff_t n) {
+  const auto values = random_ints(base_size, static_cast<int>(n / 2 + 1));
+  const auto expected = std_sorted<false>(values, projection, n, std::less<>{});
+  const auto run = [&](const char* const what, auto sort) {
+    auto actual = values;
+    const auto first = make_projection_iterator(actual.begin(), projection);
+    sort(first, first + n);
+    check(actual == expected, what, name, n);
+  };
+
+  run("projected_sort", [](auto first, auto last) {
+    jz::projected_sort(first, last);
+  });
+  run("projected_sort with scratch", [](auto first, auto last) {
+    auto scratch = std::vector<int>{};
+    jz::projected_sort(first, last, std::less<>{}, scratch);
+  });
+  run("projected_radix_sort", [](auto first, auto last) {
+    jz::projected_radix_sort(first, last);
+  });
+  run("projected_radix_sort with scratch", [](auto first, auto last) {
+    auto scratch = std::vector<int>{};
+    jz::projected_radix_sort(first, last, scratch);
+  });
+  run("projected_external_sort", [](auto first, auto last) {
+    auto options = jz::ExternalSortOptions{};
+    options.memory_budget = 256 * sizeof(int);
+    jz::projected_external_sort(first, last, options);
+  });
+#if __cplusplus >= 201703L
+  run("projected_sort with arena", [](auto first, auto last) {
+    jz::projected_sort(first, last, std::less<>{}, jz::thread_scratch_arena());
+  });
+  run("projected_radix_sort with arena", [](auto first, auto last) {
+    jz::projected_radix_sort(first, last, jz::thread_scratch_arena());
+  });
+#endif
+#ifdef JZ_PROJECTED_ALGORITHMS_HAS_EXECUTION
+  run("projected_sort(par)", [](auto first, auto last) {
+    jz::projected_sort(std::execution::par, first, last);
+  });
+#endif
+
+  // Negative keys and floats take the radix sort's key transforms.
+  auto doubles = std::vector<double>{};
+  for (const auto value : values) {
+    doubles.push_back((value - static_cast<double>(n) / 4) * 0.5);
+  }
+  const auto expected_doubles =
+      std_sorted<false>(doubles, projection, n, std::less<>{});
+  const auto first = make_projection_iterator(doubles.begin(), projection);
+  jz::projected_radix_sort(first, first + n);
+  check(doubles == expected_doubles, "projected_radix_sort of doubles", name,
+        n);
+}
+
+template <typename Proj>
+void check_stable_sorts(const char* const name, const ptrdiff_t base_size,
+                        const Proj& projection, const ptrdiff_t n) {
+  const auto values = random_pairs(base_size);
+  const auto expected = std_sorted<true>(values, projection, n, by_key);
+  const auto run = [&](const char* const what, auto sort) {
+    auto actual = values;
+    const auto first = make_projection_iterator(actual.begin(), projection);
+    sort(first, first + n);
+    check(actual == expected, what, name, n);
+  };
+
+  run("projected_stable_sort", [](auto first, auto last) {
+    jz::projected_stable_sort(first, last, by_key);
+  });
+  run("projected_stable_sort with scratch", [](auto first, auto last) {
+    auto scratch = std::vector<std::pair<int, int>>{};
+    jz::projected_stable_sort(first, last, by_key, scratch);
+  });
+  run("jz::stable_sort", [](auto first, auto last) {
+    jz::stable_sort(first, last, by_key);
+  });
+#if __cplusplus >= 201703L
+  run("projected_stable_sort with arena", [](auto first, auto last) {
+    jz::projected_stable_sort(first, last, by_key, jz::thread_scratch_arena());
+  });
+#endif
+#ifdef JZ_PROJECTED_ALGORITHMS_HAS_EXECUTION
+  run("projected_stable_sort(par)", [](auto first, auto last) {
+    jz::projected_stable_sort(std::execution::par, first, last, by_key);
+  });
+#endif
+}
+
+template <typename Proj>
+void check_merges(const char* const name, const ptrdiff_t base_size,
+                  const Proj& projection, const ptrdiff_t n) {
+  // Sorts each half of the view, and merges the two halves.
+  auto values = random_pairs(base_size);
+  const auto first = make_projection_iterator(values.begin(), projection);
+  const auto mid = first + n / 3;
+  const auto last = first + n;
+  std::stable_sort(first, mid, by_key);
+  std::stable_sort(mid, last, by_key);
+
+  auto expected = std::vector<std::pair<int, int>>{};
+  std::merge(first, mid, mid, last, std::back_inserter(expected), by_key);
+  const auto run = [&](const char* const what, auto merge) {
+    auto actual = std::vector<std::pair<int, int>>(expected.size());
+    const auto out = merge(actual.begin());
+    check(actual == expected && out == actual.end(), what, name, n);
+  };
+
+  run("projected_merge", [&](auto out) {
+    return jz::projected_merge(first, mid, mid, last, out, by_key);
+  });
+#if __cplusplus >= 201703L
+  run("projected_merge with arena", [&](auto out) {
+    return jz::projected_merge(first, mid, mid, last, out, by_key,
+                               jz::thread_scratch_arena());
+  });
+#endif
+#ifdef JZ_PROJECTED_ALGORITHMS_HAS_EXECUTION
+  run("projected_merge(par)", [&](auto out) {
+    return jz::projected_merge(std::execution::par, first, mid, mid, last,
+                               out, by_key);
+  });
+#endif
+}
+
+// Checks that inverse() undoes the projection, and that
+// make_projection_iterator_at() finds the view index of each base element.
+template <typename Proj>
+void check_inverses(const char*, ptrdiff_t, const Proj&, ptrdiff_t,
+                    std::false_type) {}
+
+template <typename Proj>
+void check_inverses(const char* const name, const ptrdiff_t base_size,
+                    const Proj& projection, const ptrdiff_t n,
+                    std::true_type) {
+  auto values = std::vector<int>(static_cast<std::size_t>(base_size));
+  auto ok = true;
+  for (auto i = ptrdiff_t{0}; i < n; ++i) {
+    const auto base_index = static_cast<ptrdiff_t>(projection(i));
+    const auto it =
+        jz::make_projection_iterator_at(values.begin(), projection, base_index);
+    ok = ok && static_cast<ptrdiff_t>(projection.inverse(base_index)) == i &&
+         it.index() == i;
+  }
+  check(ok, "inverse()", name, n);
+}
+
+// projected_resort() maps the changed base indices through the inverse.
+template <typename Proj>
+void check_resorts(const char*, ptrdiff_t, const Proj&, ptrdiff_t,
+                   std::false_type) {}
+
+template <typename Proj>
+void check_resorts(const char* const name, const ptrdiff_t base_size,
+                   const Proj& projection, const ptrdiff_t n,
+                   std::true_type) {
+  const auto sorted = std_sorted<false>(
+      random_ints(base_size, static_cast<int>(n + 1)), projection, n,
+      std::less<>{});
+
+  // Changes about a tenth of the view, listing one index twice.
+  auto values = sorted;
+  auto dirty = std::vector<ptrdiff_t>{};
+  auto dist = std::uniform_int_distribution<ptrdiff_t>(
+      0, std::max(n, ptrdiff_t{1}) - 1);
+  for (auto k = ptrdiff_t{0}; n > 0 && k < n / 10 + 1; ++k) {
+    const auto base_index = static_cast<ptrdiff_t>(projection(dist(rng)));
+    values[base_index] = random_ints(1, static_cast<int>(n + 1))[0];
+    dirty.push_back(base_index);
+  }
+  if (!dirty.empty()) {
+    dirty.push_back(dirty.front());
+  }
+  const auto expected =
+      std_sorted<false>(values, projection, n, std::less<>{});
+  const auto run = [&](const char* const what, auto resort) {
+    auto actual = values;
+    const auto first = make_projection_iterator(actual.begin(), projection);
+    resort(first, first + n);
+    check(actual == expected, what, name, n);
+  };
+
+  run("projected_resort", [&](auto first, auto last) {
+    jz::projected_resort(first, last, dirty.begin(), dirty.end());
+  });
+#if __cplusplus >= 201703L
+  run("projected_resort with arena", [&](auto first, auto last) {
+    jz::projected_resort(first, last, dirty.begin(), dirty.end(),
+                         std::less<>{}, jz::thread_scratch_arena());
+  });
+#endif
+}
+
+template <typename Proj>
+void check_applies(const char* const name, const ptrdiff_t base_size,
+                   const Proj& projection, const ptrdiff_t n) {
+  if (base_size != n) {
+    return;  // Only permutations can be applied in place.
+  }
+  const auto values = random_ints(n, static_cast<int>(n + 1));
+  auto expected = std::vector<int>(values.size());
+  auto view = make_projection_iterator(values.begin(), projection);
+  std::copy(view, view + n, expected.begin());
+
+  const auto run = [&](const char* const what, auto apply, auto unapply) {
+    auto actual = values;
+    apply(actual.begin(), actual.end());
+    check(actual == expected, what, name, n);
+    unapply(actual.begin(), actual.end());
+    check(actual == values, std::string(what) + ", inverted", name, n);
+  };
+
+  run("apply_projection",
+      [&](auto first, auto last) {
+        jz::apply_projection(first, last, projection);
+      },
+      [&](auto first, auto last) {
+        jz::apply_inverse_projection(first, last, projection);
+      });
+  run("apply_projection with scratch",
+      [&](auto first, auto last) {
+        auto scratch = std::vector<int>{};
+        jz::apply_projection(first, last, projection, scratch);
+      },
+      [&](auto first, auto last) {
+        auto scratch = std::vector<int>{};
+        jz::apply_inverse_projection(first, last, projection, scratch);
+      });
+#if __cplusplus >= 201703L
+  run("apply_projection with arena",
+      [&](auto first, auto last) {
+        jz::apply_projection(first, last, projection,
+                             jz::thread_scratch_arena());
+      },
+      [&](auto first, auto last) {
+        jz::apply_inverse_projection(first, last, projection,
+                                     jz::thread_scratch_arena());
+      });
+#endif
+}
+
+// Checks an in-order walk through CachedProjIter, for the projections it
+// takes.
+template <typename Proj>
+void check_cached_walk(const char*, ptrdiff_t, const Proj&, ptrdiff_t,
+                       std::false_type) {}
+
+template <typename Proj>
+void check_cached_walk(const char* const name, const ptrdiff_t base_size,
+                       const Proj& projection, const ptrdiff_t n,
+                       std::true_type) {
+  auto values = random_ints(base_size, 1000);
+  const auto first = make_projection_iterator(values.data(), projection);
+  auto expected = std::vector<int>(static_cast<std::size_t>(n));
+  std::copy(first, first + n, expected.begin());
+  auto actual = std::vector<int>(static_cast<std::size_t>(n));
+  const auto cached_first =
+      jz::make_cached_projection_iterator(first, first + n);
+  const auto cached_last =
+      jz::make_cached_projection_iterator(first + n, first + n);
+  std::copy(cached_first, cached_last, actual.begin());
+  check(actual == expected, "CachedProjIter walk", name, n);
+  auto reversed = std::vector<int>(static_cast<std::size_t>(n));
+  std::reverse_copy(cached_first, cached_last, reversed.begin());
+  check(std::equal(reversed.rbegin(), reversed.rend(), expected.begin()),
+        "CachedProjIter backward walk", name, n);
+  auto jumps = true;
+  for (ptrdiff_t i = 0; i < n; i += 7) {
+    jumps = jumps && cached_last[i - n] == expected[i] &&
+            *(cached_first + (n - 1 - i)) == expected[n - 1 - i];
+  }
+  check(jumps, "CachedProjIter jumps", name, n);
+}
+
+// Checks in-order walks through PrefetchingProjIter at a few distances.
+template <typename Proj>
+void check_prefetching_walk(const char* const name, const ptrdiff_t base_size,
+                            const Proj& projection, const ptrdiff_t n) {
+  auto values = random_ints(base_size, 1000);
+  const auto first = make_projection_iterator(values.data(), projection);
+  const auto last = first + n;
+  const auto expected = std::vector<int>(first, last);
+  const auto actual = std::vector<int>(
+      jz::make_prefetching_iterator(first, last),
+      jz::make_prefetching_iterator(last, last));
+  check(actual == expected, "PrefetchingProjIter walk", name, n);
+  for (const auto distance : {ptrdiff_t{0}, ptrdiff_t{1}, ptrdiff_t{16}}) {
+    const auto at_distance = std::vector<int>(
+        jz::make_prefetching_iterator(first, last, distance),
+        jz::make_prefetching_iterator(last, last, distance));
+    check(at_distance == expected,
+          "PrefetchingProjIter walk at distance " + std::to_string(distance),
+          name, n);
+  }
+}
+
+template <typename Proj>
+void check_copies(const char* const name, const ptrdiff_t base_size,
+                  const Proj& projection, const ptrdiff_t n) {
+  // Gathers the view.
+  auto values = random_ints(base_size, 1000);
+  const auto view = make_projection_iterator(values.data(), projection);
+  auto expected = std::vector<int>(static_cast<std::size_t>(n));
+  std::copy(view, view + n, expected.begin());
+  auto actual = std::vector<int>(static_cast<std::size_t>(n));
+  jz::projected_copy(view, view + n, actual.begin());
+  check(actual == expected, "projected_copy from a view", name, n);
+
+  const auto op = [](const int value) { return 3 * value + 1; };
+  std::transform(view, view + n, expected.begin(), op);
+  jz::projected_transform(view, view + n, actual.begin(), op);
+  check(actual == expected, "projected_transform from a view", name, n);
+
+  // Scatters into the view, leaving the rest of the base alone.
+  const auto source = random_ints(n, 1000);
+  const auto run = [&](const char* const what, auto copy) {
+    auto expected_base = values;
+    std::copy(source.begin(), source.end(),
+              make_projection_iterator(expected_base.data(), projection));
+    auto actual_base = values;
+    const auto out = make_projection_iterator(actual_base.data(), projection);
+    const auto end = copy(source.data(), source.data() + n, out);
+    check(actual_base == expected_base && end == out + n, what, name, n);
+  };
+  run("projected_copy into a view", [](auto first, auto last, auto out) {
+    return jz::projected_copy(first, last, out);
+  });
+  run("projected_copy_streaming", [](auto first, auto last, auto out) {
+    return jz::projected_copy_streaming(first, last, out);
+  });
+}
+
+// Checks a ProjectedView over a permutation of its whole container.
+template <typename Proj>
+void check_views(const char* const name, const ptrdiff_t base_size,
+                 const Proj& projection, const ptrdiff_t n) {
+  if (base_size != n) {
+    return;  // The view covers the whole container.
+  }
+  auto values = random_ints(n, static_cast<int>(n / 2 + 1));
+  const auto expected = std_sorted<false>(values, projection, n, std::less<>{});
+  const auto first = make_projection_iterator(values.begin(), projection);
+  auto view = jz::make_projected_view(values, projection);
+  check(static_cast<ptrdiff_t>(view.size()) == n &&
+            std::equal(view.begin(), view.end(), first, first + n),
+        "ProjectedView", name, n);
+  std::sort(view.begin(), view.end());
+  check(values == expected, "std::sort through a ProjectedView", name, n);
+}
+
+// A ProjIter over a ProjIter views the same elements whether nested or
+// flattened into one ProjIter.
+template <typename Proj>
+void check_stacked_views(const char* const name, const ptrdiff_t base_size,
+                         const Proj& projection, const ptrdiff_t n) {
+  auto values = random_ints(base_size, 1000);
+  const auto view = make_projection_iterator(values.data(), projection);
+  auto expected = std::vector<int>(view, view + n);
+  std::reverse(expected.begin(), expected.end());
+  const auto run = [&](const char* const what, auto first) {
+    check(std::equal(first, first + n, expected.begin(), expected.end()),
+          what, name, n);
+  };
+
+  run("nested ProjIter",
+      make_projection_iterator(view, jz::make_reverse_projection(n)));
+  run("flattened ProjIter",
+      jz::make_flattened_projection_iterator(
+          view, jz::make_reverse_projection(n)));
+}
+
+// Sorts through checkpoints over a std::list, and reads through a ProjIter
+// over the list itself.
+template <typename Proj>
+void check_lists(const char* const name, const ptrdiff_t base_size,
+                 const Proj& projection, const ptrdiff_t n) {
+  const auto values = random_ints(base_size, static_cast<int>(n / 2 + 1));
+  const auto expected = std_sorted<false>(values, projection, n, std::less<>{});
+  auto list = std::list<int>(values.begin(), values.end());
+  const auto checkpoints = jz::make_base_checkpoints(list.begin(), list.end());
+  const auto first = make_projection_iterator(checkpoints.begin(), projection);
+  jz::projected_sort(first, first + n);
+  check(std::equal(list.begin(), list.end(), expected.begin(), expected.end()),
+        "projected_sort through checkpoints", name, n);
+
+  if (n <= 1000) {  // Each access walks the list from its start.
+    const auto view = make_projection_iterator(list.cbegin(), projection);
+    check(std::equal(view, view + n,
+                     make_projection_iterator(expected.begin(), projection)),
+          "ProjIter over a list", name, n);
+  }
+}
+
+template <typename Proj>
+void check_deques(const char* const name, const ptrdiff_t base_size,
+                  const Proj& projection, const ptrdiff_t n) {
+  const auto values = random_ints(base_size, static_cast<int>(n / 2 + 1));
+  const auto expected = std_sorted<false>(values, projection, n, std::less<>{});
+  auto deque = std::deque<int>(values.begin(), values.end());
+  const auto first = make_projection_iterator(deque.begin(), projection);
+  std::sort(first, first + n);
+  check(std::equal(deque.begin(), deque.end(), expected.begin(),
+                   expected.end()),
+        "std::sort through a deque", name, n);
+}
+
+// Checks the jz:: algorithms against the std:: ones.  Where the standard
+// leaves the result partly unspecified, checks what it does specify.
+template <typename Proj>
+void check_algorithms(const char* const name, const ptrdiff_t base_size,
+                      const Proj& projection, const ptrdiff_t n) {
+  const auto values = random_ints(base_size, static_cast<int>(n / 2 + 1));
+  auto sorted = std_sorted<false>(values, projection, n, std::less<>{});
+  const auto view_of = [&projection](std::vector<int>& base) {
+    return make_projection_iterator(base.begin(), projection);
+  };
+  const auto mid = n / 3;
+
+  auto actual = values;
+  auto first = view_of(actual);
+  jz::sort(first, first + n);
+  check(actual == sorted, "jz::sort", name, n);
+
+  actual = values;
+  jz::nth_element(first, first + mid, first + n);
+  const auto is_partitioned =
+      n == 0 || (first[mid] == view_of(sorted)[mid] &&
+                 std::all_of(first, first + mid,
+                             [&](const int value) {
+                               return value <= first[mid];
+                             }) &&
+                 std::all_of(first + mid, first + n, [&](const int value) {
+                   return value >= first[mid];
+                 }));
+  check(is_partitioned, "jz::nth_element", name, n);
+
+  actual = values;
+  jz::partial_sort(first, first + mid, first + n);
+  check(std::equal(first, first + mid, view_of(sorted)), "jz::partial_sort",
+        name, n);
+
+  auto expected = values;
+  std::reverse(view_of(expected), view_of(expected) + n);
+  actual = values;
+  jz::reverse(first, first + n);
+  check(actual == expected, "jz::reverse", name, n);
+
+  expected = values;
+  const auto expected_mid = std::rotate(
+      view_of(expected), view_of(expected) + mid, view_of(expected) + n);
+  actual = values;
+  const auto actual_mid = jz::rotate(first, first + mid, first + n);
+  check(actual == expected &&
+            actual_mid - first == expected_mid - view_of(expected),
+        "jz::rotate", name, n);
+
+  actual = values;
+  for (const auto value : {n > 0 ? first[n / 2] : 0, -1}) {
+    check(jz::find(first, first + n, value) ==
+              std::find(first, first + n, value),
+          "jz::find", name, n);
+  }
+}
+
+// Wraps a position in a vector, and counts each step that leaves the vector
+// or dereference outside it.  Both are undefined for the vector's own
+// iterators, but don't always fail for them.
+class CheckedIter {
+ public:
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type        = int;
+  using difference_type   = ptrdiff_t;
+  using pointer           = int*;
+  using reference         = int&;
+
+  CheckedIter() = default;
+
+  CheckedIter(std::vector<int>& base, const ptrdiff_t pos)
+  : base_{&base}, pos_{pos} {}
+
+  int& operator*() const {
+    if (pos_ < 0 || pos_ >= size_()) {
+      ++out_of_range;
+      return dummy_;
+    }
+    return (*base_)[static_cast<std::size_t>(pos_)];
+  }
+
+  int* operator->() const { return &**this; }
+  int& operator[](const ptrdiff_t delta) const { return *(*this + delta); }
+
+  CheckedIter& operator+=(const ptrdiff_t delta) {
+    pos_ += delta;
+    if (pos_ < 0 || pos_ > size_()) {
+      ++out_of_range;
+    }
+    return *this;
+  }
+
+  CheckedIter& operator-=(const ptrdiff_t delta) { return *this += -delta; }
+  CheckedIter& operator++() { return *this += 1; }
+  CheckedIter& operator--() { return *this += -1; }
+
+  CheckedIter operator++(int) {
+    auto copy = *this;
+    ++*this;
+    return copy;
+  }
+
+  CheckedIter operator--(int) {
+    auto copy = *this;
+    --*this;
+    return copy;
+  }
+
+  friend CheckedIter operator+(CheckedIter it, const ptrdiff_t delta) {
+    return it += delta;
+  }
+
+  friend CheckedIter operator+(const ptrdiff_t delta, CheckedIter it) {
+    return it += delta;
+  }
+
+  friend CheckedIter operator-(CheckedIter it, const ptrdiff_t delta) {
+    return it -= delta;
+  }
+
+  friend ptrdiff_t operator-(const CheckedIter& lhs, const CheckedIter& rhs) {
+    return lhs.pos_ - rhs.pos_;
+  }
+
+  friend bool operator==(const CheckedIter& lhs, const CheckedIter& rhs) {
+    return lhs.pos_ == rhs.pos_;
+  }
+
+  friend bool operator!=(const CheckedIter& lhs, const CheckedIter& rhs) {
+    return !(lhs == rhs);
+  }
+
+  friend bool operator<(const CheckedIter& lhs, const CheckedIter& rhs) {
+    return lhs.pos_ < rhs.pos_;
+  }
+
+  friend bool operator>(const CheckedIter& lhs, const CheckedIter& rhs) {
+    return rhs < lhs;
+  }
+
+  friend bool operator<=(const CheckedIter& lhs, const CheckedIter& rhs) {
+    return !(rhs < lhs);
+  }
+
+  friend bool operator>=(const CheckedIter& lhs, const CheckedIter& rhs) {
+    return !(lhs < rhs);
+  }
+
+  static int out_of_range;
+
+ private:
+  ptrdiff_t size_() const { return static_cast<ptrdiff_t>(base_->size()); }
+
+  static int dummy_;
+
+  std::vector<int>* base_ = nullptr;
+  ptrdiff_t pos_ = 0;
+};
+
+int CheckedIter::out_of_range = 0;
+int CheckedIter::dummy_ = 0;
+
+// Views every third element of a vector whose size isn't a multiple of
+// three, forward from its first element and backward from its last, so the
+// view ends on the vector's last or first element.  The algorithms that walk
+// such views by their stride must not step past either end on the way.
+void check_stride_ends(const ptrdiff_t n) {
+  if (n == 0) {
+    return;
+  }
+  auto values = random_ints(3 * n - 2, 1000);
+  const auto run = [&](const char* const name, const ptrdiff_t start,
+                       const ptrdiff_t stride) {
+    const auto projection = jz::make_stride_projection(stride);
+    const auto first =
+        make_projection_iterator(CheckedIter(values, start), projection);
+    CheckedIter::out_of_range = 0;
+    for (const auto value : {first[n - 1], first[0], -1}) {
+      check(jz::find(first, first + n, value) ==
+                std::find(first, first + n, value),
+            "jz::find", name, n);
+    }
+    check(CheckedIter::out_of_range == 0, "jz::find within the base", name,
+          n);
+  };
+  run("stride 3 to the end", 0, 3);
+  run("stride -3 to the start", 3 * n - 3, -3);
+}
+
+// Copies views of every stride'th element of a vector whose size isn't a
+// multiple of stride, forward from its first element and backward from its
+// last, from the view and into it.  Strides of 2 take the SIMD kernels where
+// there are any, and 3 the scalar loops, except for gathers of 64-bit
+// elements.
+template <typename T>
+void check_strided_copies(const ptrdiff_t n, const ptrdiff_t stride) {
+  if (n == 0) {
+    return;
+  }
+  const auto size = stride * (n - 1) + 1;
+  const auto ints = random_ints(size, 1000);
+  const auto values = std::vector<T>(ints.begin(), ints.end());
+  const auto source_ints = random_ints(n, 1000);
+  const auto source = std::vector<T>(source_ints.begin(), source_ints.end());
+  const auto run = [&](const char* const name, const ptrdiff_t start,
+                       const ptrdiff_t step) {
+    const auto projection = jz::make_stride_projection(step);
+    const auto what = [step](const char* const algorithm) {
+      return std::string(algorithm) + " at stride " + std::to_string(step) +
+             ", " + std::to_string(sizeof(T) * 8) + "-bit";
+    };
+
+    auto base = values;
+    const auto view = make_projection_iterator(base.data() + start, projection);
+    const auto expected = std::vector<T>(view, view + n);
+    auto actual = std::vector<T>(static_cast<std::size_t>(n));
+    jz::projected_copy(view, view + n, actual.begin());
+    check(actual == expected, what("projected_copy from a view"), name, n);
+
+    auto expected_base = values;
+    std::copy(source.begin(), source.end(),
+              make_projection_iterator(expected_base.data() + start,
+                                       projection));
+    auto actual_base = values;
+    jz::projected_copy(source.begin(), source.end(),
+                       make_projection_iterator(actual_base.data() + start,
+                                                projection));
+    check(actual_base == expected_base, what("projected_copy into a view"),
+          name, n);
+  };
+  run("stride to the end", 0, stride);
+  run("stride to the start", size - 1, -stride);
+}
+
+// Streams copies into folded interleave views of T, whose segments take
+// every other element of the base forward and backward, so that staging a
+// block reads runs to both ends of the base.
+template <typename T>
+void check_streaming_copies(const ptrdiff_t n) {
+  const auto ints = random_ints(n, 1000);
+  const auto values = std::vector<T>(ints.begin(), ints.end());
+  const auto source_ints = random_ints(n, 1000);
+  const auto source = std::vector<T>(source_ints.begin(), source_ints.end());
+  const auto run = [&](const char* const name, const auto& projection) {
+    auto expected = values;
+    std::copy(source.begin(), source.end(),
+              make_projection_iterator(expected.data(), projection));
+    auto actual = values;
+    const auto out = make_projection_iterator(actual.data(), projection);
+    const auto end =
+        jz::projected_copy_streaming(source.data(), source.data() + n, out);
+    check(actual == expected && end == out + n,
+          "projected_copy_streaming, " + std::to_string(sizeof(T) * 8) +
+              "-bit",
+          name, n);
+  };
+  run("folded", jz::make_folded_interleave_projection(n));
+  run("reverse of folded",
+      jz::compose(jz::make_reverse_projection(n),
+                  jz::make_folded_interleave_projection(n)));
+}
+
+struct CheckProjection {
+  template <typename Proj>
+  void operator()(const char* const name, const ptrdiff_t base_size,
+                  const Proj& projection) const {
+    check_segments(name, base_size, projection, n,
+                   std::integral_constant<
+                       bool, jz::has_affine_segments<Proj>::value>{});
+    check_for_each(name, base_size, projection, n);
+    check_sorts(name, base_size, projection, n);
+    check_stable_sorts(name, base_size, projection, n);
+    check_merges(name, base_size, projection, n);
+    check_inverses(name, base_size, projection, n,
+                   std::integral_constant<
+                       bool, jz::has_inverse_projection<Proj>::value>{});
+    check_resorts(name, base_size, projection, n,
+                  std::integral_constant<
+                      bool, jz::has_inverse_projection<Proj>::value>{});
+    check_applies(name, base_size, projection, n);
+    check_cached_walk(name, base_size, projection, n,
+                      std::integral_constant<
+                          bool, jz::has_affine_segments<Proj>::value>{});
+    check_prefetching_walk(name, base_size, projection, n);
+    check_copies(name, base_size, projection, n);
+    check_views(name, base_size, projection, n);
+    check_stacked_views(name, base_size, projection, n);
+    check_lists(name, base_size, projection, n);
+    check_deques(name, base_size, projection, n);
+    check_algorithms(name, base_size, projection, n);
+  }
+
+  ptrdiff_t n;
+};
+
+// The algorithms also take plain ranges.
+void check_plain_ranges(const ptrdiff_t n) {
+  const auto values = random_ints(n, static_cast<int>(n / 2 + 1));
+  auto expected = values;
+  std::sort(expected.begin(), expected.end());
+
+  auto actual = values;
+  jz::projected_sort(actual.begin(), actual.end());
+  check(actual == expected, "projected_sort", "plain", n);
+  actual = values;
+  jz::projected_radix_sort(actual.begin(), actual.end());
+  check(actual == expected, "projected_radix_sort", "plain", n);
+
+  auto dirty = std::vector<ptrdiff_t>{};
+  actual = expected;
+  for (auto k = ptrdiff_t{0}; k < n; k += 7) {
+    actual[k] = static_cast<int>(n - k);
+    dirty.push_back(k);
+  }
+  auto resorted = actual;
+  std::sort(resorted.begin(), resorted.end());
+  jz::projected_resort(actual.begin(), actual.end(), dirty.begin(),
+                       dirty.end());
+  check(actual == resorted, "projected_resort", "plain", n);
+}
+
+// The folded interleave projection is branch-free, but must still match the
+// branchy definition it replaced.
+void check_folded_projection(const ptrdiff_t n) {
+  const auto projection = jz::make_folded_interleave_projection(n);
+  auto ok = true;
+  for (auto i = ptrdiff_t{0}; i < n; ++i) {
+    const auto index2 = 2 * i;
+    ok = ok && projection(i) == (index2 >= n ? 2 * n - index2 - 1 : index2);
+  }
+  check(ok, "folded interleave projection", "folded", n);
+}
+
+// folded_interleave_sort() lays a plain range out as std::sort through a
+// folded interleave view would.
+void check_folded_interleave_sorts(const ptrdiff_t n) {
+  const auto values = random_ints(n, static_cast<int>(n / 2 + 1));
+  const auto expected = std_sorted<false>(
+      values, jz::make_folded_interleave_projection(n), n, std::greater<>{});
+  const auto run = [&](const char* const what, auto sort) {
+    auto actual = values;
+    sort(actual.begin(), actual.end());
+    check(actual == expected, what, "folded", n);
+  };
+
+  run("folded_interleave_sort", [](auto first, auto last) {
+    jz::folded_interleave_sort(first, last, std::greater<>{});
+  });
+  run("folded_interleave_sort with scratch", [](auto first, auto last) {
+    auto scratch = std::vector<int>{};
+    jz::folded_interleave_sort(first, last, std::greater<>{}, scratch);
+  });
+#if __cplusplus >= 201703L
+  run("folded_interleave_sort with arena", [](auto first, auto last) {
+    jz::folded_interleave_sort(first, last, std::greater<>{},
+                               jz::thread_scratch_arena());
+  });
+#endif
+}
+
+// Checks the trailing-zero count that projected_copy_streaming() uses to find
+// unfilled slots, for each bit alone and with every higher bit set.
+void check_trailing_zeros() {
+  auto ok = true;
+  for (auto bit = 0; bit < 64; ++bit) {
+    const auto word = std::uint64_t{1} << bit;
+    ok = ok && jz::detail::count_trailing_zeros(word) == bit &&
+         jz::detail::count_trailing_zeros(~(word - 1)) == bit;
+  }
+  check(ok, "count_trailing_zeros", "bits", 64);
+}
+
+// Counts accesses only when JZ_PROJECTION_STATS is defined, and otherwise
+// leaves the counts at zero.
+void check_stats(const ptrdiff_t n) {
+#ifdef JZ_PROJECTION_STATS
+  const auto expected = static_cast<std::uint64_t>(n);
+#else
+  const auto expected = std::uint64_t{0};
+#endif
+  auto values = random_ints(3 * n, 1000);
+  const auto first =
+      make_projection_iterator(values.data(), jz::make_stride_projection(3));
+  auto copy = std::vector<int>(static_cast<std::size_t>(n));
+  jz::reset_projection_stats();
+  std::copy(first, first + n, copy.begin());
+  const auto stats = jz::thread_projection_stats();
+  check(stats.dereferences == expected && stats.projection_calls == expected,
+        "projection stats", "stride", n);
+}
+
+// Sorts a memory-mapped file through a view, and maps it again read-only to
+// read the result back.
+void check_mmap_arrays(const ptrdiff_t n) {
+  char path[] = "/tmp/projection_iterator_test.XXXXXX";
+  const auto fd = ::mkstemp(path);
+  if (fd < 0) {
+    check(false, "mkstemp", "mmap", n);
+    return;
+  }
+  const auto values = random_ints(n, static_cast<int>(n / 2 + 1));
+  const auto bytes = values.size() * sizeof(int);
+  const auto written = ::write(fd, values.data(), bytes);
+  ::close(fd);
+
+  const auto projection = jz::make_folded_interleave_projection(n);
+  const auto expected =
+      std_sorted<false>(values, projection, n, std::less<>{});
+  {
+    const auto array = jz::MmapArray<int>(path);
+    array.advise_for(projection);
+    const auto first = make_projection_iterator(array.begin(), projection);
+    jz::projected_sort(first, first + n);
+    array.sync();
+  }
+  const auto array = jz::MmapArray<const int>(path);
+  check(static_cast<std::size_t>(written) == bytes &&
+            std::equal(array.begin(), array.end(), expected.begin(),
+                       expected.end()),
+        "projected_sort of an MmapArray", "folded", n);
+  ::unlink(path);
+}
+
+// Checks that TableProjectionCache reuses a table for the same projection and
+// size, and keeps apart projections of one type and size with different state
+// when keyed apart.
+void check_table_cache() {
+  const auto n = ptrdiff_t{16};
+  jz::TableProjectionCache cache;
+  // Returns where the table lives, and what it holds.
+  const auto describe = [](const auto& table) {
+    return std::make_pair(
+        static_cast<const void*>(table.data()),
+        std::vector<ptrdiff_t>(table.data(), table.data() + n));
+  };
+  const auto table_of = [&](const auto& projection, const std::uint64_t key) {
+    return cache.visit_keyed(projection, key, n, describe);
+  };
+  const auto expect = [](const auto& projection) {
+    auto indices = std::vector<ptrdiff_t>(static_cast<std::size_t>(n));
+    for (auto i = ptrdiff_t{0}; i < n; ++i) {
+      indices[i] = projection(i);
+    }
+    return indices;
+  };
+
+  const auto folded = jz::make_folded_interleave_projection(n);
+  const auto first = cache.visit(folded, n, describe);
+  const auto again = cache.visit(folded, n, describe);
+  check(again.first == first.first && again.second == expect(folded),
+        "TableProjectionCache hit", "folded", n);
+
+  const auto wide = jz::make_transposition_projection(2, 8);
+  const auto square = jz::make_transposition_projection(4, 4);
+  const auto wide_table = table_of(wide, 2);
+  const auto square_table = table_of(square, 4);
+  check(wide_table.second == expect(wide) &&
+            square_table.second == expect(square),
+        "TableProjectionCache keys", "transposition", n);
+
+  const auto make_shards = [](const ptrdiff_t seed) {
+    return [seed](const ptrdiff_t index) { return index * seed % n; };
+  };
+  const auto shards3 = make_shards(3);
+  const auto shards5 = make_shards(5);
+  const auto table3 = table_of(shards3, 3);
+  const auto table5 = table_of(shards5, 5);
+  check(table3.second == expect(shards3) && table5.second == expect(shards5),
+        "TableProjectionCache keys", "seeded lambda", n);
+  check(table_of(shards3, 3).first == table3.first,
+        "TableProjectionCache hit", "seeded lambda", n);
+}
+
+// Pins the advice for each kind of projection.  Only walks that move forward
+// through the whole file read ahead sequentially.
+void check_mmap_advice() {
+  const auto run = [](const char* const name, const auto& projection,
+                      const jz::MmapAdvice expected) {
+    check(jz::mmap_advice_for(projection) == expected, "mmap_advice_for",
+          name, ptrdiff_t{0});
+  };
+  constexpr auto kSequential = jz::MmapAdvice::kSequential;
+  constexpr auto kNormal = jz::MmapAdvice::kNormal;
+  constexpr auto kRandom = jz::MmapAdvice::kRandom;
+
+  const auto stride = jz::make_stride_projection(3);
+  run("stride", stride, kSequential);
+  run("stride by reference", jz::proj_ref(stride), kSequential);
+  run("negative stride", jz::make_stride_projection(-3), kNormal);
+  run("stride<2>", jz::StrideProjection<2>{}, kSequential);
+  run("affine", jz::make_affine_projection(5, 2), kSequential);
+  run("negative affine", jz::make_affine_projection(5, -1), kNormal);
+  run("invertible stride",
+      jz::make_invertible_projection(
+          jz::StrideProjection<3>{},
+          [](const ptrdiff_t base_index) { return base_index / 3; }),
+      kSequential);
+  run("stride of invertible stride",
+      jz::compose(jz::make_stride_projection(2),
+                  jz::make_invertible_projection(
+                      jz::StrideProjection<3>{},
+                      [](const ptrdiff_t base_index) {
+                        return base_index / 3;
+                      })),
+      kSequential);
+
+  run("reverse", jz::make_reverse_projection(64), kNormal);
+  run("folded", jz::make_folded_interleave_projection(64), kNormal);
+  run("block interleave", jz::make_block_interleave_projection<2>(64),
+      kNormal);
+  run("bit reverse", jz::make_bit_reverse_projection(64), kNormal);
+  run("transposition", jz::make_transposition_projection(8, 8), kNormal);
+  run("tiled", jz::make_tiled_projection(8, 8, 4, 4), kNormal);
+  run("morton", jz::make_morton_projection(8, 8), kNormal);
+  run("hilbert", jz::make_hilbert_projection(8, 8), kNormal);
+  run("stride of tiled",
+      jz::compose(jz::make_stride_projection(2),
+                  jz::make_tiled_projection(8, 8, 4, 4)),
+      kNormal);
+
+  const auto table = jz::make_table_projection<std::uint32_t>(
+      [](const ptrdiff_t index) { return index; }, 64);
+  run("table", table, kRandom);
+  run("table by reference", jz::proj_ref(table), kRandom);
+}
+
+// Sorts many short views, of every size up to past the sorting networks'
+// limit, through the lane-parallel path for arithmetic values with
+// std::less and std::greater, and the one-at-a-time path otherwise.
+template <typename Compare>
+void check_batch_sorts(const char* const name, Compare comp) {
+  auto views = std::vector<std::vector<int>>{};
+  for (auto n = ptrdiff_t{0}; n <= jz::kMaxBatchNetworkSize + 3; ++n) {
+    for (auto copies = 0; copies < 20; ++copies) {
+      views.push_back(random_ints(n, static_cast<int>(n / 2 + 1)));
+    }
+  }
+  std::shuffle(views.begin(), views.end(), rng);
+  const auto make_projection = [](const ptrdiff_t n) {
+    return jz::make_folded_interleave_projection(n);
+  };
+
+  auto expected = views;
+  for (auto& view : expected) {
+    const auto n = static_cast<ptrdiff_t>(view.size());
+    view = std_sorted<false>(view, make_projection(n), n, comp);
+  }
+  const auto run = [&](const char* const what, auto sort) {
+    auto actual = views;
+    sort(actual.begin(), actual.end());
+    check(actual == expected, what, name, ptrdiff_t{0});
+  };
+
+  run("batch_projected_sort", [&](auto first, auto last) {
+    jz::batch_projected_sort(first, last, make_projection, comp);
+  });
+#if __cplusplus >= 201703L
+  run("batch_projected_sort with arena", [&](auto first, auto last) {
+    jz::batch_projected_sort(first, last, make_projection, comp,
+                             jz::thread_scratch_arena());
+  });
+#endif
+#ifdef JZ_PROJECTED_ALGORITHMS_HAS_EXECUTION
+  run("batch_projected_sort(par)", [&](auto first, auto last) {
+    jz::batch_projected_sort(std::execution::par, first, last,
+                             make_projection, comp);
+  });
+#endif
+}
+
+#ifdef JZ_PROJECTED_ALGORITHMS_HAS_EXECUTION
+// The parallel sorts only split views large enough to share out.
+void check_large_parallel_sorts() {
+  constexpr auto n = ptrdiff_t{1} << 17;
+  const auto projection = jz::make_folded_interleave_projection(n);
+  auto values = random_pairs(n);
+  const auto expected = std_sorted<true>(values, projection, n, by_key);
+  const auto first = make_projection_iterator(values.begin(), projection);
+  jz::projected_stable_sort(std::execution::par, first, first + n, by_key);
+  check(values == expected, "projected_stable_sort(par)", "folded", n);
+}
+#endif
+
+}  // namespace
+
+int main() {
+  for (const auto n : kSizes) {
+    for_each_projection(n, CheckProjection{n});
+    check_plain_ranges(n);
+    check_folded_projection(n);
+    check_folded_interleave_sorts(n);
+    check_stats(n);
+    check_mmap_arrays(n);
+    check_stride_ends(n);
+    check_strided_copies<int>(n, 2);
+    check_strided_copies<int>(n, 3);
+    check_strided_copies<std::int64_t>(n, 2);
+    check_strided_copies<std::int64_t>(n, 3);
+    check_streaming_copies<int>(n);
+    check_streaming_copies<std::int64_t>(n);
+  }
+  check_trailing_zeros();
+  check_table_cache();
+  check_mmap_advice();
+  check_batch_sorts("folded, std::less", std::less<>{});
+  check_batch_sorts("folded, std::greater", std::greater<>{});
+  check_batch_sorts("folded, lambda", [](const int lhs, const int rhs) {
+    return lhs < rhs;
+  });
+#ifdef JZ_PROJECTED_ALGORITHMS_HAS_EXECUTION
+  check_large_parallel_sorts();
+#endif
+
+  if (failures != 0) {
+    std::fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  std::printf("All checks passed\n");
+  return 0;
+}
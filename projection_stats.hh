@@ -0,0 +1,244 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+#ifndef PROJECTION_STATS_HH_
+#define PROJECTION_STATS_HH_
+
+static_assert(__cplusplus >= 201402L, "Requires C++14 or newer.");
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Counts how ProjIter and ProjectedView access their elements, to show how
+// much projection work an algorithm does and how scattered its accesses are.
+// Counting is compiled out unless JZ_PROJECTION_STATS is defined, which the
+// JZ_PROJECTION_STATS CMake option does for every target.  Define it for the
+// whole program or not at all, since it changes how the iterators compile.
+//
+// Each thread counts into its own record, so counting takes no locks or
+// atomic read-modify-writes on the hot path.  To compare an in-place sort
+// with a gathering one, for example:
+//
+//     jz::reset_projection_stats();
+//     std::sort(first, last);
+//     std::cout << jz::thread_projection_stats() << '\n';
+//
+// Without JZ_PROJECTION_STATS, these functions still work, but every count
+// stays zero.
+namespace jz {
+
+// Counts of element accesses through projections.
+struct ProjectionStats {
+  // Elements accessed through ProjIter or ProjectedView.
+  std::uint64_t dereferences = 0;
+  // Evaluations of a projection, or of its segment(), for an access.  Segment
+  // walks, as in projected_for_each(), evaluate once per segment.
+  std::uint64_t projection_calls = 0;
+  // Total steps std::advance took for bases that aren't contiguous.
+  std::uint64_t advance_distance = 0;
+  // Dereferences that landed in a different 64-byte line from the thread's
+  // previous one.
+  std::uint64_t line_transitions = 0;
+
+  ProjectionStats& operator+=(const ProjectionStats& rhs) noexcept {
+    dereferences     += rhs.dereferences;
+    projection_calls += rhs.projection_calls;
+    advance_distance += rhs.advance_distance;
+    line_transitions += rhs.line_transitions;
+    return *this;
+  }
+};
+
+inline std::ostream& operator<<(
+    std::ostream& out, const ProjectionStats& stats) {
+  return out << "dereferences=" << stats.dereferences
+             << " projection_calls=" << stats.projection_calls
+             << " advance_distance=" << stats.advance_distance
+             << " line_transitions=" << stats.line_transitions;
+}
+
+namespace detail {
+
+class ProjectionStatsRecord;
+
+// Tracks the live threads' records, and the totals of threads that exited.
+class ProjectionStatsRegistry {
+ public:
+  static ProjectionStatsRegistry& instance() {
+    static ProjectionStatsRegistry registry;
+    return registry;
+  }
+
+  void add(const ProjectionStatsRecord* record) {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    records_.push_back(record);
+  }
+
+  void retire(const ProjectionStatsRecord* record,
+              const ProjectionStats& stats) {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    records_.erase(std::find(records_.begin(), records_.end(), record));
+    retired_ += stats;
+  }
+
+  // Calls fn(record) on each live thread's record, and returns the totals of
+  // threads that exited.
+  template <typename Fn>
+  ProjectionStats visit(Fn fn) const {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    for (const auto record : records_) {
+      fn(*record);
+    }
+    return retired_;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::vector<const ProjectionStatsRecord*> records_;
+  ProjectionStats retired_;
+};
+
+// A thread's counters.  Only the owning thread writes them, so it updates
+// them with relaxed loads and stores rather than atomic increments, and
+// other threads can still read them safely.
+class ProjectionStatsRecord {
+  using Counter = std::atomic<std::uint64_t>;
+
+ public:
+  ProjectionStatsRecord() : thread_{std::this_thread::get_id()} {
+    ProjectionStatsRegistry::instance().add(this);
+  }
+
+  ~ProjectionStatsRecord() {
+    ProjectionStatsRegistry::instance().retire(this, stats());
+  }
+
+  ProjectionStatsRecord(const ProjectionStatsRecord&) = delete;
+  ProjectionStatsRecord& operator=(const ProjectionStatsRecord&) = delete;
+
+  void note_dereference(const void* const address) noexcept {
+    bump_(dereferences_, 1);
+    if (address) {
+      const auto line = reinterpret_cast<std::uintptr_t>(address) >> 6;
+      if (line != last_line_) {
+        bump_(line_transitions_, 1);
+        last_line_ = line;
+      }
+    }
+  }
+
+  void note_projection_call() noexcept { bump_(projection_calls_, 1); }
+
+  void note_advance(const std::ptrdiff_t distance) noexcept {
+    bump_(advance_distance_,
+          static_cast<std::uint64_t>(distance < 0 ? -distance : distance));
+  }
+
+  ProjectionStats stats() const noexcept {
+    auto stats = ProjectionStats{};
+    stats.dereferences     = dereferences_.load(std::memory_order_relaxed);
+    stats.projection_calls = projection_calls_.load(std::memory_order_relaxed);
+    stats.advance_distance = advance_distance_.load(std::memory_order_relaxed);
+    stats.line_transitions = line_transitions_.load(std::memory_order_relaxed);
+    return stats;
+  }
+
+  void reset() noexcept {
+    dereferences_.store(0, std::memory_order_relaxed);
+    projection_calls_.store(0, std::memory_order_relaxed);
+    advance_distance_.store(0, std::memory_order_relaxed);
+    line_transitions_.store(0, std::memory_order_relaxed);
+    last_line_ = 0;
+  }
+
+  std::thread::id thread() const noexcept { return thread_; }
+
+ private:
+  Counter dereferences_{0};
+  Counter projection_calls_{0};
+  Counter advance_distance_{0};
+  Counter line_transitions_{0};
+  std::uintptr_t last_line_ = 0;
+  std::thread::id thread_;
+
+  static void bump_(Counter& counter, const std::uint64_t delta) noexcept {
+    counter.store(counter.load(std::memory_order_relaxed) + delta,
+                  std::memory_order_relaxed);
+  }
+};
+
+// Returns the calling thread's record, registering it on first use.
+inline ProjectionStatsRecord& projection_stats_record() {
+  thread_local ProjectionStatsRecord record;
+  return record;
+}
+
+#ifdef JZ_PROJECTION_STATS
+// The hooks ProjIter and ProjectedView call.  Each passes its argument
+// through, so that it can wrap an expression in place.  projection_iterator.hh
+// defines no-op versions when JZ_PROJECTION_STATS is not defined.
+template <typename Ref>
+Ref note_dereference(Ref elem) noexcept {
+  projection_stats_record().note_dereference(
+      std::is_lvalue_reference<Ref>::value ? std::addressof(elem) : nullptr);
+  return static_cast<Ref>(elem);
+}
+
+template <typename T>
+T note_projection_call(T value) noexcept {
+  projection_stats_record().note_projection_call();
+  return value;
+}
+
+inline std::ptrdiff_t note_advance(const std::ptrdiff_t distance) noexcept {
+  projection_stats_record().note_advance(distance);
+  return distance;
+}
+#endif
+
+}  // namespace detail
+
+// Returns the calling thread's counts.
+inline ProjectionStats thread_projection_stats() {
+  return detail::projection_stats_record().stats();
+}
+
+// Zeroes the calling thread's counts.
+inline void reset_projection_stats() {
+  detail::projection_stats_record().reset();
+}
+
+// Returns the counts summed over every thread, including threads that have
+// exited.  Other threads' counts may lag behind while they're running.
+inline ProjectionStats total_projection_stats() {
+  auto total = ProjectionStats{};
+  total += detail::ProjectionStatsRegistry::instance().visit(
+      [&total](const detail::ProjectionStatsRecord& record) {
+        total += record.stats();
+      });
+  return total;
+}
+
+// Writes a line of counts for each live thread that has used the counters,
+// followed by the total over every thread.
+inline void dump_projection_stats(std::ostream& out) {
+  auto total = ProjectionStats{};
+  total += detail::ProjectionStatsRegistry::instance().visit(
+      [&out, &total](const detail::ProjectionStatsRecord& record) {
+        const auto stats = record.stats();
+        total += stats;
+        out << "thread " << record.thread() << ": " << stats << '\n';
+      });
+  out << "total: " << total << '\n';
+}
+
+}  // namespace jz
+
+#endif // PROJECTION_STATS_HH_
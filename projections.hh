@@ -0,0 +1,791 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+#ifndef PROJECTIONS_HH_
+#define PROJECTIONS_HH_
+
+static_assert(__cplusplus >= 201402L, "Requires C++14 or newer.");
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include "projection_iterator.hh"
+
+namespace jz {
+
+// Common projections for use with ProjIter.
+//
+// Each projection takes its size (or other shape parameter) either as a
+// template argument or, when that argument is dynamic_size, as a constructor
+// argument.  With compile-time shapes every member is a constant expression,
+// so the compiler can fold the projection's arithmetic and branches, and
+// fully unroll loops over small fixed-size views.
+//
+// Projections that are piecewise affine describe their pieces via segment(),
+// so that in-order walks such as projected_for_each() can strength-reduce
+// sequential access (see has_affine_segments in projection_iterator.hh).
+// Projections that are one-to-one map base indices back to view indices via
+// inverse() (see has_inverse_projection).
+
+// Marks a shape parameter as supplied at run time.  No size or stride can
+// take this value, so that negative compile-time strides stay available.
+constexpr std::ptrdiff_t dynamic_size =
+    std::numeric_limits<std::ptrdiff_t>::min();
+
+namespace detail {
+
+// Holds one shape parameter for a projection, either as a compile-time
+// constant or as a member.  Tag distinguishes multiple parameters within the
+// same projection.
+template <std::ptrdiff_t N, int Tag = 0>
+class ShapeParam {
+ public:
+  constexpr ShapeParam() noexcept = default;
+
+  static constexpr std::ptrdiff_t get() noexcept { return N; }
+};
+
+template <int Tag>
+class ShapeParam<dynamic_size, Tag> {
+ public:
+  explicit constexpr ShapeParam(const std::ptrdiff_t value) noexcept
+  : value_{value} {}
+
+  constexpr std::ptrdiff_t get() const noexcept { return value_; }
+
+ private:
+  std::ptrdiff_t value_;
+};
+
+// Returns log2 of n, which must be a power of two.
+constexpr int log2_pow2(const std::ptrdiff_t n) noexcept {
+#if defined(__GNUC__)
+  return __builtin_ctzll(static_cast<unsigned long long>(n));
+#else
+  auto bits = 0;
+  while ((std::ptrdiff_t{1} << bits) < n) {
+    ++bits;
+  }
+  return bits;
+#endif
+}
+
+// Holds log2 of a power-of-two size, so projections that shift by it don't
+// recompute it on every call.  Like ShapeParam, it's a constant for
+// compile-time sizes, and otherwise works it out once on construction.
+// Sizes below 2 have no bits.
+template <std::ptrdiff_t Size>
+class Log2SizeParam {
+ public:
+  constexpr Log2SizeParam() noexcept = default;
+
+  explicit constexpr Log2SizeParam(std::ptrdiff_t) noexcept {}
+
+  static constexpr int get() noexcept {
+    return Size > 1 ? log2_pow2(Size) : 0;
+  }
+};
+
+template <>
+class Log2SizeParam<dynamic_size> {
+ public:
+  explicit constexpr Log2SizeParam(const std::ptrdiff_t size) noexcept
+  : value_{size > 1 ? log2_pow2(size) : 0} {}
+
+  constexpr int get() const noexcept { return value_; }
+
+ private:
+  int value_;
+};
+
+}  // namespace detail
+
+// Views every stride'th element: 0, stride, 2 * stride, ....
+template <std::ptrdiff_t Stride = dynamic_size>
+class StrideProjection : private detail::ShapeParam<Stride> {
+  using StrideParam = detail::ShapeParam<Stride>;
+
+ public:
+  constexpr StrideProjection() noexcept = default;
+
+  explicit constexpr StrideProjection(const std::ptrdiff_t stride) noexcept
+  : StrideParam{stride} {}
+
+  constexpr std::ptrdiff_t stride() const noexcept {
+    return StrideParam::get();
+  }
+
+  constexpr std::ptrdiff_t operator()(const std::ptrdiff_t index)
+      const noexcept {
+    return stride() * index;
+  }
+
+  constexpr AffineSegment segment(std::ptrdiff_t) const noexcept {
+    return AffineSegment{
+        0, std::numeric_limits<std::ptrdiff_t>::max(), 0, stride()};
+  }
+
+  constexpr std::ptrdiff_t inverse(const std::ptrdiff_t base_index)
+      const noexcept {
+    return base_index / stride();
+  }
+};
+
+// Views every stride'th element starting from offset: offset,
+// offset + stride, offset + 2 * stride, ....  This is the general affine
+// projection, which compose() produces when it fuses other affine projections.
+class AffineProjection {
+ public:
+  constexpr AffineProjection(
+      const std::ptrdiff_t offset, const std::ptrdiff_t stride) noexcept
+  : offset_{offset}, stride_{stride} {}
+
+  constexpr std::ptrdiff_t offset() const noexcept { return offset_; }
+  constexpr std::ptrdiff_t stride() const noexcept { return stride_; }
+
+  constexpr std::ptrdiff_t operator()(const std::ptrdiff_t index)
+      const noexcept {
+    return offset_ + stride_ * index;
+  }
+
+  constexpr AffineSegment segment(std::ptrdiff_t) const noexcept {
+    return AffineSegment{
+        0, std::numeric_limits<std::ptrdiff_t>::max(), offset_, stride_};
+  }
+
+  constexpr std::ptrdiff_t inverse(const std::ptrdiff_t base_index)
+      const noexcept {
+    return (base_index - offset_) / stride_;
+  }
+
+ private:
+  std::ptrdiff_t offset_;
+  std::ptrdiff_t stride_;
+};
+
+// Views a container of the given size back to front.
+template <std::ptrdiff_t Size = dynamic_size>
+class ReverseProjection : private detail::ShapeParam<Size> {
+  using SizeParam = detail::ShapeParam<Size>;
+
+ public:
+  constexpr ReverseProjection() noexcept = default;
+
+  explicit constexpr ReverseProjection(const std::ptrdiff_t size) noexcept
+  : SizeParam{size} {}
+
+  constexpr std::ptrdiff_t size() const noexcept { return SizeParam::get(); }
+
+  constexpr std::ptrdiff_t operator()(const std::ptrdiff_t index)
+      const noexcept {
+    return size() - 1 - index;
+  }
+
+  constexpr AffineSegment segment(std::ptrdiff_t) const noexcept {
+    return AffineSegment{0, size(), size() - 1, -1};
+  }
+
+  constexpr std::ptrdiff_t inverse(const std::ptrdiff_t base_index)
+      const noexcept {
+    return size() - 1 - base_index;
+  }
+};
+
+// Views a container of the given size such that this view through the
+// projection:
+//
+//      0, 1, 2, 3, 4, 5, 6, 7, 8, 9
+//
+// is laid out in memory as:
+//
+//      0, 9, 1, 8, 2, 7, 3, 6, 4, 5
+//
+// The front half of the view walks the even positions forward, and the back
+// half walks the odd positions backward.
+template <std::ptrdiff_t Size = dynamic_size>
+class FoldedInterleaveProjection : private detail::ShapeParam<Size> {
+  using SizeParam = detail::ShapeParam<Size>;
+
+ public:
+  constexpr FoldedInterleaveProjection() noexcept = default;
+
+  explicit constexpr FoldedInterleaveProjection(
+      const std::ptrdiff_t size) noexcept
+  : SizeParam{size} {}
+
+  constexpr std::ptrdiff_t size() const noexcept { return SizeParam::get(); }
+
+  // This is written branch-free.  Algorithms such as std::sort probe both
+  // halves of the view unpredictably, and a branch on which half an index
+  // falls in mispredicts about half the time there.
+  constexpr std::ptrdiff_t operator()(const std::ptrdiff_t index)
+      const noexcept {
+    const auto index2 = 2 * index;
+    const auto back_mask = -static_cast<std::ptrdiff_t>(index2 >= size());
+    return index2 + (back_mask & (2 * size() - 1 - 2 * index2));
+  }
+
+  constexpr AffineSegment segment(const std::ptrdiff_t index) const noexcept {
+    return 2 * index >= size()
+        ? AffineSegment{(size() + 1) / 2, size(), 2 * size() - 1, -2}
+        : AffineSegment{0, (size() + 1) / 2, 0, 2};
+  }
+
+  // Even positions hold the front half of the view, and odd positions the
+  // back half in reverse.
+  constexpr std::ptrdiff_t inverse(const std::ptrdiff_t base_index)
+      const noexcept {
+    const auto half = base_index / 2;
+    const auto odd_mask = -(base_index & 1);
+    return half + (odd_mask & (size() - 1 - 2 * half));
+  }
+};
+
+// Views a container of the given size such that the front and back halves of
+// the view alternate in memory in blocks of Block elements.  With Block = 1,
+// this is a perfect shuffle: the front half of the view lands in the even
+// positions and the back half in the odd positions.  With Block = 2:
+//
+//      0, 1, 2, 3, 4, 5, 6, 7
+//
+// is laid out in memory as:
+//
+//      0, 1, 4, 5, 2, 3, 6, 7
+//
+// The size must be a multiple of 2 * Block.
+template <std::ptrdiff_t Block, std::ptrdiff_t Size = dynamic_size>
+class BlockInterleaveProjection : private detail::ShapeParam<Size> {
+  using SizeParam = detail::ShapeParam<Size>;
+
+  static_assert(Block > 0, "Block size must be positive.");
+
+ public:
+  constexpr BlockInterleaveProjection() noexcept = default;
+
+  explicit constexpr BlockInterleaveProjection(
+      const std::ptrdiff_t size) noexcept
+  : SizeParam{size} {}
+
+  constexpr std::ptrdiff_t size() const noexcept { return SizeParam::get(); }
+
+  constexpr std::ptrdiff_t operator()(const std::ptrdiff_t index)
+      const noexcept {
+    const auto half  = size() / 2;
+    const auto back  = index >= half ? 1 : 0;
+    const auto local = index - back * half;
+    return (2 * (local / Block) + back) * Block + local % Block;
+  }
+
+  // Each block is a run of consecutive elements.
+  constexpr AffineSegment segment(const std::ptrdiff_t index) const noexcept {
+    const auto half  = size() / 2;
+    const auto local = index >= half ? index - half : index;
+    const auto first = index - local % Block;
+    return AffineSegment{first, first + Block, (*this)(first) - first, 1};
+  }
+
+  constexpr std::ptrdiff_t inverse(const std::ptrdiff_t base_index)
+      const noexcept {
+    const auto block = base_index / Block;
+    const auto local = block / 2 * Block + base_index % Block;
+    return local + block % 2 * (size() / 2);
+  }
+};
+
+// Views a container whose size is a power of two in bit-reversed index order,
+// as in the reordering step of a radix-2 FFT.  For size 8:
+//
+//      0, 1, 2, 3, 4, 5, 6, 7
+//
+// is laid out in memory as:
+//
+//      0, 4, 2, 6, 1, 5, 3, 7
+//
+// This has no affine runs worth describing, so it offers no segment().
+template <std::ptrdiff_t Size = dynamic_size>
+class BitReverseProjection
+    : private detail::ShapeParam<Size>, private detail::Log2SizeParam<Size> {
+  using SizeParam = detail::ShapeParam<Size>;
+  using Log2SizeParam = detail::Log2SizeParam<Size>;
+
+ public:
+  constexpr BitReverseProjection() noexcept = default;
+
+  explicit constexpr BitReverseProjection(const std::ptrdiff_t size) noexcept
+  : SizeParam{size}, Log2SizeParam{size} {}
+
+  constexpr std::ptrdiff_t size() const noexcept { return SizeParam::get(); }
+
+  constexpr std::ptrdiff_t operator()(const std::ptrdiff_t index)
+      const noexcept {
+    auto x = static_cast<std::uint64_t>(index);
+    x = ((x >> 1)  & 0x5555555555555555u) | ((x & 0x5555555555555555u) << 1);
+    x = ((x >> 2)  & 0x3333333333333333u) | ((x & 0x3333333333333333u) << 2);
+    x = ((x >> 4)  & 0x0F0F0F0F0F0F0F0Fu) | ((x & 0x0F0F0F0F0F0F0F0Fu) << 4);
+    x = ((x >> 8)  & 0x00FF00FF00FF00FFu) | ((x & 0x00FF00FF00FF00FFu) << 8);
+    x = ((x >> 16) & 0x0000FFFF0000FFFFu) | ((x & 0x0000FFFF0000FFFFu) << 16);
+    x = (x >> 32) | (x << 32);
+    return size() > 1 ? static_cast<std::ptrdiff_t>(x >> (64 - log2_size()))
+                      : 0;
+  }
+
+  // Bit reversal is its own inverse.
+  constexpr std::ptrdiff_t inverse(const std::ptrdiff_t base_index)
+      const noexcept {
+    return (*this)(base_index);
+  }
+
+ private:
+  constexpr int log2_size() const noexcept { return Log2SizeParam::get(); }
+};
+
+// Views a Rows x Cols row-major matrix in column-major order, i.e. as its
+// transpose.  For a 2 x 3 matrix:
+//
+//      0, 1, 2, 3, 4, 5
+//
+// is laid out in memory as:
+//
+//      0, 2, 4,
+//      1, 3, 5
+template <std::ptrdiff_t Rows = dynamic_size, std::ptrdiff_t Cols = dynamic_size>
+class TranspositionProjection
+    : private detail::ShapeParam<Rows, 0>, private detail::ShapeParam<Cols, 1> {
+  using RowsParam = detail::ShapeParam<Rows, 0>;
+  using ColsParam = detail::ShapeParam<Cols, 1>;
+
+ public:
+  constexpr TranspositionProjection() noexcept = default;
+
+  constexpr TranspositionProjection(
+      const std::ptrdiff_t rows, const std::ptrdiff_t cols) noexcept
+  : RowsParam{rows}, ColsParam{cols} {}
+
+  constexpr std::ptrdiff_t rows() const noexcept { return RowsParam::get(); }
+  constexpr std::ptrdiff_t cols() const noexcept { return ColsParam::get(); }
+  constexpr std::ptrdiff_t size() const noexcept { return rows() * cols(); }
+
+  constexpr std::ptrdiff_t operator()(const std::ptrdiff_t index)
+      const noexcept {
+    return index % rows() * cols() + index / rows();
+  }
+
+  // Each column of the matrix is a run with a stride of one row.
+  constexpr AffineSegment segment(const std::ptrdiff_t index) const noexcept {
+    const auto col = index / rows();
+    return AffineSegment{
+        col * rows(), (col + 1) * rows(), col - col * rows() * cols(), cols()};
+  }
+
+  constexpr std::ptrdiff_t inverse(const std::ptrdiff_t base_index)
+      const noexcept {
+    return base_index % cols() * rows() + base_index / cols();
+  }
+};
+
+// Pairs a projection with its inverse, given as a separate callable, so that
+// it provides inverse() (see has_inverse_projection).  This is for
+// projections, such as lambdas, that can't define it themselves:
+//
+//     auto rotate_by_3 = make_invertible_projection(
+//         [n](std::ptrdiff_t i) { return (i + 3) % n; },
+//         [n](std::ptrdiff_t b) { return (b + n - 3) % n; });
+//
+// The caller is responsible for inverse really being the inverse.
+// segment() and walk() pass through when the projection provides them.
+template <typename Proj, typename Inverse>
+class InvertibleProjection {
+ public:
+  constexpr InvertibleProjection(Proj projection, Inverse inverse) noexcept
+  : projection_{std::move(projection)}, inverse_{std::move(inverse)} {}
+
+  constexpr auto operator()(const std::ptrdiff_t index) const
+      -> decltype(std::declval<const Proj&>()(std::ptrdiff_t{})) {
+    return projection_(index);
+  }
+
+  template <typename P = Proj>
+  constexpr auto segment(const std::ptrdiff_t index) const
+      -> decltype(std::declval<const P&>().segment(index)) {
+    return projection_.segment(index);
+  }
+
+  template <typename Fn, typename P = Proj>
+  auto walk(const std::ptrdiff_t first, const std::ptrdiff_t last, Fn& fn) const
+      -> decltype(std::declval<const P&>().walk(first, last, fn)) {
+    return projection_.walk(first, last, fn);
+  }
+
+  constexpr auto inverse(const std::ptrdiff_t base_index) const
+      -> decltype(std::declval<const Inverse&>()(std::ptrdiff_t{})) {
+    return inverse_(base_index);
+  }
+
+ private:
+#if __cplusplus >= 202002L
+  [[no_unique_address]]
+#endif
+  Proj projection_;
+#if __cplusplus >= 202002L
+  [[no_unique_address]]
+#endif
+  Inverse inverse_;
+};
+
+// Provides argument deduction-friendly construction for the run-time sized
+// projections, in the same style as make_projection_iterator().  The
+// compile-time sized ones need no deduction, e.g. ReverseProjection<16>{}.
+constexpr inline AffineProjection make_affine_projection(
+    const std::ptrdiff_t offset, const std::ptrdiff_t stride) noexcept {
+  return AffineProjection(offset, stride);
+}
+
+constexpr inline StrideProjection<> make_stride_projection(
+    const std::ptrdiff_t stride) noexcept {
+  return StrideProjection<>(stride);
+}
+
+constexpr inline ReverseProjection<> make_reverse_projection(
+    const std::ptrdiff_t size) noexcept {
+  return ReverseProjection<>(size);
+}
+
+constexpr inline FoldedInterleaveProjection<>
+make_folded_interleave_projection(const std::ptrdiff_t size) noexcept {
+  return FoldedInterleaveProjection<>(size);
+}
+
+template <std::ptrdiff_t Block>
+constexpr inline BlockInterleaveProjection<Block>
+make_block_interleave_projection(const std::ptrdiff_t size) noexcept {
+  return BlockInterleaveProjection<Block>(size);
+}
+
+constexpr inline BitReverseProjection<> make_bit_reverse_projection(
+    const std::ptrdiff_t size) noexcept {
+  return BitReverseProjection<>(size);
+}
+
+constexpr inline TranspositionProjection<> make_transposition_projection(
+    const std::ptrdiff_t rows, const std::ptrdiff_t cols) noexcept {
+  return TranspositionProjection<>(rows, cols);
+}
+
+template <typename Proj, typename Inverse>
+constexpr InvertibleProjection<Proj, Inverse> make_invertible_projection(
+    Proj projection, Inverse inverse) noexcept {
+  return InvertibleProjection<Proj, Inverse>(
+      std::move(projection), std::move(inverse));
+}
+
+// Indicates whether a projection is affine over every index, and so can fuse
+// with other affine projections in compose().
+template <typename Proj>
+struct is_affine_projection : std::false_type {};
+
+template <>
+struct is_affine_projection<AffineProjection> : std::true_type {};
+
+template <std::ptrdiff_t Stride>
+struct is_affine_projection<StrideProjection<Stride>> : std::true_type {};
+
+template <std::ptrdiff_t Size>
+struct is_affine_projection<ReverseProjection<Size>> : std::true_type {};
+
+// Indicates whether the view's size alone determines a projection of this
+// type, so that two such projections over views of the same size map indices
+// the same way.  That holds for stateless projections, and for those whose
+// only state is their size.  TableProjectionCache relies on this to key its
+// tables by type and size.
+template <typename Proj>
+struct is_size_determined_projection : std::is_empty<Proj> {};
+
+template <std::ptrdiff_t Size>
+struct is_size_determined_projection<ReverseProjection<Size>>
+    : std::true_type {};
+
+template <std::ptrdiff_t Size>
+struct is_size_determined_projection<FoldedInterleaveProjection<Size>>
+    : std::true_type {};
+
+template <std::ptrdiff_t Block, std::ptrdiff_t Size>
+struct is_size_determined_projection<BlockInterleaveProjection<Block, Size>>
+    : std::true_type {};
+
+template <std::ptrdiff_t Size>
+struct is_size_determined_projection<BitReverseProjection<Size>>
+    : std::true_type {};
+
+// Returns an affine projection's map as an AffineProjection.
+constexpr inline AffineProjection to_affine_projection(
+    const AffineProjection& projection) noexcept {
+  return projection;
+}
+
+template <std::ptrdiff_t Stride>
+constexpr AffineProjection to_affine_projection(
+    const StrideProjection<Stride>& projection) noexcept {
+  return AffineProjection(0, projection.stride());
+}
+
+template <std::ptrdiff_t Size>
+constexpr AffineProjection to_affine_projection(
+    const ReverseProjection<Size>& projection) noexcept {
+  return AffineProjection(projection.size() - 1, -1);
+}
+
+namespace detail {
+
+constexpr inline std::ptrdiff_t floor_div(
+    const std::ptrdiff_t num, const std::ptrdiff_t den) noexcept {
+  return num / den - (num % den != 0 && (num < 0) != (den < 0));
+}
+
+constexpr inline std::ptrdiff_t ceil_div(
+    const std::ptrdiff_t num, const std::ptrdiff_t den) noexcept {
+  return num / den + (num % den != 0 && (num < 0) == (den < 0));
+}
+
+// Returns the segment of outer composed with inner, given inner's segment
+// around an index, and outer's segment around that index's projection.  The
+// result is the part of inner's segment that projects into outer's.  A last
+// of PTRDIFF_MAX marks a segment without end.
+constexpr inline AffineSegment compose_segments(
+    const AffineSegment& outer, const AffineSegment& inner) noexcept {
+  constexpr auto kUnbounded = std::numeric_limits<std::ptrdiff_t>::max();
+  auto first = inner.first;
+  auto last = inner.last;
+  if (inner.stride > 0) {
+    first = std::max(first, ceil_div(outer.first - inner.offset, inner.stride));
+    if (outer.last != kUnbounded) {
+      last = std::min(
+          last, floor_div(outer.last - 1 - inner.offset, inner.stride) + 1);
+    }
+  } else if (inner.stride < 0) {
+    if (outer.last != kUnbounded) {
+      first = std::max(
+          first, ceil_div(outer.last - 1 - inner.offset, inner.stride));
+    }
+    last = std::min(
+        last, floor_div(outer.first - inner.offset, inner.stride) + 1);
+  }
+  return AffineSegment{first, last, outer.offset + outer.stride * inner.offset,
+                       outer.stride * inner.stride};
+}
+
+}  // namespace detail
+
+// Applies inner to the index, then outer to the result.  compose() builds
+// these for projections it can't fuse.
+//
+// When both projections are piecewise affine, so is the composition:
+// segment() clips inner's segment to the indices that land in one segment of
+// outer.  When outer can walk() and inner is piecewise affine, walk() hands
+// each ascending run of inner to outer's walk(); when only inner can walk(),
+// walk() applies outer along inner's walk.
+template <typename Outer, typename Inner>
+class ComposedProjection {
+ public:
+  constexpr ComposedProjection(Outer outer, Inner inner) noexcept
+  : outer_{std::move(outer)}, inner_{std::move(inner)} {}
+
+  constexpr const Outer& outer() const noexcept { return outer_; }
+  constexpr const Inner& inner() const noexcept { return inner_; }
+
+  constexpr auto operator()(const std::ptrdiff_t index) const
+      -> decltype(std::declval<const Outer&>()(std::ptrdiff_t{})) {
+    return outer_(static_cast<std::ptrdiff_t>(inner_(index)));
+  }
+
+  // Only when both projections are invertible.
+  template <typename O = Outer, typename I = Inner>
+  constexpr auto inverse(const std::ptrdiff_t base_index) const
+      -> decltype(std::declval<const I&>().inverse(std::declval<const O&>()
+              .inverse(base_index))) {
+    return inner_.inverse(static_cast<std::ptrdiff_t>(
+        outer_.inverse(base_index)));
+  }
+
+  // Only when both projections are piecewise affine.
+  template <typename O = Outer, typename I = Inner>
+  constexpr auto segment(const std::ptrdiff_t index) const noexcept
+      -> std::enable_if_t<has_affine_segments<O>::value &&
+                              has_affine_segments<I>::value,
+                          AffineSegment> {
+    const auto inner = inner_.segment(index);
+    return detail::compose_segments(
+        outer_.segment(inner.offset + inner.stride * index), inner);
+  }
+
+  // Only when outer can walk runs of indices, and inner is piecewise affine.
+  template <typename Fn, typename O = Outer, typename I = Inner>
+  auto walk(std::ptrdiff_t first, const std::ptrdiff_t last, Fn& fn) const
+      -> std::enable_if_t<has_projection_walk<O>::value &&
+                          has_affine_segments<I>::value> {
+    while (first < last) {
+      const auto segment = inner_.segment(first);
+      const auto stop = std::min(segment.last, last);
+      const auto start = segment.offset + segment.stride * first;
+      if (segment.stride == 1) {
+        outer_.walk(start, start + (stop - first), fn);
+      } else {
+        for (auto index = start; first < stop;
+             ++first, index += segment.stride) {
+          fn(outer_(index));
+        }
+      }
+      first = stop;
+    }
+  }
+
+  // Only when inner can walk runs of indices, and the overload above doesn't
+  // apply.
+  template <typename Fn, typename O = Outer, typename I = Inner>
+  auto walk(const std::ptrdiff_t first, const std::ptrdiff_t last, Fn& fn) const
+      -> std::enable_if_t<has_projection_walk<I>::value &&
+                          !(has_projection_walk<O>::value &&
+                            has_affine_segments<I>::value)> {
+    auto apply_outer = [this, &fn](const std::ptrdiff_t index) {
+      fn(outer_(index));
+    };
+    inner_.walk(first, last, apply_outer);
+  }
+
+ private:
+#if __cplusplus >= 202002L
+  [[no_unique_address]]
+#endif
+  Outer outer_;
+#if __cplusplus >= 202002L
+  [[no_unique_address]]
+#endif
+  Inner inner_;
+};
+
+template <typename Outer, typename Inner>
+constexpr auto compose(Outer outer, Inner inner) noexcept;
+
+namespace detail {
+
+template <typename Proj>
+struct is_composed_projection : std::false_type {};
+
+template <typename Outer, typename Inner>
+struct is_composed_projection<ComposedProjection<Outer, Inner>>
+    : std::true_type {};
+
+// Indicates whether Proj is a composition whose outer projection is affine.
+template <typename Proj>
+struct has_affine_outer : std::false_type {};
+
+template <typename Outer, typename Inner>
+struct has_affine_outer<ComposedProjection<Outer, Inner>>
+    : is_affine_projection<Outer> {};
+
+// Selects how compose() combines two projections.  In order of preference:
+enum class ComposeRule {
+  kFuse,         // Both are affine: fuse them into one affine projection.
+  kReassociate,  // outer is a composition: compose right to left.
+  kFuseOuter,    // Fuse outer with inner's affine outer projection.
+  kNest,         // Otherwise, wrap both in a ComposedProjection.
+};
+
+template <typename Outer, typename Inner>
+constexpr ComposeRule compose_rule() noexcept {
+  return is_affine_projection<Outer>::value &&
+             is_affine_projection<Inner>::value
+      ? ComposeRule::kFuse
+      : is_composed_projection<Outer>::value
+      ? ComposeRule::kReassociate
+      : is_affine_projection<Outer>::value && has_affine_outer<Inner>::value
+      ? ComposeRule::kFuseOuter
+      : ComposeRule::kNest;
+}
+
+template <ComposeRule Rule>
+using compose_rule_tag = std::integral_constant<ComposeRule, Rule>;
+
+template <typename Outer, typename Inner>
+constexpr AffineProjection fuse_affine(
+    const Outer& outer, const Inner& inner) noexcept {
+  const auto a = to_affine_projection(outer);
+  const auto b = to_affine_projection(inner);
+  return AffineProjection(
+      a.offset() + a.stride() * b.offset(), a.stride() * b.stride());
+}
+
+// With strides known at compile time, the fused stride is too.
+template <std::ptrdiff_t OuterStride, std::ptrdiff_t InnerStride,
+          typename = std::enable_if_t<OuterStride != dynamic_size &&
+                                      InnerStride != dynamic_size>>
+constexpr StrideProjection<OuterStride * InnerStride> fuse_affine(
+    const StrideProjection<OuterStride>&,
+    const StrideProjection<InnerStride>&) noexcept {
+  return StrideProjection<OuterStride * InnerStride>{};
+}
+
+template <typename Outer, typename Inner>
+constexpr auto compose(
+    Outer outer, Inner inner, compose_rule_tag<ComposeRule::kFuse>) noexcept {
+  return fuse_affine(outer, inner);
+}
+
+template <typename Outer, typename Inner>
+constexpr auto compose(
+    Outer outer, Inner inner,
+    compose_rule_tag<ComposeRule::kReassociate>) noexcept {
+  return jz::compose(outer.outer(), jz::compose(outer.inner(), inner));
+}
+
+template <typename Outer, typename Inner>
+constexpr auto compose(
+    Outer outer, Inner inner,
+    compose_rule_tag<ComposeRule::kFuseOuter>) noexcept {
+  return jz::compose(jz::compose(outer, inner.outer()), inner.inner());
+}
+
+template <typename Outer, typename Inner>
+constexpr auto compose(
+    Outer outer, Inner inner, compose_rule_tag<ComposeRule::kNest>) noexcept {
+  return ComposedProjection<Outer, Inner>(std::move(outer), std::move(inner));
+}
+
+}  // namespace detail
+
+// Returns the projection that applies inner to an index, then outer to the
+// result, i.e. outer(inner(index)).  Viewing a view through a projection
+// composes the projections this way: the base view's projection is outer.
+//
+// Affine projections (see is_affine_projection) fuse into a single
+// AffineProjection, or a StrideProjection when its stride is known at compile
+// time, so a stack of them costs one multiply-add per access.  Nested
+// compositions flatten, and affine projections next to each other anywhere in
+// the chain fuse.
+template <typename Outer, typename Inner>
+constexpr auto compose(Outer outer, Inner inner) noexcept {
+  return detail::compose(
+      std::move(outer), std::move(inner),
+      detail::compose_rule_tag<detail::compose_rule<Outer, Inner>()>{});
+}
+
+// Flattens a projection of a ProjIter into a single ProjIter over the
+// original base, with the two projections composed.  Without this, each
+// access to the outer iterator first computes an inner iterator, and then
+// projects from there, as make_projection_iterator() arranges for ProjIter
+// bases.
+template <typename Iter, typename BaseProj, typename Proj>
+constexpr auto make_flattened_projection_iterator(
+    const ProjIter<Iter, BaseProj>& base, Proj projection) noexcept {
+  // The base iterator may not be at index 0, so shift our indices by its.
+  auto flat = compose(
+      base.projection(),
+      compose(make_affine_projection(base.index(), 1), std::move(projection)));
+  return make_projection_iterator(base.base(), std::move(flat));
+}
+
+}  // namespace jz
+
+#endif // PROJECTIONS_HH_
@@ -0,0 +1,313 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+#ifndef SCRATCH_ARENA_HH_
+#define SCRATCH_ARENA_HH_
+
+static_assert(__cplusplus >= 201703L, "Requires C++17 or newer.");
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+#include "apply_projection.hh"
+#include "batch_sort.hh"
+#include "projected_algorithms.hh"
+
+namespace jz {
+
+// A memory resource that hands out scratch memory by bumping a pointer
+// through chunks it holds on to.  Deallocating does nothing; instead, a Scope
+// gives back everything allocated since it began when it ends, and reset()
+// gives back everything.  The chunks stay, so once an arena has grown to fit
+// a workload, repeating that workload allocates nothing more from upstream.
+//
+// The projected algorithms below take an arena in place of their scratch
+// vectors, and open a Scope for each call.  To keep one per thread, use
+// thread_scratch_arena():
+//
+//     jz::projected_sort(first, last, std::less<>{},
+//                        jz::thread_scratch_arena());
+//
+// An arena isn't thread safe, so each thread needs its own.
+class ScratchArena : public std::pmr::memory_resource {
+ public:
+  // The size of the first chunk, unless the constructor is told otherwise.
+  // Each later chunk is at least twice the size of the one before.
+  static constexpr std::size_t kDefaultChunkSize = std::size_t{64} << 10;
+
+  // Marks how much of an arena is in use, and rewinds the arena to that mark
+  // when it ends.  Memory allocated from the arena during the Scope mustn't
+  // be used after it ends.  Scopes must end in the opposite order to the
+  // order they began in.
+  class Scope {
+   public:
+    explicit Scope(ScratchArena& arena) noexcept
+    : arena_{arena}, chunk_{arena.chunk_}, used_{arena.used_} {}
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+    ~Scope() {
+      arena_.chunk_ = chunk_;
+      arena_.used_ = used_;
+    }
+
+   private:
+    ScratchArena& arena_;
+    std::size_t chunk_;
+    std::size_t used_;
+  };
+
+  explicit ScratchArena(
+      const std::size_t chunk_size = kDefaultChunkSize,
+      std::pmr::memory_resource* const upstream =
+          std::pmr::get_default_resource()) noexcept
+  : upstream_{upstream}, chunk_size_{std::max(chunk_size, std::size_t{1})} {}
+
+  ScratchArena(const ScratchArena&) = delete;
+  ScratchArena& operator=(const ScratchArena&) = delete;
+
+  ~ScratchArena() override {
+    for (const auto& chunk : chunks_) {
+      upstream_->deallocate(chunk.data, chunk.size, kChunkAlignment);
+    }
+  }
+
+  // Gives back everything allocated from the arena, keeping the chunks.
+  void reset() noexcept {
+    chunk_ = 0;
+    used_ = 0;
+  }
+
+  // Returns the total size of the chunks we hold.
+  std::size_t capacity() const noexcept {
+    auto total = std::size_t{0};
+    for (const auto& chunk : chunks_) {
+      total += chunk.size;
+    }
+    return total;
+  }
+
+ private:
+  static constexpr std::size_t kChunkAlignment = alignof(std::max_align_t);
+
+  struct Chunk {
+    std::byte* data;
+    std::size_t size;
+  };
+
+  std::pmr::memory_resource* upstream_;
+  std::size_t chunk_size_;
+  std::vector<Chunk> chunks_;
+  std::size_t chunk_ = 0;  // The chunk we're allocating from.
+  std::size_t used_ = 0;   // How many of its bytes are in use.
+
+  // Allocates from the current chunk, or returns nullptr if it's too full.
+  void* carve_(const std::size_t bytes, const std::size_t alignment) noexcept {
+    const auto& chunk = chunks_[chunk_];
+    const auto address = reinterpret_cast<std::uintptr_t>(chunk.data);
+    const auto start =
+        ((address + used_ + alignment - 1) & ~(alignment - 1)) - address;
+    if (start > chunk.size || chunk.size - start < bytes) {
+      return nullptr;
+    }
+    used_ = start + bytes;
+    return chunk.data + start;
+  }
+
+  void* do_allocate(const std::size_t bytes,
+                    const std::size_t alignment) override {
+    for (; chunk_ < chunks_.size(); ++chunk_, used_ = 0) {
+      if (const auto memory = carve_(bytes, alignment)) {
+        return memory;
+      }
+    }
+
+    // None of our chunks has room, so add one.
+    const auto size = std::max({
+        bytes + alignment, chunk_size_,
+        chunks_.empty() ? std::size_t{0} : 2 * chunks_.back().size});
+    chunks_.reserve(chunks_.size() + 1);
+    chunks_.push_back(Chunk{
+        static_cast<std::byte*>(upstream_->allocate(size, kChunkAlignment)),
+        size});
+    chunk_ = chunks_.size() - 1;
+    used_ = 0;
+    return carve_(bytes, alignment);
+  }
+
+  void do_deallocate(void*, std::size_t, std::size_t) override {}
+
+  bool do_is_equal(
+      const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+};
+
+// Returns the calling thread's own ScratchArena.
+inline ScratchArena& thread_scratch_arena() {
+  thread_local ScratchArena arena;
+  return arena;
+}
+
+namespace detail {
+
+// Sorts [first, last) stably with a bottom-up merge sort, moving elements
+// back and forth between it and buffer, which must have room for as many.
+// Unlike std::stable_sort, this never allocates.  Returns whichever of
+// first and buffer ends up holding the sorted elements.
+template <typename T, typename Compare>
+T* buffered_stable_sort(T* const first, T* const last, T* const buffer,
+                        Compare comp) {
+  constexpr auto kRunSize = std::ptrdiff_t{32};
+  const auto n = last - first;
+  for (auto run = first; run != last;) {
+    const auto run_last = run + std::min(kRunSize, last - run);
+    for (auto it = run + 1; it < run_last; ++it) {
+      auto value = std::move(*it);
+      auto hole = it;
+      for (; hole != run && comp(value, *(hole - 1)); --hole) {
+        *hole = std::move(*(hole - 1));
+      }
+      *hole = std::move(value);
+    }
+    run = run_last;
+  }
+
+  auto src = first;
+  auto dst = buffer;
+  for (auto width = kRunSize; width < n; width *= 2) {
+    for (auto lo = std::ptrdiff_t{0}; lo < n; lo += 2 * width) {
+      const auto mid = std::min(lo + width, n);
+      const auto hi = std::min(lo + 2 * width, n);
+      move_merge(src + lo, src + mid, src + mid, src + hi, dst + lo, comp);
+    }
+    std::swap(src, dst);
+  }
+  return src;
+}
+
+}  // namespace detail
+
+// Counterparts of the projected algorithms that take their scratch storage
+// from arena, rather than the heap.  Each gives back what it took from the
+// arena before returning.
+
+template <typename RandomIt, typename Compare>
+void projected_sort(
+    RandomIt first, RandomIt last, Compare comp, ScratchArena& arena) {
+  using T = typename std::iterator_traits<RandomIt>::value_type;
+  const ScratchArena::Scope scope(arena);
+  auto scratch = std::pmr::vector<T>(&arena);
+  scratch.reserve(std::distance(first, last));
+  projected_sort(first, last, comp, scratch);
+}
+
+// Unlike the other projected_stable_sort() overloads, this sorts with a
+// merge sort of its own, as std::stable_sort allocates its own buffer.  The
+// value type must be default constructible.
+template <typename RandomIt, typename Compare>
+void projected_stable_sort(
+    RandomIt first, RandomIt last, Compare comp, ScratchArena& arena) {
+  using T = typename std::iterator_traits<RandomIt>::value_type;
+  const auto size = static_cast<std::size_t>(std::distance(first, last));
+  const ScratchArena::Scope scope(arena);
+  auto scratch = std::pmr::vector<T>(&arena);
+  scratch.reserve(size);
+  detail::gather(first, last, scratch);
+  auto buffer = std::pmr::vector<T>(size, &arena);
+  const auto sorted = detail::buffered_stable_sort(
+      scratch.data(), scratch.data() + size, buffer.data(), comp);
+  detail::scatter(sorted, first, last);
+}
+
+template <typename RandomIt>
+void projected_radix_sort(RandomIt first, RandomIt last, ScratchArena& arena) {
+  using T = typename std::iterator_traits<RandomIt>::value_type;
+  const ScratchArena::Scope scope(arena);
+  auto scratch = std::pmr::vector<T>(&arena);
+  scratch.reserve(2 * static_cast<std::size_t>(std::distance(first, last)));
+  projected_radix_sort(first, last, scratch);
+}
+
+template <typename RandomIt1, typename RandomIt2, typename OutputIt,
+          typename Compare>
+OutputIt projected_merge(
+    RandomIt1 first1, RandomIt1 last1, RandomIt2 first2, RandomIt2 last2,
+    OutputIt out, Compare comp, ScratchArena& arena) {
+  using T = typename std::iterator_traits<RandomIt1>::value_type;
+  const auto na = static_cast<std::ptrdiff_t>(last1 - first1);
+  const auto nb = static_cast<std::ptrdiff_t>(last2 - first2);
+  const ScratchArena::Scope scope(arena);
+  auto scratch_a = std::pmr::vector<T>(&arena);
+  auto scratch_b = std::pmr::vector<T>(&arena);
+  scratch_a.reserve(std::min(na, detail::kMergeBlockSize));
+  scratch_b.reserve(std::min(nb, detail::kMergeBlockSize));
+  return detail::merge_slice(first1, na, first2, nb, 0, na + nb, out, comp,
+                             scratch_a, scratch_b);
+}
+
+template <typename RandomIt, typename Compare>
+void folded_interleave_sort(
+    RandomIt first, RandomIt last, Compare comp, ScratchArena& arena) {
+  using T = typename std::iterator_traits<RandomIt>::value_type;
+  const ScratchArena::Scope scope(arena);
+  auto scratch = std::pmr::vector<T>(&arena);
+  scratch.reserve(std::distance(first, last));
+  folded_interleave_sort(first, last, comp, scratch);
+}
+
+template <typename RandomIt, typename IndexIt, typename Compare>
+void projected_resort(
+    RandomIt first, RandomIt last, IndexIt dirty_first, IndexIt dirty_last,
+    Compare comp, ScratchArena& arena) {
+  const ScratchArena::Scope scope(arena);
+  detail::projected_resort(
+      first, last, dirty_first, dirty_last, comp,
+      std::pmr::polymorphic_allocator<std::ptrdiff_t>(&arena));
+}
+
+template <typename RandomIt, typename Proj>
+void apply_projection(
+    RandomIt first, RandomIt last, const Proj& projection,
+    ScratchArena& arena) {
+  using T = typename std::iterator_traits<RandomIt>::value_type;
+  const ScratchArena::Scope scope(arena);
+  auto scratch = std::pmr::vector<T>(&arena);
+  scratch.reserve(std::distance(first, last));
+  apply_projection(first, last, projection, scratch);
+}
+
+template <typename RandomIt, typename Proj>
+void apply_inverse_projection(
+    RandomIt first, RandomIt last, const Proj& projection,
+    ScratchArena& arena) {
+  using T = typename std::iterator_traits<RandomIt>::value_type;
+  const ScratchArena::Scope scope(arena);
+  auto scratch = std::pmr::vector<T>(&arena);
+  scratch.reserve(std::distance(first, last));
+  apply_inverse_projection(first, last, projection, scratch);
+}
+
+template <typename SpanIt, typename MakeProjection, typename Compare>
+void batch_projected_sort(
+    SpanIt first, SpanIt last, MakeProjection make_projection, Compare comp,
+    ScratchArena& arena) {
+  using T = typename std::iterator_traits<
+      decltype(std::begin(*first))>::value_type;
+  const ScratchArena::Scope scope(arena);
+  auto positions = detail::NetworkPositions<
+      std::pmr::polymorphic_allocator<std::ptrdiff_t>>(&arena);
+  auto scratch = std::pmr::vector<T>(&arena);
+  scratch.reserve(kMaxBatchNetworkSize);
+  detail::batch_projected_sort(first, last, make_projection, comp, positions,
+                               scratch);
+}
+
+}  // namespace jz
+
+#endif // SCRATCH_ARENA_HH_
@@ -0,0 +1,319 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+#ifndef TABLE_PROJECTION_HH_
+#define TABLE_PROJECTION_HH_
+
+static_assert(__cplusplus >= 201402L, "Requires C++14 or newer.");
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "projected_algorithms.hh"
+#include "projection_iterator.hh"
+#include "projections.hh"
+
+namespace jz {
+
+// Evaluates a projection once for each index in [0, size), and serves later
+// lookups from the resulting table.  This pays off for projections that cost
+// more than a load per call, such as hash-based layouts, when the same view
+// is walked or sorted more than once.
+//
+// IndexT is the unsigned type the table stores, and must be able to hold
+// every projected index.  A narrower type makes the table smaller, so it
+// takes less cache and memory bandwidth to walk; visit_table_projection()
+// below picks the narrowest type that fits.
+//
+// The table is as large as the view, so copying a TableProjection copies the
+// table.  To use one with ProjIter, wrap it with proj_ref() so the iterators
+// share it, or view through it with ProjectedView, which holds it once.
+template <typename IndexT>
+class TableProjection {
+  static_assert(std::is_unsigned<IndexT>::value,
+                "Table index type must be unsigned.");
+
+ public:
+  using index_type = IndexT;
+
+  TableProjection() = default;
+
+  template <typename Proj>
+  TableProjection(const Proj& projection, const std::ptrdiff_t size)
+  : table_(size) {
+    fill_(projection, 0, size);
+  }
+
+#ifdef JZ_PROJECTED_ALGORITHMS_HAS_EXECUTION
+  // As above, but fills the table in parallel for parallel policies.  The
+  // projection must be safe to call concurrently.
+  template <typename ExecutionPolicy, typename Proj,
+            typename = detail::enable_if_execution_policy_t<ExecutionPolicy>>
+  TableProjection(
+      ExecutionPolicy&&, const Proj& projection, const std::ptrdiff_t size)
+  : table_(size) {
+    const auto tasks = detail::is_parallel_policy_v<ExecutionPolicy>
+        ? detail::parallel_task_count(size) : 1u;
+    detail::run_parallel_tasks(tasks, [&](const unsigned task) {
+      fill_(projection, size * task / tasks, size * (task + 1) / tasks);
+    });
+  }
+#endif
+
+  std::ptrdiff_t size() const noexcept {
+    return static_cast<std::ptrdiff_t>(table_.size());
+  }
+
+  const IndexT* data() const noexcept { return table_.data(); }
+
+  std::ptrdiff_t operator()(const std::ptrdiff_t index) const noexcept {
+    return static_cast<std::ptrdiff_t>(table_[index]);
+  }
+
+ private:
+  std::vector<IndexT> table_;
+
+  template <typename Proj>
+  void fill_(
+      const Proj& projection, const std::ptrdiff_t first,
+      const std::ptrdiff_t last) {
+    for (auto index = first; index < last; ++index) {
+      const auto projected = projection(index);
+      assert(projected >= 0 &&
+             static_cast<std::uint64_t>(projected) <=
+                 std::numeric_limits<IndexT>::max());
+      table_[index] = static_cast<IndexT>(projected);
+    }
+  }
+};
+
+// Provides template argument deduction for the projection type.
+template <typename IndexT, typename Proj>
+TableProjection<IndexT> make_table_projection(
+    const Proj& projection, const std::ptrdiff_t size) {
+  return TableProjection<IndexT>(projection, size);
+}
+
+#ifdef JZ_PROJECTED_ALGORITHMS_HAS_EXECUTION
+template <typename IndexT, typename ExecutionPolicy, typename Proj,
+          typename = detail::enable_if_execution_policy_t<ExecutionPolicy>>
+TableProjection<IndexT> make_table_projection(
+    ExecutionPolicy&& policy, const Proj& projection,
+    const std::ptrdiff_t size) {
+  return TableProjection<IndexT>(
+      std::forward<ExecutionPolicy>(policy), projection, size);
+}
+#endif
+
+namespace detail {
+
+// The table index types, narrowest first.
+enum class TableWidth { k16, k32, k64 };
+
+inline TableWidth table_width(const std::ptrdiff_t index_limit) noexcept {
+  return index_limit <= std::ptrdiff_t{1} << 16 ? TableWidth::k16
+       : index_limit <= std::ptrdiff_t{1} << 32 ? TableWidth::k32
+       : TableWidth::k64;
+}
+
+template <typename Fn>
+using table_visit_result_t =
+    decltype(std::declval<Fn&>()(
+        std::declval<const TableProjection<std::uint16_t>&>()));
+
+template <typename IndexT, typename Proj, typename Fn>
+table_visit_result_t<Fn> visit_new_table(
+    const Proj& projection, const std::ptrdiff_t size, Fn& fn) {
+  const auto table = TableProjection<IndexT>(projection, size);
+  return fn(table);
+}
+
+}  // namespace detail
+
+// Builds a TableProjection for projection over [0, size) with the narrowest
+// index type that holds every index below index_limit, and returns
+// fn(table).  fn must accept a table of any index type, e.g. with a generic
+// lambda, and return the same type for each:
+//
+//     jz::visit_table_projection(shard_layout, v.size(), [&](auto& table) {
+//       auto view = jz::make_projected_view(v, jz::proj_ref(table));
+//       jz::projected_sort(view.begin(), view.end());
+//     });
+//
+// The projection's values must all be below index_limit.  The overload
+// without one assumes they're below size, as for a permutation of the view.
+template <typename Proj, typename Fn>
+detail::table_visit_result_t<Fn> visit_table_projection(
+    const Proj& projection, const std::ptrdiff_t size,
+    const std::ptrdiff_t index_limit, Fn&& fn) {
+  switch (detail::table_width(index_limit)) {
+    case detail::TableWidth::k16:
+      return detail::visit_new_table<std::uint16_t>(projection, size, fn);
+    case detail::TableWidth::k32:
+      return detail::visit_new_table<std::uint32_t>(projection, size, fn);
+    default:
+      return detail::visit_new_table<std::uint64_t>(projection, size, fn);
+  }
+}
+
+template <typename Proj, typename Fn>
+detail::table_visit_result_t<Fn> visit_table_projection(
+    const Proj& projection, const std::ptrdiff_t size, Fn&& fn) {
+  return visit_table_projection(
+      projection, size, size, std::forward<Fn>(fn));
+}
+
+namespace detail {
+
+// Returns an address unique to T, to key on types without RTTI.
+template <typename T>
+const void* type_key() noexcept {
+  static const char key = 0;
+  return &key;
+}
+
+}  // namespace detail
+
+// Keeps the most recently used tables, so that repeatedly viewing same-sized
+// ranges through the same projection only builds the table once.
+//
+// visit() keys tables by the projection's type and the view's size, so it
+// only takes projections that the size alone determines (see
+// is_size_determined_projection), such as those built by
+// make_folded_interleave_projection().  For projections with other state,
+// such as a transposition's shape or a lambda that captures a hash seed,
+// visit_keyed() takes a key as well, which must tell apart every projection
+// of the same type and size that the cache sees:
+//
+//     cache.visit_keyed(shard_layout, seed, v.size(), [&](auto& table) {
+//       ...
+//     });
+//
+// This is safe to use from multiple threads.  A table stays alive while a
+// visit() that's using it runs, even if another thread evicts it meanwhile.
+class TableProjectionCache {
+ public:
+  explicit TableProjectionCache(const std::size_t capacity = 8)
+  : capacity_{std::max<std::size_t>(capacity, 1)} {}
+
+  TableProjectionCache(const TableProjectionCache&) = delete;
+  TableProjectionCache& operator=(const TableProjectionCache&) = delete;
+
+  // As visit_table_projection(), but reuses a cached table for projection's
+  // type and size if there is one, and otherwise builds and caches one,
+  // evicting the least recently used table if the cache is full.
+  template <typename Proj, typename Fn>
+  detail::table_visit_result_t<Fn> visit(
+      const Proj& projection, const std::ptrdiff_t size,
+      const std::ptrdiff_t index_limit, Fn&& fn) {
+    static_assert(is_size_determined_projection<Proj>::value,
+                  "The size doesn't determine this projection; use "
+                  "visit_keyed().");
+    return visit_keyed(projection, 0, size, index_limit, std::forward<Fn>(fn));
+  }
+
+  template <typename Proj, typename Fn>
+  detail::table_visit_result_t<Fn> visit(
+      const Proj& projection, const std::ptrdiff_t size, Fn&& fn) {
+    return visit(projection, size, size, std::forward<Fn>(fn));
+  }
+
+  // As visit(), for any projection, keying tables by key as well as the
+  // projection's type and size.
+  template <typename Proj, typename Fn>
+  detail::table_visit_result_t<Fn> visit_keyed(
+      const Proj& projection, const std::uint64_t key,
+      const std::ptrdiff_t size, const std::ptrdiff_t index_limit, Fn&& fn) {
+    switch (detail::table_width(index_limit)) {
+      case detail::TableWidth::k16:
+        return fn(*find_or_build_<std::uint16_t>(projection, key, size));
+      case detail::TableWidth::k32:
+        return fn(*find_or_build_<std::uint32_t>(projection, key, size));
+      default:
+        return fn(*find_or_build_<std::uint64_t>(projection, key, size));
+    }
+  }
+
+  template <typename Proj, typename Fn>
+  detail::table_visit_result_t<Fn> visit_keyed(
+      const Proj& projection, const std::uint64_t key,
+      const std::ptrdiff_t size, Fn&& fn) {
+    return visit_keyed(projection, key, size, size, std::forward<Fn>(fn));
+  }
+
+  // Drops every cached table.
+  void clear() {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    entries_.clear();
+  }
+
+ private:
+  struct Entry {
+    const void* type;
+    std::uint64_t key;
+    std::ptrdiff_t size;
+    const void* index_type;
+    std::shared_ptr<const void> table;
+  };
+
+  std::size_t capacity_;
+  std::mutex mutex_;
+  std::vector<Entry> entries_;  // Most recently used first.
+
+  template <typename IndexT, typename Proj>
+  std::shared_ptr<const TableProjection<IndexT>> find_or_build_(
+      const Proj& projection, const std::uint64_t proj_key,
+      const std::ptrdiff_t size) {
+    const auto key = Entry{detail::type_key<Proj>(), proj_key, size,
+                           detail::type_key<IndexT>(), nullptr};
+    if (auto table = find_<IndexT>(key)) {
+      return table;
+    }
+
+    // Build outside the lock, so other threads can use the cache meanwhile.
+    // If another thread builds the same table first, we use ours this time,
+    // and keep theirs.
+    auto table = std::make_shared<const TableProjection<IndexT>>(
+        projection, size);
+    const std::lock_guard<std::mutex> lock{mutex_};
+    if (find_locked_(key) == entries_.end()) {
+      if (entries_.size() == capacity_) {
+        entries_.pop_back();
+      }
+      entries_.insert(entries_.begin(), Entry{key.type, key.key, key.size,
+                                              key.index_type, table});
+    }
+    return table;
+  }
+
+  template <typename IndexT>
+  std::shared_ptr<const TableProjection<IndexT>> find_(const Entry& key) {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    const auto it = find_locked_(key);
+    if (it == entries_.end()) {
+      return nullptr;
+    }
+    std::rotate(entries_.begin(), it, it + 1);
+    return std::static_pointer_cast<const TableProjection<IndexT>>(
+        entries_.front().table);
+  }
+
+  std::vector<Entry>::iterator find_locked_(const Entry& key) {
+    return std::find_if(
+        entries_.begin(), entries_.end(), [&key](const Entry& entry) {
+          return entry.type == key.type && entry.key == key.key &&
+                 entry.size == key.size && entry.index_type == key.index_type;
+        });
+  }
+};
+
+}  // namespace jz
+
+#endif // TABLE_PROJECTION_HH_
@@ -0,0 +1,490 @@
+// Author:  Joe Zbiciak <joe.zbiciak@leftturnonly.info>
+// SPDX-License-Identifier:  CC-BY-SA-4.0
+#ifndef TILED_PROJECTIONS_HH_
+#define TILED_PROJECTIONS_HH_
+
+static_assert(__cplusplus >= 201402L, "Requires C++14 or newer.");
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "projection_iterator.hh"
+#include "projections.hh"
+
+namespace jz {
+
+// Projections that view a row-major Rows x Cols matrix, such as an image, in
+// an order that keeps nearby elements of the view near each other in both
+// dimensions.  Row-major order is the identity, StrideProjection<1>, and
+// column-major order is TranspositionProjection in projections.hh, or
+// equivalently, a TiledProjection with Rows x 1 tiles.
+//
+// Each computes any single index on its own, so random access through a
+// ProjIter works as usual.  In-order walks such as projected_for_each(),
+// projected_copy() and projected_transform() avoid that per-element cost:
+// TiledProjection describes each row of each tile as an affine segment, and
+// the space-filling curves step from one element to the next with walk() (see
+// has_projection_walk), descending the curve's quadrants recursively.  Either
+// way, a pass over the whole view finishes each tile or quadrant before
+// starting the next, so it works within a few cache lines and pages at a time.
+namespace detail {
+
+// Gathers the even bits of bits into the low half, for Morton decoding.
+constexpr std::uint64_t compact_even_bits(std::uint64_t bits) noexcept {
+  bits &= 0x5555555555555555u;
+  bits = (bits | bits >> 1)  & 0x3333333333333333u;
+  bits = (bits | bits >> 2)  & 0x0F0F0F0F0F0F0F0Fu;
+  bits = (bits | bits >> 4)  & 0x00FF00FF00FF00FFu;
+  bits = (bits | bits >> 8)  & 0x0000FFFF0000FFFFu;
+  bits = (bits | bits >> 16) & 0x00000000FFFFFFFFu;
+  return bits;
+}
+
+// Inverts compact_even_bits(), spreading the low half into the even bits.
+constexpr std::uint64_t spread_even_bits(std::uint64_t bits) noexcept {
+  bits &= 0x00000000FFFFFFFFu;
+  bits = (bits | bits << 16) & 0x0000FFFF0000FFFFu;
+  bits = (bits | bits << 8)  & 0x00FF00FF00FF00FFu;
+  bits = (bits | bits << 4)  & 0x0F0F0F0F0F0F0F0Fu;
+  bits = (bits | bits << 2)  & 0x3333333333333333u;
+  bits = (bits | bits << 1)  & 0x5555555555555555u;
+  return bits;
+}
+
+// The quadrant orders of the space-filling curves.  Within a square, base
+// offsets are offset + du * u + dv * v for coordinates (u, v), where du and dv
+// orient the square.  child() turns a square's orientation into that of its
+// q'th quadrant, of side half, and leaf() visits a 2 x 2 square in order.
+//
+// The Morton, or Z-order, curve visits (0, 0), (1, 0), (0, 1), (1, 1) in
+// every square, with the same orientation.
+struct MortonCurve {
+  static void child(const int q, const std::ptrdiff_t half,
+                    std::ptrdiff_t& offset, std::ptrdiff_t&,
+                    std::ptrdiff_t&, const std::ptrdiff_t du,
+                    const std::ptrdiff_t dv) noexcept {
+    offset += (q & 1 ? du * half : 0) + (q & 2 ? dv * half : 0);
+  }
+
+  template <typename Fn>
+  static void leaf(const std::ptrdiff_t offset, const std::ptrdiff_t du,
+                   const std::ptrdiff_t dv, Fn& fn) {
+    fn(offset);
+    fn(offset + du);
+    fn(offset + dv);
+    fn(offset + du + dv);
+  }
+};
+
+// The Hilbert curve visits (0, 0), (0, 1), (1, 1), (1, 0), transposing the
+// first quadrant and anti-transposing the last, so that each quadrant's curve
+// ends next to where the next one starts.
+struct HilbertCurve {
+  static void child(const int q, const std::ptrdiff_t half,
+                    std::ptrdiff_t& offset, std::ptrdiff_t& child_du,
+                    std::ptrdiff_t& child_dv, const std::ptrdiff_t du,
+                    const std::ptrdiff_t dv) noexcept {
+    switch (q) {
+      case 0:
+        child_du = dv;
+        child_dv = du;
+        break;
+      case 1:
+        offset += dv * half;
+        break;
+      case 2:
+        offset += (du + dv) * half;
+        break;
+      default:
+        offset += du * (2 * half - 1) + dv * (half - 1);
+        child_du = -dv;
+        child_dv = -du;
+        break;
+    }
+  }
+
+  template <typename Fn>
+  static void leaf(const std::ptrdiff_t offset, const std::ptrdiff_t du,
+                   const std::ptrdiff_t dv, Fn& fn) {
+    fn(offset);
+    fn(offset + dv);
+    fn(offset + du + dv);
+    fn(offset + du);
+  }
+};
+
+// Calls fn on the base offset of each index in [first, last) within the
+// square of the given side whose curve starts at index.
+template <typename Curve, typename Fn>
+void walk_curve_square(
+    const std::ptrdiff_t offset, const std::ptrdiff_t du,
+    const std::ptrdiff_t dv, const std::ptrdiff_t side,
+    const std::ptrdiff_t index, const std::ptrdiff_t first,
+    const std::ptrdiff_t last, Fn& fn) {
+  if (side == 1) {
+    fn(offset);
+    return;
+  }
+  if (side == 2 && first <= index && index + 4 <= last) {
+    Curve::leaf(offset, du, dv, fn);
+    return;
+  }
+  const auto half = side / 2;
+  const auto quarter = half * half;
+  for (auto q = 0; q < 4; ++q) {
+    const auto child = index + q * quarter;
+    if (child >= last) {
+      break;
+    }
+    if (child + quarter <= first) {
+      continue;
+    }
+    auto child_offset = offset;
+    auto child_du = du;
+    auto child_dv = dv;
+    Curve::child(q, half, child_offset, child_du, child_dv, du, dv);
+    walk_curve_square<Curve>(child_offset, child_du, child_dv, half, child,
+                             first, last, fn);
+  }
+}
+
+// As above, over a row of squares of side 2^log2_side, block_step elements
+// apart in the base, which the curve visits one after the other.
+template <typename Curve, typename Fn>
+void walk_curve(
+    const int log2_side, const std::ptrdiff_t block_step,
+    const std::ptrdiff_t du, const std::ptrdiff_t dv,
+    const std::ptrdiff_t first, const std::ptrdiff_t last, Fn& fn) {
+  const auto side = std::ptrdiff_t{1} << log2_side;
+  const auto block_size = side * side;
+  for (auto block = first / block_size; block * block_size < last; ++block) {
+    walk_curve_square<Curve>(block * block_step, du, dv, side,
+                             block * block_size, first, last, fn);
+  }
+}
+
+}  // namespace detail
+
+// Views a row-major Rows x Cols matrix a tile at a time: tiles of TileRows x
+// TileCols elements in row-major order, each walked in row-major order.  The
+// matrix needn't be a multiple of the tile shape: tiles along the right and
+// bottom edges are clipped to fit.  For a 3 x 5 matrix with 2 x 2 tiles:
+//
+//      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14
+//
+// is laid out in memory as:
+//
+//      0,  1,  4,  5,  8,
+//      2,  3,  6,  7,  9,
+//      10, 11, 12, 13, 14
+//
+// The tile shape is fixed at compile time or given to the constructor, and
+// the matrix shape is always given to the constructor.  Each row of a tile is
+// an affine segment.
+template <std::ptrdiff_t TileRows = dynamic_size,
+          std::ptrdiff_t TileCols = dynamic_size>
+class TiledProjection
+    : private detail::ShapeParam<TileRows, 0>,
+      private detail::ShapeParam<TileCols, 1> {
+  using TileRowsParam = detail::ShapeParam<TileRows, 0>;
+  using TileColsParam = detail::ShapeParam<TileCols, 1>;
+
+ public:
+  constexpr TiledProjection(
+      const std::ptrdiff_t rows, const std::ptrdiff_t cols) noexcept
+  : rows_{rows}, cols_{cols} {}
+
+  constexpr TiledProjection(
+      const std::ptrdiff_t rows, const std::ptrdiff_t cols,
+      const std::ptrdiff_t tile_rows, const std::ptrdiff_t tile_cols) noexcept
+  : TileRowsParam{tile_rows}, TileColsParam{tile_cols},
+    rows_{rows}, cols_{cols} {}
+
+  constexpr std::ptrdiff_t rows() const noexcept { return rows_; }
+  constexpr std::ptrdiff_t cols() const noexcept { return cols_; }
+  constexpr std::ptrdiff_t size() const noexcept { return rows_ * cols_; }
+
+  constexpr std::ptrdiff_t tile_rows() const noexcept {
+    return TileRowsParam::get();
+  }
+
+  constexpr std::ptrdiff_t tile_cols() const noexcept {
+    return TileColsParam::get();
+  }
+
+  constexpr std::ptrdiff_t operator()(const std::ptrdiff_t index)
+      const noexcept {
+    return locate_(index).offset;
+  }
+
+  constexpr AffineSegment segment(const std::ptrdiff_t index) const noexcept {
+    const auto location = locate_(index);
+    const auto first = index - location.col;
+    return AffineSegment{
+        first, first + location.width, location.offset - index, 1};
+  }
+
+  constexpr std::ptrdiff_t inverse(const std::ptrdiff_t base_index)
+      const noexcept {
+    const auto y = base_index / cols_;
+    const auto x = base_index - y * cols_;
+    const auto band = y / tile_rows();
+    const auto tile = x / tile_cols();
+    return band * band_size_() + tile * band_height_(band) * tile_cols() +
+           (y - band * tile_rows()) * tile_width_(tile) +
+           (x - tile * tile_cols());
+  }
+
+ private:
+  std::ptrdiff_t rows_;
+  std::ptrdiff_t cols_;
+
+  // An index's base offset, and its column within a tile of the given width.
+  struct Location {
+    std::ptrdiff_t offset;
+    std::ptrdiff_t col;
+    std::ptrdiff_t width;
+  };
+
+  // The view holds a band of tiles the full width of the matrix at a time.
+  constexpr std::ptrdiff_t band_size_() const noexcept {
+    return tile_rows() * cols_;
+  }
+
+  constexpr std::ptrdiff_t band_height_(const std::ptrdiff_t band)
+      const noexcept {
+    return std::min(tile_rows(), rows_ - band * tile_rows());
+  }
+
+  constexpr std::ptrdiff_t tile_width_(const std::ptrdiff_t tile)
+      const noexcept {
+    return std::min(tile_cols(), cols_ - tile * tile_cols());
+  }
+
+  // Every tile but the last in a band is full width, so the tile is found
+  // with one division, and clamped to the last.
+  constexpr Location locate_(const std::ptrdiff_t index) const noexcept {
+    const auto band = index / band_size_();
+    const auto in_band = index - band * band_size_();
+    const auto height = band_height_(band);
+    const auto tile = std::min(in_band / (height * tile_cols()),
+                               (cols_ - 1) / tile_cols());
+    const auto in_tile = in_band - tile * height * tile_cols();
+    const auto width = tile_width_(tile);
+    const auto row = in_tile / width;
+    const auto col = in_tile - row * width;
+    return Location{
+        (band * tile_rows() + row) * cols_ + tile * tile_cols() + col,
+        col, width};
+  }
+};
+
+// Views a row-major Rows x Cols matrix in Morton, or Z-order: each 2 x 2
+// square in row-major order, and each 2 x 2 square of those squares likewise,
+// and so on.  For a 4 x 4 matrix:
+//
+//      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+//
+// is laid out in memory as:
+//
+//      0,  1,  4,  5,
+//      2,  3,  6,  7,
+//      8,  9,  12, 13,
+//      10, 11, 14, 15
+//
+// Rows and Cols must be powers of two.  A matrix that's wider than it is tall
+// is viewed as a row of square matrices, one after the other, and one that's
+// taller than it is wide, as a column of them.  Each index computes with a
+// few shifts and masks.
+template <std::ptrdiff_t Rows = dynamic_size,
+          std::ptrdiff_t Cols = dynamic_size>
+class MortonProjection
+    : private detail::ShapeParam<Rows, 0>, private detail::ShapeParam<Cols, 1> {
+  using RowsParam = detail::ShapeParam<Rows, 0>;
+  using ColsParam = detail::ShapeParam<Cols, 1>;
+
+ public:
+  constexpr MortonProjection() noexcept = default;
+
+  constexpr MortonProjection(
+      const std::ptrdiff_t rows, const std::ptrdiff_t cols) noexcept
+  : RowsParam{rows}, ColsParam{cols} {}
+
+  constexpr std::ptrdiff_t rows() const noexcept { return RowsParam::get(); }
+  constexpr std::ptrdiff_t cols() const noexcept { return ColsParam::get(); }
+  constexpr std::ptrdiff_t size() const noexcept { return rows() * cols(); }
+
+  constexpr std::ptrdiff_t operator()(const std::ptrdiff_t index)
+      const noexcept {
+    const auto log2_side = log2_side_();
+    const auto bits = static_cast<std::uint64_t>(index);
+    const auto in_block = bits & ((std::uint64_t{1} << 2 * log2_side) - 1);
+    const auto block = bits >> 2 * log2_side;
+    auto x = detail::compact_even_bits(in_block);
+    auto y = detail::compact_even_bits(in_block >> 1);
+    (cols() >= rows() ? x : y) |= block << log2_side;
+    return static_cast<std::ptrdiff_t>(
+        y << detail::log2_pow2(cols()) | x);
+  }
+
+  constexpr std::ptrdiff_t inverse(const std::ptrdiff_t base_index)
+      const noexcept {
+    const auto log2_side = log2_side_();
+    const auto bits = static_cast<std::uint64_t>(base_index);
+    const auto side_mask = (std::uint64_t{1} << log2_side) - 1;
+    const auto x = bits & static_cast<std::uint64_t>(cols() - 1);
+    const auto y = bits >> detail::log2_pow2(cols());
+    const auto block = (cols() >= rows() ? x : y) >> log2_side;
+    return static_cast<std::ptrdiff_t>(
+        block << 2 * log2_side | detail::spread_even_bits(x & side_mask) |
+        detail::spread_even_bits(y & side_mask) << 1);
+  }
+
+  template <typename Fn>
+  void walk(const std::ptrdiff_t first, const std::ptrdiff_t last, Fn& fn)
+      const {
+    const auto log2_side = log2_side_();
+    const auto side = std::ptrdiff_t{1} << log2_side;
+    detail::walk_curve<detail::MortonCurve>(
+        log2_side, cols() >= rows() ? side : side * cols(), 1, cols(), first,
+        last, fn);
+  }
+
+ private:
+  constexpr int log2_side_() const noexcept {
+    return detail::log2_pow2(std::min(rows(), cols()));
+  }
+};
+
+// Views a row-major Rows x Cols matrix along a Hilbert curve, which steps
+// from each element to one of its neighbors.  For a 4 x 4 matrix:
+//
+//      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+//
+// is laid out in memory as:
+//
+//      0,  1,  14, 15,
+//      3,  2,  13, 12,
+//      4,  7,  8,  11,
+//      5,  6,  9,  10
+//
+// Rows and Cols must be powers of two.  As with MortonProjection, other
+// rectangles are viewed as a row or column of squares, oriented so the curve
+// runs from each square into the next.  Each index computes in O(log size)
+// steps, so in-order walks gain the most from walk() here.
+template <std::ptrdiff_t Rows = dynamic_size,
+          std::ptrdiff_t Cols = dynamic_size>
+class HilbertProjection
+    : private detail::ShapeParam<Rows, 0>, private detail::ShapeParam<Cols, 1> {
+  using RowsParam = detail::ShapeParam<Rows, 0>;
+  using ColsParam = detail::ShapeParam<Cols, 1>;
+
+ public:
+  constexpr HilbertProjection() noexcept = default;
+
+  constexpr HilbertProjection(
+      const std::ptrdiff_t rows, const std::ptrdiff_t cols) noexcept
+  : RowsParam{rows}, ColsParam{cols} {}
+
+  constexpr std::ptrdiff_t rows() const noexcept { return RowsParam::get(); }
+  constexpr std::ptrdiff_t cols() const noexcept { return ColsParam::get(); }
+  constexpr std::ptrdiff_t size() const noexcept { return rows() * cols(); }
+
+  // Finds the index's coordinates (u, v) within its square from the lowest
+  // quadrant digit up, reorienting them for each enclosing quadrant.
+  constexpr std::ptrdiff_t operator()(const std::ptrdiff_t index)
+      const noexcept {
+    const auto log2_side = log2_side_();
+    const auto side = std::ptrdiff_t{1} << log2_side;
+    const auto block = index >> 2 * log2_side;
+    auto digits = index & (side * side - 1);
+    auto u = std::ptrdiff_t{0};
+    auto v = std::ptrdiff_t{0};
+    for (auto span = std::ptrdiff_t{1}; span < side; span *= 2, digits /= 4) {
+      const auto ru = 1 & (digits / 2);
+      const auto rv = 1 & (digits ^ ru);
+      reorient_(span, ru, rv, u, v);
+      u += span * ru;
+      v += span * rv;
+    }
+    return cols() >= rows() ? v * cols() + block * side + u
+                            : (block * side + u) * cols() + v;
+  }
+
+  constexpr std::ptrdiff_t inverse(const std::ptrdiff_t base_index)
+      const noexcept {
+    const auto log2_side = log2_side_();
+    const auto side = std::ptrdiff_t{1} << log2_side;
+    const auto x = base_index & (cols() - 1);
+    const auto y = base_index >> detail::log2_pow2(cols());
+    const auto along = cols() >= rows() ? x : y;
+    auto u = along & (side - 1);
+    auto v = cols() >= rows() ? y : x;
+    auto digits = std::ptrdiff_t{0};
+    for (auto span = side / 2; span > 0; span /= 2) {
+      const auto ru = (u & span) ? 1 : 0;
+      const auto rv = (v & span) ? 1 : 0;
+      digits += span * span * ((3 * ru) ^ rv);
+      reorient_(side, ru, rv, u, v);
+    }
+    return (along >> log2_side) << 2 * log2_side | digits;
+  }
+
+  template <typename Fn>
+  void walk(const std::ptrdiff_t first, const std::ptrdiff_t last, Fn& fn)
+      const {
+    const auto log2_side = log2_side_();
+    const auto side = std::ptrdiff_t{1} << log2_side;
+    if (cols() >= rows()) {
+      detail::walk_curve<detail::HilbertCurve>(
+          log2_side, side, 1, cols(), first, last, fn);
+    } else {
+      detail::walk_curve<detail::HilbertCurve>(
+          log2_side, side * cols(), cols(), 1, first, last, fn);
+    }
+  }
+
+ private:
+  constexpr int log2_side_() const noexcept {
+    return detail::log2_pow2(std::min(rows(), cols()));
+  }
+
+  // Transposes the first quadrant of a square of side span, and
+  // anti-transposes the last.
+  static constexpr void reorient_(
+      const std::ptrdiff_t span, const std::ptrdiff_t ru,
+      const std::ptrdiff_t rv, std::ptrdiff_t& u, std::ptrdiff_t& v) noexcept {
+    if (rv == 0) {
+      if (ru == 1) {
+        u = span - 1 - u;
+        v = span - 1 - v;
+      }
+      const auto t = u;
+      u = v;
+      v = t;
+    }
+  }
+};
+
+// Provides argument deduction-friendly construction, in the same style as
+// projections.hh.
+constexpr inline TiledProjection<> make_tiled_projection(
+    const std::ptrdiff_t rows, const std::ptrdiff_t cols,
+    const std::ptrdiff_t tile_rows, const std::ptrdiff_t tile_cols) noexcept {
+  return TiledProjection<>(rows, cols, tile_rows, tile_cols);
+}
+
+constexpr inline MortonProjection<> make_morton_projection(
+    const std::ptrdiff_t rows, const std::ptrdiff_t cols) noexcept {
+  return MortonProjection<>(rows, cols);
+}
+
+constexpr inline HilbertProjection<> make_hilbert_projection(
+    const std::ptrdiff_t rows, const std::ptrdiff_t cols) noexcept {
+  return HilbertProjection<>(rows, cols);
+}
+
+}  // namespace jz
+
+#endif // TILED_PROJECTIONS_HH_